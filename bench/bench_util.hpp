@@ -0,0 +1,66 @@
+#ifndef BENCH_UTIL_HPP
+#define BENCH_UTIL_HPP
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Helpers shared by the tools under bench/.
+namespace worms_server
+{
+    // The nearest-rank percentile of sorted samples, zero if there are none.
+    inline uint32_t Percentile(const std::vector<uint32_t>& sorted, const double fraction)
+    {
+        if (sorted.empty())
+        {
+            return 0;
+        }
+
+        const auto rank = static_cast<size_t>(std::ceil(fraction * static_cast<double>(sorted.size())));
+        return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+    }
+
+    // Parses "<name>=<weight>,..." over names into mix; names left out weigh zero. Returns false, leaving mix
+    // as it was, on an unknown name, a bad weight or all weights zero.
+    template <size_t N>
+    bool ParseMix(const std::string_view spec, const std::array<std::string_view, N>& names,
+                  std::array<uint32_t, N>& mix)
+    {
+        std::array<uint32_t, N> parsed{};
+        for (size_t begin = 0; begin <= spec.size();)
+        {
+            const size_t comma = std::min(spec.find(',', begin), spec.size());
+            const std::string_view entry = spec.substr(begin, comma - begin);
+            begin = comma + 1;
+
+            const size_t equals = entry.find('=');
+            const auto name = std::ranges::find(names, entry.substr(0, equals));
+            if (equals == std::string_view::npos || name == names.end())
+            {
+                return false;
+            }
+
+            const auto value = entry.substr(equals + 1);
+            auto& weight = parsed[static_cast<size_t>(name - names.begin())];
+            if (const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), weight);
+                ec != std::errc() || end != value.data() + value.size())
+            {
+                return false;
+            }
+        }
+
+        if (std::ranges::all_of(parsed, [](const uint32_t weight) { return weight == 0; }))
+        {
+            return false;
+        }
+
+        mix = parsed;
+        return true;
+    }
+} // namespace worms_server
+
+#endif // BENCH_UTIL_HPP
@@ -0,0 +1,284 @@
+// Microbenchmarks for the codec paths every packet goes through: parsing client packets, freezing the
+// outbound shapes the handlers send, SessionInfo, the code page conversions, framing of fragmented input
+// and the case-insensitive name compare. Run with --benchmark_out=<file> --benchmark_out_format=json to
+// keep results for comparing builds.
+
+#include <algorithm>
+#include <cstring>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "framed_packet_reader.hpp"
+#include "packet_code.hpp"
+#include "packet_stream.hpp"
+#include "session_info.hpp"
+#include "string_utils.hpp"
+#include "windows_1251.hpp"
+#include "windows_1252.hpp"
+#include "worms_packet.hpp"
+
+namespace
+{
+    using namespace worms_server;
+
+    constexpr std::string_view ASCII_TEXT = "GRP:[ Player ]  anyone up for a quick game of ninja rope races?";
+    constexpr std::string_view CYRILLIC_TEXT = "GRP:[ Игрок ]  кто хочет сыграть партию на верёвках?";
+    constexpr std::string_view MIXED_TEXT = "GRP:[ Player ]  gg wp, Игрок — rematch? café ½ time";
+
+    std::vector<net::byte> ToBytes(const PacketBufferPtr& packet)
+    {
+        return {packet->bytes().begin(), packet->bytes().end()};
+    }
+
+    // Client packets as the game sends them, one per handler.
+    const std::vector<std::pair<const char*, std::vector<net::byte>>>& ClientCorpus()
+    {
+        static const std::vector<std::pair<const char*, std::vector<net::byte>>> CORPUS{
+            {"Login", ToBytes(WormsPacket::freeze(PacketCode::Login,
+                                                  {.value1 = 0, .value4 = 0, .name = "Player",
+                                                   .info = SessionInfo(Nation::UnitedKingdom, SessionType::User)}))},
+            {"ListRooms", ToBytes(WormsPacket::freeze(PacketCode::ListRooms, {.value4 = 0}))},
+            {"ListUsers", ToBytes(WormsPacket::freeze(PacketCode::ListUsers, {.value2 = 0x1001, .value4 = 0}))},
+            {"ListGames", ToBytes(WormsPacket::freeze(PacketCode::ListGames, {.value2 = 0x1001, .value4 = 0}))},
+            {"CreateRoom", ToBytes(WormsPacket::freeze(PacketCode::CreateRoom,
+                                                       {.value1 = 0, .value4 = 0, .name = "Ninja Rope Races",
+                                                        .data = "pw",
+                                                        .info = SessionInfo(Nation::UnitedKingdom, SessionType::Room)}))},
+            {"Join", ToBytes(WormsPacket::freeze(PacketCode::Join, {.value2 = 0x1001, .value10 = 0x1002}))},
+            {"Leave", ToBytes(WormsPacket::freeze(PacketCode::Leave, {.value2 = 0x1001, .value10 = 0x1002}))},
+            {"ChatRoom", ToBytes(WormsPacket::freeze(PacketCode::ChatRoom,
+                                                     {.value0 = 0x1002, .value3 = 0x1001,
+                                                      .data = std::string(ASCII_TEXT)}))},
+            {"CreateGame", ToBytes(WormsPacket::freeze(PacketCode::CreateGame,
+                                                       {.value1 = 0, .value2 = 0x1001, .value4 = 0x800,
+                                                        .name = "Player", .data = "192.168.1.20",
+                                                        .info = SessionInfo(Nation::UnitedKingdom, SessionType::Game)}))},
+            {"ConnectGame", ToBytes(WormsPacket::freeze(PacketCode::ConnectGame, {.value0 = 0x1003}))},
+        };
+        return CORPUS;
+    }
+
+    // The corpus back to back, as a busy client's stream looks to the server.
+    const std::vector<net::byte>& ClientStream()
+    {
+        static const std::vector<net::byte> STREAM = []
+        {
+            std::vector<net::byte> stream;
+            for (const auto& bytes : ClientCorpus() | std::views::values)
+            {
+                stream.insert(stream.end(), bytes.begin(), bytes.end());
+            }
+            return stream;
+        }();
+        return STREAM;
+    }
+
+    void BM_ReadFrom(benchmark::State& state)
+    {
+        const auto& [name, bytes] = ClientCorpus()[static_cast<size_t>(state.range(0))];
+        state.SetLabel(name);
+        for (auto _ : state)
+        {
+            auto reader = net::packet_reader(std::span<const net::byte>(bytes));
+            auto result = WormsPacket::readFrom(reader);
+            benchmark::DoNotOptimize(result);
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes.size()));
+    }
+    BENCHMARK(BM_ReadFrom)->DenseRange(0, 9);
+
+    // Every shape the handlers freeze, from replies to the broadcasts that fan out to a room.
+    void BM_Freeze(benchmark::State& state)
+    {
+        static const std::vector<std::pair<const char*, std::pair<PacketCode, PacketFields>>> SHAPES{
+            {"Reply", {PacketCode::JoinReply, {.error = 0}}},
+            {"LoginReply", {PacketCode::LoginReply, {.value1 = 0x1002, .error = 0}}},
+            {"Leave", {PacketCode::Leave, {.value2 = 0x1001, .value10 = 0x1002}}},
+            {"Close", {PacketCode::Close, {.value10 = 0x1001}}},
+            {"DisconnectUser", {PacketCode::DisconnectUser, {.value10 = 0x1002}}},
+            {"Login", {PacketCode::Login, {.value1 = 0x1002, .value4 = 0, .name = "Player",
+                                           .info = SessionInfo(Nation::UnitedKingdom, SessionType::User)}}},
+            {"ListItemUser", {PacketCode::ListItem, {.value1 = 0x1002, .name = "Player", .data = "",
+                                                     .info = SessionInfo(Nation::UnitedKingdom, SessionType::User)}}},
+            {"ListItemGame", {PacketCode::ListItem, {.value1 = 0x1003, .name = "Player", .data = "192.168.1.20",
+                                                     .info = SessionInfo(Nation::UnitedKingdom, SessionType::Game)}}},
+            {"CreateRoom", {PacketCode::CreateRoom, {.value1 = 0x1001, .value4 = 0, .name = "Ninja Rope Races",
+                                                     .data = "", .info = SessionInfo(Nation::UnitedKingdom, SessionType::Room)}}},
+            {"CreateGame", {PacketCode::CreateGame, {.value1 = 0x1003, .value2 = 0x1001, .value4 = 0x800,
+                                                     .name = "Player", .data = "192.168.1.20",
+                                                     .info = SessionInfo(Nation::UnitedKingdom, SessionType::Game)}}},
+            {"ConnectGameReply", {PacketCode::ConnectGameReply, {.data = "192.168.1.20", .error = 0}}},
+            {"ChatRoomAscii", {PacketCode::ChatRoom, {.value0 = 0x1002, .value3 = 0x1001,
+                                                      .data = std::string(ASCII_TEXT)}}},
+            {"ChatRoomCyrillic", {PacketCode::ChatRoom, {.value0 = 0x1002, .value3 = 0x1001,
+                                                         .data = std::string(CYRILLIC_TEXT)}}},
+        };
+
+        const auto& [name, shape] = SHAPES[static_cast<size_t>(state.range(0))];
+        state.SetLabel(name);
+        for (auto _ : state)
+        {
+            auto packet = WormsPacket::freeze(shape.first, shape.second);
+            benchmark::DoNotOptimize(packet);
+        }
+    }
+    BENCHMARK(BM_Freeze)->DenseRange(0, 12);
+
+    std::vector<net::byte> SessionInfoBytes()
+    {
+        std::vector<net::byte> bytes(50);
+        PacketWriter writer(bytes);
+        SessionInfo(Nation::UnitedKingdom, SessionType::User).writeTo(writer);
+        return bytes;
+    }
+
+    void BM_SessionInfoReadFrom(benchmark::State& state)
+    {
+        const auto bytes = SessionInfoBytes();
+        for (auto _ : state)
+        {
+            auto reader = net::packet_reader(std::span<const net::byte>(bytes));
+            auto result = SessionInfo::readFrom(reader);
+            benchmark::DoNotOptimize(result);
+        }
+    }
+    BENCHMARK(BM_SessionInfoReadFrom);
+
+    void BM_SessionInfoWriteTo(benchmark::State& state)
+    {
+        const SessionInfo info(Nation::UnitedKingdom, SessionType::User);
+        std::vector<net::byte> bytes(50);
+        for (auto _ : state)
+        {
+            PacketWriter writer(bytes);
+            info.writeTo(writer);
+            benchmark::DoNotOptimize(bytes.data());
+            benchmark::ClobberMemory();
+        }
+    }
+    BENCHMARK(BM_SessionInfoWriteTo);
+
+    void BM_VerifySessionInfo(benchmark::State& state)
+    {
+        const SessionInfo info(Nation::UnitedKingdom, SessionType::User);
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(SessionInfo::verifySessionInfo(info));
+        }
+    }
+    BENCHMARK(BM_VerifySessionInfo);
+
+    constexpr std::array TEXTS{ASCII_TEXT, CYRILLIC_TEXT, MIXED_TEXT};
+    constexpr std::array TEXT_NAMES{"ascii", "cyrillic", "mixed"};
+
+    template <typename CodePage>
+    void BM_Encode(benchmark::State& state)
+    {
+        const std::string_view text = TEXTS[static_cast<size_t>(state.range(0))];
+        state.SetLabel(TEXT_NAMES[static_cast<size_t>(state.range(0))]);
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(CodePage::encode(text));
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+    }
+    BENCHMARK(BM_Encode<Windows1251>)->DenseRange(0, 2);
+    BENCHMARK(BM_Encode<Windows1252>)->DenseRange(0, 2);
+
+    template <typename CodePage>
+    void BM_Decode(benchmark::State& state)
+    {
+        const std::string encoded = CodePage::encode(TEXTS[static_cast<size_t>(state.range(0))]);
+        state.SetLabel(TEXT_NAMES[static_cast<size_t>(state.range(0))]);
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(CodePage::decode(encoded));
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * encoded.size()));
+    }
+    BENCHMARK(BM_Decode<Windows1251>)->DenseRange(0, 2);
+    BENCHMARK(BM_Decode<Windows1252>)->DenseRange(0, 2);
+
+    // The client stream fed in chunks of range(0) bytes through the original framed_packet_reader.
+    void BM_FramedPacketReader(benchmark::State& state)
+    {
+        const auto& stream = ClientStream();
+        const auto chunk = static_cast<size_t>(state.range(0));
+        for (auto _ : state)
+        {
+            net::framed_packet_reader<WormsPacketPtr, std::string> reader(
+                +[](net::packet_reader& packetReader) { return WormsPacket::readFrom(packetReader); });
+            for (size_t offset = 0; offset < stream.size(); offset += chunk)
+            {
+                reader.append(stream.data() + offset, std::min(chunk, stream.size() - offset));
+                while (true)
+                {
+                    auto result = reader.try_read_packet();
+                    if (result.status != net::packet_parse_status::complete)
+                    {
+                        break;
+                    }
+                    benchmark::DoNotOptimize(result);
+                }
+            }
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * stream.size()));
+    }
+    BENCHMARK(BM_FramedPacketReader)->Arg(1)->Arg(7)->Arg(64)->Arg(4096);
+
+    // Same input through the PacketStream sessions receive into.
+    void BM_PacketStream(benchmark::State& state)
+    {
+        const auto& stream = ClientStream();
+        const auto chunk = static_cast<size_t>(state.range(0));
+        for (auto _ : state)
+        {
+            PacketStream packets;
+            for (size_t offset = 0; offset < stream.size();)
+            {
+                const auto space = packets.prepare();
+                const size_t length = std::min({chunk, stream.size() - offset, space.size()});
+                std::memcpy(space.data(), stream.data() + offset, length);
+                packets.commit(length);
+                offset += length;
+                while (true)
+                {
+                    auto result = packets.tryReadPacket();
+                    if (result.status != net::packet_parse_status::complete)
+                    {
+                        break;
+                    }
+                    benchmark::DoNotOptimize(result);
+                }
+            }
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * stream.size()));
+    }
+    BENCHMARK(BM_PacketStream)->Arg(1)->Arg(7)->Arg(64)->Arg(4096);
+
+    // Name lookups compare against every taken name; most differ in length or early on.
+    void BM_EqualsCaseInsensitive(benchmark::State& state)
+    {
+        static constexpr std::array<std::pair<std::string_view, std::string_view>, 3> PAIRS{{
+            {"NinjaRopeMaster", "ninjaropemaster"},
+            {"NinjaRopeMaster", "NinjaRopeMastex"},
+            {"NinjaRopeMaster", "Player"},
+        }};
+        static constexpr std::array NAMES{"equal", "last-differs", "length-differs"};
+
+        const auto& [a, b] = PAIRS[static_cast<size_t>(state.range(0))];
+        state.SetLabel(NAMES[static_cast<size_t>(state.range(0))]);
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(EqualsCaseInsensitive(a, b));
+        }
+    }
+    BENCHMARK(BM_EqualsCaseInsensitive)->DenseRange(0, 2);
+}
+
+BENCHMARK_MAIN();
@@ -0,0 +1,381 @@
+// Drives Database directly from several threads with a weighted mix of the calls sessions make, at lobby
+// sizes from a thousand to tens of thousands of users. Reports throughput and p50/p99/p99.9 per operation
+// for every user count and thread count, then checks the tables still agree with what was put in.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <latch>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "database.hpp"
+#include "game.hpp"
+#include "room.hpp"
+#include "user.hpp"
+
+using namespace std::string_view_literals;
+
+namespace
+{
+    using namespace worms_server;
+    using Clock = std::chrono::steady_clock;
+
+    enum class Operation : uint8_t { Snapshot, Lookup, Churn, Room, GameByName };
+
+    constexpr std::array OPERATION_NAMES{"snapshot"sv, "lookup"sv, "churn"sv, "room"sv, "game"sv};
+    constexpr std::array OPERATION_LABELS{"getUsers"sv, "getUser"sv, "addUser+removeUser"sv,
+                                          "addRoom+removeRoom"sv, "getGameByName"sv};
+    constexpr size_t OPERATION_COUNT = OPERATION_NAMES.size();
+
+    constexpr uint32_t FIRST_ID = 0x1000U;
+
+    // Ids the threads add and remove again; far above anything the population uses.
+    constexpr uint32_t CHURN_ID_BASE = 0x1000'0000U;
+    constexpr uint32_t CHURN_IDS_PER_THREAD = 0x0100'0000U;
+
+    // Every thread's churn ids have to fit above CHURN_ID_BASE.
+    constexpr uint32_t MAX_THREADS = (UINT32_MAX - CHURN_ID_BASE) / CHURN_IDS_PER_THREAD + 1;
+
+    struct Options
+    {
+        std::vector<uint32_t> users{1'000, 10'000, 50'000};
+        std::vector<uint32_t> threads{1, 2, 4, 8};
+        std::chrono::milliseconds duration{2'000};
+        std::array<uint32_t, OPERATION_COUNT> mix{5, 60, 10, 5, 20};
+    };
+
+    struct Population
+    {
+        uint32_t users;
+        uint32_t rooms;
+        uint32_t games;
+        uint32_t roomBase;
+        uint32_t gameBase;
+    };
+
+    // Nanoseconds per call, kept per thread and merged after the run.
+    using Samples = std::array<std::vector<uint32_t>, OPERATION_COUNT>;
+
+    Population Populate(const uint32_t userCount)
+    {
+        const Population population{.users = userCount,
+                                    .rooms = std::max(8U, userCount / 100),
+                                    .games = userCount / 10,
+                                    .roomBase = FIRST_ID + userCount,
+                                    .gameBase = FIRST_ID + userCount + std::max(8U, userCount / 100)};
+        const auto database = Database::getInstance();
+
+        for (uint32_t i = 0; i < population.rooms; ++i)
+        {
+            database->addRoom(std::make_shared<Room>(population.roomBase + i, std::format("Room{}", i), Nation::None,
+                                                     asio::ip::address_v4()));
+        }
+
+        for (uint32_t i = 0; i < userCount; ++i)
+        {
+            const auto name = std::format("Player{}", i);
+            const uint32_t roomId = population.roomBase + i % population.rooms;
+            database->addUser(std::make_shared<User>(nullptr, FIRST_ID + i, name, Nation::None));
+            database->setUserRoomId(FIRST_ID + i, roomId);
+
+            if (i < population.games)
+            {
+                database->addGame(std::make_shared<Game>(population.gameBase + i, name, Nation::None, roomId,
+                                                         asio::ip::address_v4(), SessionAccess::PublicAccess));
+            }
+        }
+
+        return population;
+    }
+
+    void Clear()
+    {
+        const auto database = Database::getInstance();
+        for (const auto& user : database->getUsers())
+        {
+            database->removeUser(user->getId());
+        }
+        for (const auto& room : database->getRooms())
+        {
+            database->removeRoom(room->getId());
+        }
+        for (const auto& game : database->getGames())
+        {
+            database->removeGame(game->getId());
+        }
+    }
+
+    void Work(const Population& population, const Options& options, const uint32_t thread, std::latch& start,
+              const Clock::time_point& end, Samples& samples)
+    {
+        const auto database = Database::getInstance();
+        std::mt19937 random(thread * 7919 + population.users);
+        std::discrete_distribution<size_t> pick(options.mix.begin(), options.mix.end());
+        std::uniform_int_distribution<uint32_t> user(0, population.users - 1);
+        std::uniform_int_distribution<uint32_t> game(0, std::max(population.games, 1U) - 1);
+
+        const uint32_t churnBase = CHURN_ID_BASE + thread * CHURN_IDS_PER_THREAD;
+        uint32_t churned = 0;
+        size_t sink = 0;
+
+        start.arrive_and_wait();
+        while (Clock::now() < end)
+        {
+            const auto operation = static_cast<Operation>(pick(random));
+            const auto before = Clock::now();
+            switch (operation)
+            {
+            case Operation::Snapshot:
+                sink += database->getUsers().size();
+                break;
+
+            case Operation::Lookup:
+                sink += database->getUser(FIRST_ID + user(random)) != nullptr;
+                break;
+
+            case Operation::Churn:
+            {
+                const uint32_t id = churnBase + churned++ % CHURN_IDS_PER_THREAD;
+                database->addUser(std::make_shared<User>(nullptr, id, std::format("Churn{:x}", id), Nation::None));
+                database->removeUser(id);
+                break;
+            }
+
+            case Operation::Room:
+            {
+                const uint32_t id = churnBase + churned++ % CHURN_IDS_PER_THREAD;
+                database->addRoom(std::make_shared<Room>(id, std::format("Churn{:x}", id), Nation::None,
+                                                         asio::ip::address_v4()));
+                database->removeRoom(id);
+                break;
+            }
+
+            case Operation::GameByName:
+                sink += database->getGameByName(std::format("Player{}", game(random))) != nullptr;
+                break;
+            }
+
+            const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - before);
+            samples[static_cast<size_t>(operation)].push_back(
+                static_cast<uint32_t>(std::min<int64_t>(elapsed.count(), UINT32_MAX)));
+        }
+
+        volatile size_t keep = sink;
+        (void)keep;
+    }
+
+    void Run(const Population& population, const Options& options, const uint32_t threadCount)
+    {
+        std::vector<Samples> samples(threadCount);
+        std::latch start(threadCount + 1);
+        Clock::time_point end = Clock::time_point::max();
+
+        std::vector<std::thread> threads;
+        for (uint32_t i = 0; i < threadCount; ++i)
+        {
+            threads.emplace_back(Work, std::cref(population), std::cref(options), i, std::ref(start), std::cref(end),
+                                 std::ref(samples[i]));
+        }
+
+        end = Clock::now() + options.duration;
+        start.arrive_and_wait();
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        const double seconds = std::chrono::duration<double>(options.duration).count();
+        std::cout << std::format("\n{} users, {} rooms, {} games, {} threads\n", population.users, population.rooms,
+                                 population.games, threadCount);
+        std::cout << std::format("{:<20} {:>10} {:>11} {:>9} {:>9} {:>9} {:>9}\n", "operation", "count", "per sec",
+                                 "p50 ns", "p99 ns", "p99.9 ns", "max ns");
+
+        for (size_t op = 0; op < OPERATION_COUNT; ++op)
+        {
+            std::vector<uint32_t> merged;
+            for (auto& thread : samples)
+            {
+                merged.insert(merged.end(), thread[op].begin(), thread[op].end());
+                thread[op] = {};
+            }
+
+            if (merged.empty())
+            {
+                continue;
+            }
+
+            std::ranges::sort(merged);
+            std::cout << std::format("{:<20} {:>10} {:>11.0f} {:>9} {:>9} {:>9} {:>9}\n", OPERATION_LABELS[op],
+                                     merged.size(), static_cast<double>(merged.size()) / seconds,
+                                     Percentile(merged, 0.5), Percentile(merged, 0.99), Percentile(merged, 0.999),
+                                     merged.back());
+        }
+    }
+
+    // After a run only the population should be left, every entry reachable by id and name.
+    bool Verify(const Population& population)
+    {
+        const auto database = Database::getInstance();
+        const auto users = database->getUsers();
+        if (users.size() != population.users || database->getRooms().size() != population.rooms
+            || database->getGames().size() != population.games)
+        {
+            std::cerr << std::format("Table sizes drifted: {} users, {} rooms, {} games\n", users.size(),
+                                     database->getRooms().size(), database->getGames().size());
+            return false;
+        }
+
+        for (const auto& user : users)
+        {
+            if (database->getUser(user->getId()) != user || !database->isUserNameTaken(user->getName()))
+            {
+                std::cerr << std::format("User {} is no longer indexed\n", user->getId());
+                return false;
+            }
+        }
+
+        for (uint32_t i = 0; i < population.games; ++i)
+        {
+            const auto game = database->getGameByName(std::format("Player{}", i));
+            if (game == nullptr || game->getId() != population.gameBase + i)
+            {
+                std::cerr << std::format("Game of Player{} is no longer indexed\n", i);
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool ParseList(const std::string_view spec, std::vector<uint32_t>& values)
+    {
+        std::vector<uint32_t> parsed;
+        for (size_t begin = 0; begin <= spec.size();)
+        {
+            const size_t comma = std::min(spec.find(',', begin), spec.size());
+            const std::string_view entry = spec.substr(begin, comma - begin);
+            begin = comma + 1;
+
+            uint32_t value = 0;
+            if (const auto [end, ec] = std::from_chars(entry.data(), entry.data() + entry.size(), value);
+                ec != std::errc() || end != entry.data() + entry.size() || value == 0)
+            {
+                return false;
+            }
+            parsed.push_back(value);
+        }
+
+        values = std::move(parsed);
+        return true;
+    }
+
+    // Returns false if the program should exit, after printing the usage or an error.
+    bool ParseArguments(const int argc, char** argv, Options& options)
+    {
+        const std::vector<std::string> args(argv + 1, argv + argc);
+        for (size_t i = 0; i < args.size(); ++i)
+        {
+            const std::string& arg = args[i];
+            if (arg == "-h" || arg == "--help")
+            {
+                std::cout << "Usage: worms_database_bench [options]\n"
+                    << "  -u, --users <count>,...	User counts to run at (default: 1000,10000,50000)\n"
+                    << "  -t, --threads <count>,...	Thread counts to run with, up to " << MAX_THREADS
+                    << " (default: 1,2,4,8)\n"
+                    << "  -d, --duration <ms>		Length of each run (default: 2000)\n"
+                    << "  --mix <operation>=<weight>,...	Weights over snapshot, lookup, churn, room and game\n"
+                    << "				(default: snapshot=5,lookup=60,churn=10,room=5,game=20)\n";
+                return false;
+            }
+
+            if (i + 1 == args.size())
+            {
+                std::cerr << "Missing value for " << arg << '\n';
+                return false;
+            }
+
+            const std::string& value = args[++i];
+            bool valid = true;
+            if (arg == "-u" || arg == "--users")
+            {
+                valid = ParseList(value, options.users);
+            }
+            else if (arg == "-t" || arg == "--threads")
+            {
+                valid = ParseList(value, options.threads)
+                    && std::ranges::all_of(options.threads, [](const uint32_t count) { return count <= MAX_THREADS; });
+            }
+            else if (arg == "-d" || arg == "--duration")
+            {
+                options.duration = std::chrono::milliseconds(std::stoi(value));
+            }
+            else if (arg == "--mix")
+            {
+                valid = ParseMix(value, OPERATION_NAMES, options.mix);
+            }
+            else
+            {
+                std::cerr << "Unknown option " << arg << '\n';
+                return false;
+            }
+
+            if (!valid)
+            {
+                std::cerr << "Invalid value '" << value << "' for " << arg << '\n';
+                return false;
+            }
+        }
+
+        if (options.duration.count() <= 0)
+        {
+            std::cerr << "Duration must be positive\n";
+            return false;
+        }
+
+        return true;
+    }
+}
+
+int main(const int argc, char** argv)
+{
+    Options options;
+    try
+    {
+        if (!ParseArguments(argc, argv, options))
+        {
+            return 0;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Invalid argument: " << e.what() << '\n';
+        return 1;
+    }
+
+    for (const uint32_t users : options.users)
+    {
+        const auto population = Populate(users);
+        for (const uint32_t threads : options.threads)
+        {
+            Run(population, options, threads);
+            if (!Verify(population))
+            {
+                return 1;
+            }
+        }
+        Clear();
+    }
+
+    return 0;
+}
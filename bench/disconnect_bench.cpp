@@ -0,0 +1,205 @@
+// Drops 1,000 of 5,000 simulated clients at once and compares the one-by-one DisconnectUser teardown
+// with DisconnectBatcher::teardown: wall time and the number of buffers handed to survivors.
+
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "database.hpp"
+#include "disconnect_batcher.hpp"
+#include "game.hpp"
+#include "metrics.hpp"
+#include "packet_code.hpp"
+#include "room.hpp"
+#include "user.hpp"
+#include "worms_packet.hpp"
+
+namespace
+{
+    using namespace worms_server;
+    using Clock = std::chrono::steady_clock;
+
+    constexpr uint32_t USER_COUNT = 5'000;
+    constexpr uint32_t DROP_EVERY = 5;
+    constexpr uint32_t ROOM_COUNT = 64;
+    constexpr uint32_t OPEN_ROOMS = 56;
+    constexpr uint32_t GAME_COUNT = 500;
+    constexpr uint32_t FIRST_ID = 0x1000U;
+
+    // Every fifth user drops, including a fifth of the game hosts.
+    std::vector<std::shared_ptr<User>> Populate()
+    {
+        const auto database = Database::getInstance();
+        const uint32_t roomBase = FIRST_ID + USER_COUNT;
+        const uint32_t gameBase = roomBase + ROOM_COUNT;
+
+        for (uint32_t i = 0; i < ROOM_COUNT; ++i)
+        {
+            database->addRoom(std::make_shared<Room>(roomBase + i, std::format("Room{}", i), Nation::None,
+                                                     asio::ip::address_v4()));
+        }
+
+        std::vector<std::shared_ptr<User>> dropped;
+        for (uint32_t i = 0; i < USER_COUNT; ++i)
+        {
+            const auto name = std::format("Player{}", i);
+            auto user = std::make_shared<User>(nullptr, FIRST_ID + i, name, Nation::None);
+            database->addUser(user);
+
+            // The last few rooms only hold dropped users without a game, so they close during the storm.
+            const bool inClosingRoom = i % DROP_EVERY == 0 && i >= GAME_COUNT;
+            const uint32_t roomId = inClosingRoom ? roomBase + OPEN_ROOMS + i / DROP_EVERY % (ROOM_COUNT - OPEN_ROOMS)
+                                                  : roomBase + i % OPEN_ROOMS;
+            database->setUserRoomId(user->getId(), roomId);
+
+            if (i < GAME_COUNT)
+            {
+                database->addGame(std::make_shared<Game>(gameBase + i, name, Nation::None, roomId,
+                                                         asio::ip::address_v4(), SessionAccess::PublicAccess));
+            }
+
+            if (i % DROP_EVERY == 0)
+            {
+                dropped.push_back(std::move(user));
+            }
+        }
+
+        return dropped;
+    }
+
+    void Clear()
+    {
+        const auto database = Database::getInstance();
+        for (const auto& user : database->getUsers())
+        {
+            database->removeUser(user->getId());
+        }
+        for (const auto& room : database->getRooms())
+        {
+            database->removeRoom(room->getId());
+        }
+        for (const auto& game : database->getGames())
+        {
+            database->removeGame(game->getId());
+        }
+    }
+
+    // The previous DisconnectUser and LeaveRoom, run once per dropped user.
+    size_t LegacyTeardown(const std::vector<std::shared_ptr<User>>& dropped)
+    {
+        const auto database = Database::getInstance();
+        size_t sends = 0;
+
+        for (const auto& client : dropped)
+        {
+            uint32_t leftId = client->getId();
+            uint32_t roomId = client->getRoomId();
+            database->removeUser(leftId);
+
+            if (const auto game = database->getGameByName(client->getName()))
+            {
+                roomId = game->getRoomId();
+                leftId = game->getId();
+                database->removeGame(leftId);
+
+                const auto leave =
+                    WormsPacket::freeze(PacketCode::Leave, {.value2 = game->getId(), .value10 = client->getId()});
+                const auto close = WormsPacket::freeze(PacketCode::Close, {.value10 = game->getId()});
+                for (const auto& user : database->getUsers())
+                {
+                    user->sendPacket(leave);
+                    user->sendPacket(close);
+                    sends += 2;
+                }
+            }
+
+            const auto room = database->getRoom(roomId);
+            const auto users = database->getUsers();
+            const auto games = database->getGames();
+            const bool roomClosed = room && std::ranges::none_of(users, [&](const auto& user)
+            {
+                return user->getRoomId() == roomId;
+            }) && std::ranges::none_of(games, [&](const auto& game) { return game->getRoomId() == roomId; });
+
+            if (roomClosed)
+            {
+                database->removeRoom(roomId);
+            }
+
+            const auto leave = WormsPacket::freeze(PacketCode::Leave, {.value2 = roomId, .value10 = leftId});
+            const auto close = WormsPacket::freeze(PacketCode::Close, {.value10 = roomId});
+            for (const auto& user : users)
+            {
+                if (room != nullptr)
+                {
+                    user->sendPacket(leave);
+                    ++sends;
+                }
+                if (roomClosed)
+                {
+                    user->sendPacket(close);
+                    ++sends;
+                }
+            }
+
+            const auto disconnect = WormsPacket::freeze(PacketCode::DisconnectUser, {.value10 = client->getId()});
+            for (const auto& user : database->getUsers())
+            {
+                user->sendPacket(disconnect);
+                ++sends;
+            }
+        }
+
+        return sends;
+    }
+
+    // Every buffer the presence broadcaster handed to a user so far; the bench records on one thread, so one
+    // shard holds them all.
+    uint64_t BroadcastSends()
+    {
+        return LocalMetricShard().histograms[static_cast<size_t>(MetricHistogram::BroadcastFanout)].sum.load();
+    }
+
+    template <typename Fn>
+    double Milliseconds(Fn&& fn)
+    {
+        const auto start = Clock::now();
+        fn();
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    void Report(const std::string_view label, const double milliseconds, const size_t sends)
+    {
+        const auto database = Database::getInstance();
+        const size_t survivors = database->getUsers().size();
+        std::cout << std::format("{:<10} {:>8.2f} ms | {:>9} buffers sent ({:.1f} per survivor) | {} rooms, {} games left\n",
+                                 label, milliseconds, sends, static_cast<double>(sends) / static_cast<double>(survivors),
+                                 database->getRooms().size(), database->getGames().size());
+    }
+}
+
+int main()
+{
+    std::cout << std::format("Dropping {} of {} users ({} rooms, {} games)\n", USER_COUNT / DROP_EVERY, USER_COUNT,
+                             ROOM_COUNT, GAME_COUNT);
+
+    auto dropped = Populate();
+    size_t legacySends = 0;
+    const double legacy = Milliseconds([&] { legacySends = LegacyTeardown(dropped); });
+    Report("one-by-one", legacy, legacySends);
+    dropped.clear();
+    Clear();
+
+    dropped = Populate();
+    const uint64_t sendsBefore = BroadcastSends();
+    const double batched = Milliseconds([&] { DisconnectBatcher::teardown(dropped); });
+    Report("batched", batched, BroadcastSends() - sendsBefore);
+    dropped.clear();
+    Clear();
+
+    return 0;
+}
@@ -0,0 +1,225 @@
+// Compares the lobby table layout against the pre-columnar one: measured heap bytes per user, and the
+// cost of the room scans LeaveRoom, OnListUsers and OnChatRoom run on every call.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <ranges>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "database.hpp"
+#include "session_info.hpp"
+#include "user.hpp"
+
+namespace
+{
+    using namespace worms_server;
+
+    // Bytes requested from the global heap and not yet freed, kept by the operator new below.
+    std::atomic<int64_t> liveBytes{0};
+    using Clock = std::chrono::steady_clock;
+
+    // Field-for-field copy of the old User, stored the old way: shared_ptr values in an unordered_map.
+    struct LegacyUser
+    {
+        uint32_t id;
+        std::string name;
+        SessionInfo sessionInfo;
+        std::atomic<uint32_t> roomId;
+        std::weak_ptr<void> session;
+    };
+
+    constexpr size_t MEASURED_USERS = 10'000;
+
+    std::string NameOfLength(const size_t index, const size_t length)
+    {
+        auto name = std::format("Player{}", index);
+        name.resize(length, 'x');
+        return name;
+    }
+
+    // Heap bytes allocated per user while the old layout holds MEASURED_USERS of them.
+    int64_t LegacyBytesPerUser(const size_t nameLength)
+    {
+        std::unordered_map<uint32_t, std::shared_ptr<LegacyUser>> legacy;
+        const int64_t before = liveBytes.load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < MEASURED_USERS; ++i)
+        {
+            auto old = std::make_shared<LegacyUser>();
+            old->id = 0x1000U + i;
+            old->name = NameOfLength(i, nameLength);
+            old->sessionInfo = SessionInfo(Nation::None, SessionType::User);
+            legacy.emplace(old->id, std::move(old));
+        }
+        return (liveBytes.load(std::memory_order_relaxed) - before) / static_cast<int64_t>(MEASURED_USERS);
+    }
+
+    // The same for the columnar tables, including the slack their vectors grew with.
+    int64_t ColumnarBytesPerUser(const size_t nameLength)
+    {
+        const auto database = Database::getInstance();
+        const int64_t before = liveBytes.load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < MEASURED_USERS; ++i)
+        {
+            database->addUser(std::make_shared<User>(nullptr, 0x1000U + i, NameOfLength(i, nameLength), Nation::None));
+        }
+        const int64_t used = liveBytes.load(std::memory_order_relaxed) - before;
+
+        for (uint32_t i = 0; i < MEASURED_USERS; ++i)
+        {
+            database->removeUser(0x1000U + i);
+        }
+        return used / static_cast<int64_t>(MEASURED_USERS);
+    }
+
+    template <typename Fn>
+    double NanosPerCall(const size_t iterations, Fn&& fn)
+    {
+        const auto start = Clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            fn(i);
+        }
+        const auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start);
+        return elapsed.count() / static_cast<double>(iterations);
+    }
+
+    void RunScan(const size_t userCount, const uint32_t roomCount)
+    {
+        std::mt19937 random(userCount);
+        std::uniform_int_distribution<uint32_t> roomOf(1, roomCount);
+
+        std::unordered_map<uint32_t, std::shared_ptr<LegacyUser>> legacy;
+        const auto database = Database::getInstance();
+
+        for (uint32_t i = 0; i < userCount; ++i)
+        {
+            const uint32_t id = 0x1000U + i;
+            const uint32_t roomId = roomOf(random);
+            const auto name = std::format("Player{}", i);
+
+            auto old = std::make_shared<LegacyUser>();
+            old->id = id;
+            old->name = name;
+            old->sessionInfo = SessionInfo(Nation::None, SessionType::User);
+            old->roomId = roomId;
+            legacy.emplace(id, std::move(old));
+
+            database->addUser(std::make_shared<User>(nullptr, id, name, Nation::None));
+            database->setUserRoomId(id, roomId);
+        }
+
+        const size_t iterations = std::max<size_t>(10, 2'000'000 / userCount);
+        volatile size_t sink = 0;
+
+        // Old LeaveRoom: snapshot every user, then test each one through its pointer.
+        const double legacyAny = NanosPerCall(iterations, [&](const size_t i)
+        {
+            std::vector<std::shared_ptr<LegacyUser>> users;
+            users.reserve(legacy.size());
+            for (const auto& user : legacy | std::views::values)
+            {
+                users.push_back(user);
+            }
+            const uint32_t roomId = static_cast<uint32_t>(i % roomCount) + 1;
+            sink = sink + std::ranges::any_of(users, [roomId](const auto& user) { return user->roomId == roomId; });
+        });
+
+        const double columnarAny = NanosPerCall(iterations, [&](const size_t i)
+        {
+            const uint32_t roomId = static_cast<uint32_t>(i % roomCount) + 1;
+            sink = sink + database->hasUsersInRoom(roomId, 0);
+        });
+
+        // A room nobody is in forces a full pass over the room id column.
+        const double columnarMiss = NanosPerCall(iterations, [&](const size_t)
+        {
+            sink = sink + database->hasUsersInRoom(roomCount + 1, 0);
+        });
+
+        const double columnarList = NanosPerCall(iterations, [&](const size_t i)
+        {
+            const uint32_t roomId = static_cast<uint32_t>(i % roomCount) + 1;
+            sink = sink + database->getUsersInRoom(roomId).size();
+        });
+
+        std::cout << std::format("{:>6} users {:>3} rooms | old snapshot+any_of {:>9.0f} ns | hasUsersInRoom {:>6.0f} ns"
+                                 " (full pass {:>6.0f} ns) | getUsersInRoom {:>8.0f} ns\n",
+                                 userCount, roomCount, legacyAny, columnarAny, columnarMiss, columnarList);
+
+        for (uint32_t i = 0; i < userCount; ++i)
+        {
+            database->removeUser(0x1000U + i);
+        }
+    }
+}
+
+// Every allocation carries its size in a header, so frees are counted exactly whichever delete runs.
+void* operator new(const std::size_t size)
+{
+    auto* block = static_cast<std::max_align_t*>(std::malloc(size + sizeof(std::max_align_t)));
+    if (block == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+
+    *reinterpret_cast<std::size_t*>(block) = size;
+    liveBytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+    return block + 1;
+}
+
+void operator delete(void* pointer) noexcept
+{
+    if (pointer == nullptr)
+    {
+        return;
+    }
+
+    auto* block = static_cast<std::max_align_t*>(pointer) - 1;
+    liveBytes.fetch_sub(static_cast<int64_t>(*reinterpret_cast<std::size_t*>(block)), std::memory_order_relaxed);
+    std::free(block);
+}
+
+void* operator new[](const std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+int main()
+{
+    // Measured before the scans, which leave the tables' vectors grown.
+    std::cout << std::format("Heap bytes per user over {} users (8-character name / 18-character name), "
+                             "excluding allocator headers:\n", MEASURED_USERS)
+              << std::format("  before: {} / {} bytes\n", LegacyBytesPerUser(8), LegacyBytesPerUser(18))
+              << std::format("  after:  {} / {} bytes\n\n", ColumnarBytesPerUser(8), ColumnarBytesPerUser(18));
+
+    for (const size_t users : {1'000UZ, 10'000UZ, 50'000UZ})
+    {
+        RunScan(users, 32);
+    }
+
+    return 0;
+}
@@ -0,0 +1,740 @@
+// Headless swarm of Worms2 clients for putting load on a running server. Clients arrive at a fixed rate, log
+// in, and run a weighted mix of lobby actions with think time in between until their session ends. Every
+// request is timed from send to its reply; the report lists throughput and p50/p99/p99.9 per operation.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <asio.hpp>
+
+#include "bench_util.hpp"
+#include "packet_code.hpp"
+#include "packet_stream.hpp"
+#include "session_info.hpp"
+#include "worms_packet.hpp"
+
+using namespace std::string_view_literals;
+
+namespace
+{
+    using namespace worms_server;
+    using asio::awaitable;
+    using asio::use_awaitable;
+    using asio::ip::tcp;
+    using Clock = std::chrono::steady_clock;
+
+    enum class Operation : uint8_t
+    {
+        Login, ListRooms, ListUsers, ListGames, CreateRoom, Join, Leave, Chat, HostGame, ConnectGame,
+    };
+
+    constexpr std::array OPERATION_NAMES{"login"sv, "list-rooms"sv, "list-users"sv, "list-games"sv,
+                                         "create-room"sv, "join"sv, "leave"sv, "chat"sv, "host-game"sv,
+                                         "connect-game"sv};
+    constexpr size_t OPERATION_COUNT = OPERATION_NAMES.size();
+
+    // What a client does between two think pauses; the weights come from --mix.
+    enum class Action : uint8_t { List, Chat, Create, Join, Leave, Host, Connect };
+
+    constexpr std::array ACTION_NAMES{"list"sv, "chat"sv, "create"sv, "join"sv, "leave"sv, "host"sv, "connect"sv};
+    constexpr size_t ACTION_COUNT = ACTION_NAMES.size();
+
+    constexpr auto REQUEST_TIMEOUT = std::chrono::seconds(10);
+
+    struct Options
+    {
+        std::string host = "127.0.0.1";
+        uint16_t port = 17000;
+        uint32_t clients = 1000;
+        double arrivalRate = 100.0;
+        std::chrono::seconds duration{30};
+        std::chrono::milliseconds think{500};
+        std::chrono::seconds sessionLength{60};
+        uint32_t sources = 1;
+        size_t threads = std::max(1U, std::thread::hardware_concurrency());
+        std::array<uint32_t, ACTION_COUNT> mix{20, 50, 5, 10, 5, 5, 5};
+    };
+
+    struct Stats
+    {
+        // Microseconds from sending a request to its reply.
+        std::array<std::vector<uint32_t>, OPERATION_COUNT> latencies;
+
+        // Replies carrying an error, e.g. a taken room name or a rate-limited request.
+        std::array<uint64_t, OPERATION_COUNT> failures{};
+
+        uint64_t timeouts = 0;
+        uint64_t connectFailures = 0;
+        uint64_t sessions = 0;
+        uint64_t packetsReceived = 0;
+    };
+
+    // Each client runs entirely on one worker's thread, so its stats need no synchronization.
+    struct Worker
+    {
+        Stats stats;
+        std::mt19937 random{std::random_device{}()};
+
+        // Last, so the coroutines it still holds are destroyed before the stats they point into.
+        asio::io_context context{1};
+    };
+
+    std::atomic<uint32_t> liveClients{0};
+    std::atomic<bool> stopping{false};
+
+    class Client : public std::enable_shared_from_this<Client>
+    {
+    public:
+        Client(Worker& worker, const Options& options, const uint32_t number, const uint16_t runTag) :
+            worker_(worker), options_(options), number_(number), name_(std::format("lg{:04x}-{}", runTag, number)),
+            socket_(worker.context), wake_(worker.context), thinkTimer_(worker.context),
+            stream_(PacketSource::Server)
+        {
+        }
+
+        awaitable<void> run()
+        {
+            if (co_await connect())
+            {
+                co_spawn(worker_.context, [self = shared_from_this()]() -> awaitable<void> // NOLINT(*-avoid-capturing-lambda-coroutines)
+                {
+                    co_await self->read();
+                }, asio::detached);
+
+                if (co_await login())
+                {
+                    std::exponential_distribution<double> length(
+                        1.0 / static_cast<double>(options_.sessionLength.count()));
+                    const auto endAt = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                           std::chrono::duration<double>(length(worker_.random)));
+
+                    while (!stopping && socket_.is_open() && Clock::now() < endAt)
+                    {
+                        if (!co_await perform(pickAction()) || !co_await think())
+                        {
+                            break;
+                        }
+                    }
+                    ++worker_.stats.sessions;
+                }
+            }
+
+            asio::error_code ec;
+            socket_.shutdown(tcp::socket::shutdown_both, ec);
+            socket_.close(ec);
+            wake_.cancel();
+            liveClients.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+    private:
+        awaitable<bool> connect()
+        {
+            asio::error_code ec;
+            const tcp::endpoint server(asio::ip::make_address(options_.host, ec), options_.port);
+
+            // Spreading clients over 127.0.0.x keeps them under the server's per-address login cap.
+            if (options_.sources > 1 && !ec)
+            {
+                const auto source = asio::ip::address_v4((127U << 24) + 1 + number_ % options_.sources);
+                socket_.open(tcp::v4(), ec);
+                if (!ec)
+                {
+                    socket_.bind({source, 0}, ec);
+                }
+            }
+
+            if (!ec)
+            {
+                co_await socket_.async_connect(server, asio::redirect_error(use_awaitable, ec));
+            }
+
+            if (ec)
+            {
+                ++worker_.stats.connectFailures;
+                co_return false;
+            }
+
+            socket_.set_option(tcp::no_delay(true));
+            address_ = socket_.local_endpoint(ec).address().to_string();
+            co_return true;
+        }
+
+        awaitable<bool> login()
+        {
+            const auto reply = co_await request(
+                Operation::Login, WormsPacket::freeze(PacketCode::Login, {.value1 = 0, .value4 = 0, .name = name_,
+                                                                          .info = SessionInfo(Nation::None,
+                                                                              SessionType::User)}),
+                PacketCode::LoginReply);
+            if (reply == nullptr || reply->fields().error.value_or(0) != 0)
+            {
+                co_return false;
+            }
+
+            id_ = reply->fields().value1.value_or(0);
+            co_return true;
+        }
+
+        Action pickAction()
+        {
+            std::discrete_distribution<size_t> pick(options_.mix.begin(), options_.mix.end());
+            return static_cast<Action>(pick(worker_.random));
+        }
+
+        // Returns false once the connection is gone or a request timed out.
+        awaitable<bool> perform(const Action action)
+        {
+            switch (action)
+            {
+            case Action::List:
+                co_return co_await list(Operation::ListRooms, {.value4 = 0}) != nullptr
+                          && co_await list(Operation::ListUsers, {.value2 = roomId_, .value4 = 0}) != nullptr
+                          && co_await list(Operation::ListGames, {.value2 = roomId_, .value4 = 0}) != nullptr;
+
+            case Action::Chat:
+                co_return co_await chat();
+
+            case Action::Create:
+                co_return co_await createRoom();
+
+            case Action::Join:
+                co_return co_await joinAnyRoom();
+
+            case Action::Leave:
+                co_return hosting_ || co_await leave();
+
+            case Action::Host:
+                co_return co_await hostGame();
+
+            case Action::Connect:
+                co_return co_await connectGame();
+            }
+
+            co_return true;
+        }
+
+        awaitable<bool> chat()
+        {
+            if (roomId_ == 0 && !co_await joinAnyRoom())
+            {
+                co_return false;
+            }
+
+            if (roomId_ == 0)
+            {
+                co_return true;
+            }
+
+            const auto message = std::format("GRP:[ {} ]  message {} from the load generator", name_, ++messages_);
+            co_return co_await request(Operation::Chat,
+                                       WormsPacket::freeze(PacketCode::ChatRoom, {.value0 = id_, .value3 = roomId_,
+                                                                                  .data = message}),
+                                       PacketCode::ChatRoomReply) != nullptr;
+        }
+
+        awaitable<bool> createRoom()
+        {
+            if (hosting_)
+            {
+                co_return co_await chat();
+            }
+
+            const auto reply = co_await request(
+                Operation::CreateRoom,
+                WormsPacket::freeze(PacketCode::CreateRoom, {.value1 = 0, .value4 = 0,
+                                                             .name = std::format("{}-{}", name_, ++rooms_),
+                                                             .data = "lg",
+                                                             .info = SessionInfo(Nation::None, SessionType::Room)}),
+                PacketCode::CreateRoomReply);
+            if (reply == nullptr)
+            {
+                co_return false;
+            }
+
+            co_return reply->fields().error.value_or(0) != 0 || co_await join(reply->fields().value1.value_or(0));
+        }
+
+        awaitable<bool> joinAnyRoom()
+        {
+            if (hosting_)
+            {
+                co_return true;
+            }
+
+            if (co_await list(Operation::ListRooms, {.value4 = 0}) == nullptr)
+            {
+                co_return false;
+            }
+
+            std::erase(listed_, roomId_);
+            if (listed_.empty())
+            {
+                co_return co_await createRoom();
+            }
+
+            std::uniform_int_distribution<size_t> pick(0, listed_.size() - 1);
+            co_return co_await join(listed_[pick(worker_.random)]);
+        }
+
+        awaitable<bool> join(const uint32_t roomId)
+        {
+            if (roomId_ != 0 && !co_await leave())
+            {
+                co_return false;
+            }
+
+            const auto reply = co_await request(
+                Operation::Join, WormsPacket::freeze(PacketCode::Join, {.value2 = roomId, .value10 = id_}),
+                PacketCode::JoinReply);
+            if (reply == nullptr)
+            {
+                co_return false;
+            }
+
+            if (reply->fields().error.value_or(0) == 0)
+            {
+                roomId_ = roomId;
+            }
+            co_return true;
+        }
+
+        awaitable<bool> leave()
+        {
+            if (roomId_ == 0)
+            {
+                co_return true;
+            }
+
+            const auto reply = co_await request(
+                Operation::Leave, WormsPacket::freeze(PacketCode::Leave, {.value2 = roomId_, .value10 = id_}),
+                PacketCode::LeaveReply);
+            roomId_ = 0;
+            co_return reply != nullptr;
+        }
+
+        awaitable<bool> hostGame()
+        {
+            // The server answers a successful CreateGame twice, so every client hosts at most once.
+            if (hosted_)
+            {
+                co_return co_await connectGame();
+            }
+
+            if (roomId_ == 0 && !co_await joinAnyRoom())
+            {
+                co_return false;
+            }
+
+            if (roomId_ == 0)
+            {
+                co_return true;
+            }
+
+            hosted_ = true;
+            const auto reply = co_await request(
+                Operation::HostGame,
+                WormsPacket::freeze(PacketCode::CreateGame, {.value1 = 0, .value2 = roomId_, .value4 = 0x800,
+                                                             .name = name_, .data = address_,
+                                                             .info = SessionInfo(Nation::None, SessionType::Game)}),
+                PacketCode::CreateGameReply);
+            if (reply == nullptr)
+            {
+                co_return false;
+            }
+
+            hosting_ = reply->fields().error.value_or(0) == 0;
+            co_return true;
+        }
+
+        awaitable<bool> connectGame()
+        {
+            if (roomId_ == 0)
+            {
+                co_return co_await joinAnyRoom();
+            }
+
+            if (co_await list(Operation::ListGames, {.value2 = roomId_, .value4 = 0}) == nullptr)
+            {
+                co_return false;
+            }
+
+            if (listed_.empty())
+            {
+                co_return true;
+            }
+
+            std::uniform_int_distribution<size_t> pick(0, listed_.size() - 1);
+            co_return co_await request(
+                Operation::ConnectGame,
+                WormsPacket::freeze(PacketCode::ConnectGame, {.value0 = listed_[pick(worker_.random)]}),
+                PacketCode::ConnectGameReply) != nullptr;
+        }
+
+        // Sends a list request and collects the ids of the ListItems before its ListEnd in listed_.
+        awaitable<WormsPacketPtr> list(const Operation operation, PacketFields fields)
+        {
+            static constexpr std::array<PacketCode, 3> CODES{PacketCode::ListRooms, PacketCode::ListUsers,
+                                                            PacketCode::ListGames};
+            const auto code = CODES[static_cast<size_t>(operation) - static_cast<size_t>(Operation::ListRooms)];
+            co_return co_await request(operation, WormsPacket::freeze(code, std::move(fields)), PacketCode::ListEnd);
+        }
+
+        // Sends packet and waits for the first packet with the reply code. Returns nullptr if the connection
+        // is lost or no reply arrives in time.
+        awaitable<WormsPacketPtr> request(const Operation operation, const PacketBufferPtr& packet,
+                                          const PacketCode replyCode)
+        {
+            awaiting_ = replyCode;
+            reply_ = nullptr;
+            listed_.clear();
+
+            const auto sentAt = Clock::now();
+            asio::error_code ec;
+            co_await async_write(socket_, asio::buffer(packet->data(), packet->size()),
+                                 asio::redirect_error(use_awaitable, ec));
+
+            // The reply may already be in if the write had to wait.
+            if (!ec && reply_ == nullptr)
+            {
+                wake_.expires_after(REQUEST_TIMEOUT);
+                co_await wake_.async_wait(asio::redirect_error(use_awaitable, ec));
+            }
+
+            awaiting_ = PacketCode::Unknown;
+            if (reply_ == nullptr)
+            {
+                if (socket_.is_open() && !stopping)
+                {
+                    ++worker_.stats.timeouts;
+                }
+                co_return nullptr;
+            }
+
+            const auto index = static_cast<size_t>(operation);
+            const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - sentAt);
+            worker_.stats.latencies[index].push_back(static_cast<uint32_t>(elapsed.count()));
+            if (reply_->fields().error.value_or(0) != 0)
+            {
+                ++worker_.stats.failures[index];
+            }
+
+            co_return std::exchange(reply_, nullptr);
+        }
+
+        awaitable<void> read()
+        {
+            while (socket_.is_open())
+            {
+                while (true)
+                {
+                    auto [status, data, error] = stream_.tryReadPacket();
+                    if (status == net::packet_parse_status::partial)
+                    {
+                        break;
+                    }
+
+                    if (status == net::packet_parse_status::error)
+                    {
+                        std::cerr << std::format("{}: {}\n", name_, error.value_or("parse error"));
+                        asio::error_code ec;
+                        socket_.close(ec);
+                        wake_.cancel();
+                        co_return;
+                    }
+
+                    ++worker_.stats.packetsReceived;
+                    receive(*data);
+                }
+
+                asio::error_code ec;
+                const size_t read =
+                    co_await socket_.async_receive(stream_.prepare(), asio::redirect_error(use_awaitable, ec));
+                if (read == 0 || ec)
+                {
+                    break;
+                }
+                stream_.commit(read);
+            }
+
+            wake_.cancel();
+        }
+
+        void receive(const WormsPacketPtr& packet)
+        {
+            if (packet->code() == PacketCode::ListItem && awaiting_ == PacketCode::ListEnd)
+            {
+                listed_.push_back(packet->fields().value1.value_or(0));
+                return;
+            }
+
+            if (packet->code() == awaiting_ && reply_ == nullptr)
+            {
+                reply_ = packet;
+                wake_.cancel();
+            }
+        }
+
+        awaitable<bool> think()
+        {
+            std::uniform_real_distribution<double> factor(0.5, 1.5);
+            thinkTimer_.expires_after(
+                std::chrono::duration_cast<Clock::duration>(options_.think * factor(worker_.random)));
+            asio::error_code ec;
+            co_await thinkTimer_.async_wait(asio::redirect_error(use_awaitable, ec));
+            co_return socket_.is_open();
+        }
+
+        Worker& worker_;
+        const Options& options_;
+        uint32_t number_;
+        std::string name_;
+        std::string address_;
+
+        tcp::socket socket_;
+        asio::steady_timer wake_;
+        asio::steady_timer thinkTimer_;
+        PacketStream stream_;
+
+        uint32_t id_ = 0;
+        uint32_t roomId_ = 0;
+        uint32_t rooms_ = 0;
+        uint32_t messages_ = 0;
+        bool hosted_ = false;
+        bool hosting_ = false;
+
+        PacketCode awaiting_ = PacketCode::Unknown;
+        WormsPacketPtr reply_;
+        std::vector<uint32_t> listed_;
+    };
+
+    awaitable<void> Arrivals(const std::vector<std::unique_ptr<Worker>>& workers, const Options& options)
+    {
+        Worker& home = *workers.front();
+        asio::steady_timer timer(home.context);
+        std::exponential_distribution<double> gap(options.arrivalRate);
+        const auto runTag = static_cast<uint16_t>(home.random());
+
+        uint32_t number = 0;
+        auto next = Clock::now();
+        while (!stopping)
+        {
+            if (liveClients.load(std::memory_order_relaxed) < options.clients)
+            {
+                liveClients.fetch_add(1, std::memory_order_relaxed);
+                auto& worker = *workers[number % workers.size()];
+                auto client = std::make_shared<Client>(worker, options, number++, runTag);
+                co_spawn(worker.context, [client = std::move(client)]() -> awaitable<void> // NOLINT(*-avoid-capturing-lambda-coroutines)
+                {
+                    co_await client->run();
+                }, asio::detached);
+            }
+
+            next += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(gap(home.random)));
+            timer.expires_at(next);
+            asio::error_code ec;
+            co_await timer.async_wait(asio::redirect_error(use_awaitable, ec));
+        }
+    }
+
+    void Report(const std::vector<std::unique_ptr<Worker>>& workers, const double seconds)
+    {
+        Stats total;
+        for (const auto& worker : workers)
+        {
+            for (size_t i = 0; i < OPERATION_COUNT; ++i)
+            {
+                total.latencies[i].insert(total.latencies[i].end(), worker->stats.latencies[i].begin(),
+                                          worker->stats.latencies[i].end());
+                total.failures[i] += worker->stats.failures[i];
+            }
+            total.timeouts += worker->stats.timeouts;
+            total.connectFailures += worker->stats.connectFailures;
+            total.sessions += worker->stats.sessions;
+            total.packetsReceived += worker->stats.packetsReceived;
+        }
+
+        std::cout << std::format("\n{:<13} {:>9} {:>9} {:>8} {:>9} {:>9} {:>9} {:>9}\n", "operation", "count",
+                                 "per sec", "errors", "p50 us", "p99 us", "p99.9 us", "max us");
+
+        uint64_t requests = 0;
+        for (size_t i = 0; i < OPERATION_COUNT; ++i)
+        {
+            auto& samples = total.latencies[i];
+            if (samples.empty())
+            {
+                continue;
+            }
+
+            std::ranges::sort(samples);
+            requests += samples.size();
+            std::cout << std::format("{:<13} {:>9} {:>9.1f} {:>8} {:>9} {:>9} {:>9} {:>9}\n", OPERATION_NAMES[i],
+                                     samples.size(), static_cast<double>(samples.size()) / seconds,
+                                     total.failures[i], Percentile(samples, 0.5), Percentile(samples, 0.99),
+                                     Percentile(samples, 0.999), samples.back());
+        }
+
+        std::cout << std::format("\n{} requests in {:.1f} s ({:.0f}/s), {} packets received ({:.0f}/s)\n", requests,
+                                 seconds, static_cast<double>(requests) / seconds, total.packetsReceived,
+                                 static_cast<double>(total.packetsReceived) / seconds);
+        std::cout << std::format("{} sessions completed, {} timeouts, {} failed connects\n", total.sessions,
+                                 total.timeouts, total.connectFailures);
+    }
+
+    // Returns false if the program should exit, after printing the usage or an error.
+    bool ParseArguments(const int argc, char** argv, Options& options)
+    {
+        const std::vector<std::string> args(argv + 1, argv + argc);
+        for (size_t i = 0; i < args.size(); ++i)
+        {
+            const std::string& arg = args[i];
+            if (arg == "-h" || arg == "--help")
+            {
+                std::cout << "Usage: worms_loadgen [options]\n"
+                    << "  --host <address>		Server address (default: 127.0.0.1)\n"
+                    << "  -p, --port <port>		Server port (default: 17000)\n"
+                    << "  -c, --clients <count>		Most clients connected at once (default: 1000)\n"
+                    << "  -r, --rate <per-second>	New clients per second (default: 100)\n"
+                    << "  -d, --duration <seconds>	Length of the run (default: 30)\n"
+                    << "  --think <ms>			Mean pause between actions (default: 500)\n"
+                    << "  --session <seconds>		Mean time a client stays (default: 60)\n"
+                    << "  --sources <count>		Spread clients over 127.0.0.1 to 127.0.0.<count> (default: 1)\n"
+                    << "  -t, --threads <count>		Client threads (default: "
+                    << options.threads << ")\n"
+                    << "  --mix <action>=<weight>,...	Action weights over list, chat, create, join, leave, host\n"
+                    << "				and connect (default: list=20,chat=50,create=5,join=10,\n"
+                    << "				leave=5,host=5,connect=5)\n";
+                return false;
+            }
+
+            if (i + 1 == args.size())
+            {
+                std::cerr << "Missing value for " << arg << '\n';
+                return false;
+            }
+
+            const std::string& value = args[++i];
+            if (arg == "--host")
+            {
+                options.host = value;
+            }
+            else if (arg == "-p" || arg == "--port")
+            {
+                options.port = static_cast<uint16_t>(std::stoi(value));
+            }
+            else if (arg == "-c" || arg == "--clients")
+            {
+                options.clients = static_cast<uint32_t>(std::stoul(value));
+            }
+            else if (arg == "-r" || arg == "--rate")
+            {
+                options.arrivalRate = std::stod(value);
+            }
+            else if (arg == "-d" || arg == "--duration")
+            {
+                options.duration = std::chrono::seconds(std::stoi(value));
+            }
+            else if (arg == "--think")
+            {
+                options.think = std::chrono::milliseconds(std::stoi(value));
+            }
+            else if (arg == "--session")
+            {
+                options.sessionLength = std::chrono::seconds(std::stoi(value));
+            }
+            else if (arg == "--sources")
+            {
+                options.sources = std::clamp<uint32_t>(static_cast<uint32_t>(std::stoul(value)), 1, 254);
+            }
+            else if (arg == "-t" || arg == "--threads")
+            {
+                options.threads = std::max<size_t>(1, std::stoul(value));
+            }
+            else if (arg == "--mix")
+            {
+                if (!ParseMix(value, ACTION_NAMES, options.mix))
+                {
+                    std::cerr << "Invalid mix '" << value << "'\n";
+                    return false;
+                }
+            }
+            else
+            {
+                std::cerr << "Unknown option " << arg << '\n';
+                return false;
+            }
+        }
+
+        if (options.arrivalRate <= 0.0 || options.clients == 0 || options.sessionLength.count() <= 0)
+        {
+            std::cerr << "Rate, clients and session length must be positive\n";
+            return false;
+        }
+
+        return true;
+    }
+}
+
+int main(const int argc, char** argv)
+{
+    Options options;
+    try
+    {
+        if (!ParseArguments(argc, argv, options))
+        {
+            return 0;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Invalid argument: " << e.what() << '\n';
+        return 1;
+    }
+
+    std::cout << std::format("{} clients at most, {:.0f} new per second, for {} s against {}:{} on {} threads\n",
+                             options.clients, options.arrivalRate, options.duration.count(), options.host,
+                             options.port, options.threads);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (size_t i = 0; i < options.threads; ++i)
+    {
+        workers.push_back(std::make_unique<Worker>());
+    }
+
+    std::vector<asio::executor_work_guard<asio::io_context::executor_type>> guards;
+    std::vector<std::thread> threads;
+    for (const auto& worker : workers)
+    {
+        guards.push_back(asio::make_work_guard(worker->context));
+        threads.emplace_back([&context = worker->context] { context.run(); });
+    }
+
+    co_spawn(workers.front()->context, Arrivals(workers, options), asio::detached);
+
+    const auto start = Clock::now();
+    std::this_thread::sleep_for(options.duration);
+    stopping = true;
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    // In-flight requests are dropped, not counted.
+    for (const auto& worker : workers)
+    {
+        worker->context.stop();
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    Report(workers, seconds);
+    return 0;
+}
@@ -0,0 +1,336 @@
+// Runs a whole lobby in one process and on one thread: the server's sessions talk to scripted clients over
+// LoopbackTransports while ServerClock runs on virtual time. Clients arrive at a fixed rate, log in, and
+// either open a room or join one, chat a few times with think time in between and leave. The same options
+// always produce the same digest of what the clients received, so a run is repeatable and bisectable.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <asio.hpp>
+#include "spdlog/spdlog.h"
+
+#include "loopback_transport.hpp"
+#include "packet_code.hpp"
+#include "packet_stream.hpp"
+#include "server.hpp"
+#include "server_clock.hpp"
+#include "session_info.hpp"
+#include "worms_packet.hpp"
+
+namespace
+{
+    using namespace worms_server;
+
+    struct Options
+    {
+        uint32_t clients = 2'000;
+        uint32_t perRoom = 20;
+        uint32_t chats = 5;
+        double arrivalRate = 200.0;
+        std::chrono::milliseconds think{2'000};
+        std::chrono::seconds duration{120};
+        std::chrono::milliseconds step{10};
+    };
+
+    struct Totals
+    {
+        uint32_t loggedIn = 0;
+        uint32_t finished = 0;
+        uint64_t packets = 0;
+        uint64_t bytes = 0;
+        uint64_t digest = 0xcbf29ce484222325ULL;
+    };
+
+    class SimClient
+    {
+    public:
+        SimClient(std::unique_ptr<LoopbackTransport> transport, const Options& options, Totals& totals,
+                  const uint32_t number) :
+            transport_(std::move(transport)), options_(options), totals_(totals), number_(number),
+            name_(std::format("Sim{}", number)), stream_(PacketSource::Server)
+        {
+        }
+
+        awaitable<void> run()
+        {
+            const auto login = co_await request(
+                WormsPacket::freeze(PacketCode::Login, {.value1 = 0, .value4 = 0, .name = name_,
+                                                        .info = SessionInfo(Nation::None, SessionType::User)}),
+                PacketCode::LoginReply);
+            if (login == nullptr || login->fields().error.value_or(1) != 0)
+            {
+                co_return;
+            }
+            id_ = login->fields().value1.value_or(0);
+            ++totals_.loggedIn;
+
+            if (!co_await enterRoom())
+            {
+                co_return;
+            }
+
+            for (uint32_t i = 0; i < options_.chats; ++i)
+            {
+                co_await think();
+                const auto message = std::format("GRP:[ {} ]  message {}", name_, i);
+                if (co_await request(WormsPacket::freeze(PacketCode::ChatRoom, {.value0 = id_, .value3 = roomId_,
+                                                                                .data = message}),
+                                     PacketCode::ChatRoomReply) == nullptr)
+                {
+                    co_return;
+                }
+            }
+
+            co_await think();
+            co_await request(WormsPacket::freeze(PacketCode::Leave, {.value2 = roomId_, .value10 = id_}),
+                             PacketCode::LeaveReply);
+            transport_->close();
+            ++totals_.finished;
+        }
+
+    private:
+        // The first client of every group opens a room; the others join the newest one they see.
+        awaitable<bool> enterRoom()
+        {
+            if (number_ % options_.perRoom == 0)
+            {
+                const auto created = co_await request(
+                    WormsPacket::freeze(PacketCode::CreateRoom, {.value1 = 0, .value4 = 0, .name = name_, .data = "sim",
+                                                                 .info = SessionInfo(Nation::None, SessionType::Room)}),
+                    PacketCode::CreateRoomReply);
+                if (created == nullptr || created->fields().error.value_or(1) != 0)
+                {
+                    co_return false;
+                }
+                roomId_ = created->fields().value1.value_or(0);
+            }
+            else
+            {
+                co_await think();
+                if (co_await request(WormsPacket::freeze(PacketCode::ListRooms, {.value4 = 0}), PacketCode::ListEnd)
+                    == nullptr || listed_.empty())
+                {
+                    co_return false;
+                }
+                roomId_ = std::ranges::max(listed_);
+            }
+
+            const auto joined = co_await request(
+                WormsPacket::freeze(PacketCode::Join, {.value2 = roomId_, .value10 = id_}), PacketCode::JoinReply);
+            co_return joined != nullptr && joined->fields().error.value_or(1) == 0;
+        }
+
+        awaitable<void> think()
+        {
+            ServerTimer timer(transport_->executor(), options_.think);
+            asio::error_code ec;
+            co_await timer.async_wait(asio::redirect_error(use_awaitable, ec));
+        }
+
+        // Sends packet and reads until the reply code arrives, taking in the broadcasts queued in between.
+        awaitable<WormsPacketPtr> request(const PacketBufferPtr& packet, const PacketCode replyCode)
+        {
+            listed_.clear();
+            const std::array buffers{asio::const_buffer(packet->data(), packet->size())};
+            asio::error_code ec;
+            co_await transport_->write(buffers, ec);
+
+            while (!ec)
+            {
+                auto [status, data, error] = stream_.tryReadPacket();
+                if (status == net::packet_parse_status::error)
+                {
+                    std::cerr << std::format("{}: {}\n", name_, error.value_or("parse error"));
+                    co_return nullptr;
+                }
+
+                if (status == net::packet_parse_status::complete)
+                {
+                    const auto frame = stream_.currentFrame();
+                    ++totals_.packets;
+                    totals_.bytes += frame.size();
+                    for (const auto byte : frame)
+                    {
+                        totals_.digest = (totals_.digest ^ static_cast<uint8_t>(byte)) * 0x100000001b3ULL;
+                    }
+
+                    const auto& received = *data;
+                    if (received->code() == PacketCode::ListItem && replyCode == PacketCode::ListEnd)
+                    {
+                        listed_.push_back(received->fields().value1.value_or(0));
+                    }
+                    else if (received->code() == replyCode)
+                    {
+                        co_return received;
+                    }
+                    continue;
+                }
+
+                const size_t read = co_await transport_->receive(stream_.prepare(), ec);
+                stream_.commit(read);
+            }
+
+            co_return nullptr;
+        }
+
+        std::unique_ptr<LoopbackTransport> transport_;
+        const Options& options_;
+        Totals& totals_;
+        uint32_t number_;
+        std::string name_;
+        PacketStream stream_;
+
+        uint32_t id_ = 0;
+        uint32_t roomId_ = 0;
+        std::vector<uint32_t> listed_;
+    };
+
+    awaitable<void> Arrivals(Server& server, const Options& options, Totals& totals)
+    {
+        const auto executor = co_await asio::this_coro::executor;
+        const auto gap = std::chrono::duration_cast<ServerClock::duration>(
+            std::chrono::duration<double>(1.0 / options.arrivalRate));
+        ServerTimer timer(executor);
+
+        for (uint32_t number = 0; number < options.clients; ++number)
+        {
+            // One address per client keeps them clear of the per-address login cap.
+            auto [serverEnd, clientEnd] =
+                LoopbackTransport::createPair(executor, asio::ip::address_v4(0x0A000000U + number + 1));
+            if (server.connect(std::move(serverEnd)))
+            {
+                auto client = std::make_shared<SimClient>(std::move(clientEnd), options, totals, number);
+                co_spawn(executor, [client = std::move(client)]() -> awaitable<void> // NOLINT(*-avoid-capturing-lambda-coroutines)
+                {
+                    co_await client->run();
+                }, asio::detached);
+            }
+
+            timer.expires_after(gap);
+            asio::error_code ec;
+            co_await timer.async_wait(asio::redirect_error(use_awaitable, ec));
+        }
+    }
+
+    // Returns false if the program should exit, after printing the usage or an error.
+    bool ParseArguments(const int argc, char** argv, Options& options)
+    {
+        const std::vector<std::string> args(argv + 1, argv + argc);
+        for (size_t i = 0; i < args.size(); ++i)
+        {
+            const std::string& arg = args[i];
+            if (arg == "-h" || arg == "--help")
+            {
+                std::cout << "Usage: worms_lobby_sim [options]\n"
+                    << "  -c, --clients <count>		Clients to simulate (default: 2000)\n"
+                    << "  --per-room <count>		Clients per room (default: 20)\n"
+                    << "  --chats <count>		Messages each client sends (default: 5)\n"
+                    << "  -r, --rate <per-second>	New clients per virtual second (default: 200)\n"
+                    << "  --think <ms>			Virtual pause between actions (default: 2000)\n"
+                    << "  -d, --duration <seconds>	Virtual length of the run (default: 120)\n"
+                    << "  --step <ms>			Virtual time advanced per poll (default: 10)\n";
+                return false;
+            }
+
+            if (i + 1 == args.size())
+            {
+                std::cerr << "Missing value for " << arg << '\n';
+                return false;
+            }
+
+            const std::string& value = args[++i];
+            if (arg == "-c" || arg == "--clients")
+            {
+                options.clients = static_cast<uint32_t>(std::stoul(value));
+            }
+            else if (arg == "--per-room")
+            {
+                options.perRoom = static_cast<uint32_t>(std::stoul(value));
+            }
+            else if (arg == "--chats")
+            {
+                options.chats = static_cast<uint32_t>(std::stoul(value));
+            }
+            else if (arg == "-r" || arg == "--rate")
+            {
+                options.arrivalRate = std::stod(value);
+            }
+            else if (arg == "--think")
+            {
+                options.think = std::chrono::milliseconds(std::stoi(value));
+            }
+            else if (arg == "-d" || arg == "--duration")
+            {
+                options.duration = std::chrono::seconds(std::stoi(value));
+            }
+            else if (arg == "--step")
+            {
+                options.step = std::chrono::milliseconds(std::stoi(value));
+            }
+            else
+            {
+                std::cerr << "Unknown option " << arg << '\n';
+                return false;
+            }
+        }
+
+        if (options.clients == 0 || options.perRoom == 0 || options.arrivalRate <= 0.0
+            || options.duration.count() <= 0 || options.step.count() <= 0)
+        {
+            std::cerr << "Clients, clients per room, rate, duration and step must be positive\n";
+            return false;
+        }
+
+        return true;
+    }
+}
+
+int main(const int argc, char** argv)
+{
+    Options options;
+    try
+    {
+        if (!ParseArguments(argc, argv, options))
+        {
+            return 0;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Invalid argument: " << e.what() << '\n';
+        return 1;
+    }
+
+    spdlog::set_level(spdlog::level::warn);
+    ServerClock::useVirtualTime();
+
+    ServerOptions serverOptions;
+    serverOptions.maxConnections = options.clients + 1;
+    Totals totals;
+    {
+        Server server(serverOptions);
+        server.start();
+        co_spawn(server.context(), Arrivals(server, options, totals), asio::detached);
+
+        const auto start = std::chrono::steady_clock::now();
+        const size_t handlers = AdvanceVirtualTime(server.context(), options.duration, options.step);
+        const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << std::format("{} clients, {} logged in, {} finished\n", options.clients, totals.loggedIn,
+                                 totals.finished);
+        std::cout << std::format("{} packets, {} bytes received; digest {:016x}\n", totals.packets, totals.bytes,
+                                 totals.digest);
+        std::cout << std::format("{} s of virtual time in {:.2f} s ({:.0f}x), {} handlers run\n",
+                                 options.duration.count(), wall,
+                                 static_cast<double>(options.duration.count()) / wall, handlers);
+    }
+
+    return 0;
+}
@@ -0,0 +1,511 @@
+// Replays a traffic capture (WormsServer --capture) against a running server. Every captured session
+// becomes a connection that opens, sends each frame the client sent and closes at the captured times,
+// divided by --speed. Sessions that came from the same address share a loopback source address, so the
+// server sees the same per-address structure. The user, room and game ids in the captured frames are
+// translated to the ones the live server hands out, learned by pairing its LoginReply, CreateRoomReply
+// and CreateGameReply with the captured ones. Replies are read and counted; the only one checked is the
+// reply to each session's first Join, which has to match the captured outcome.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <asio.hpp>
+
+#include "bench_util.hpp"
+#include "id_translation.hpp"
+#include "packet_stream.hpp"
+#include "traffic_capture.hpp"
+#include "worms_packet.hpp"
+
+namespace
+{
+    using namespace worms_server;
+    using asio::awaitable;
+    using asio::use_awaitable;
+    using asio::ip::tcp;
+    using Clock = std::chrono::steady_clock;
+
+    struct Options
+    {
+        std::string capture;
+        std::string host = "127.0.0.1";
+        uint16_t port = 17000;
+        double speed = 1.0;
+        size_t threads = std::max(1U, std::thread::hardware_concurrency());
+    };
+
+    // How long a frame waits for the live replies that assigned the ids it may use.
+    constexpr auto REPLY_WAIT = std::chrono::seconds(5);
+
+    struct Frame
+    {
+        uint64_t time;
+        std::vector<net::byte> bytes;
+
+        // Id-assigning replies the client had received when it sent this frame.
+        size_t idRepliesBefore = 0;
+    };
+
+    struct CapturedSession
+    {
+        uint64_t openAt = 0;
+        std::optional<uint64_t> closeAt;
+        uint32_t source = 0;
+        std::vector<Frame> frames;
+
+        // The captured replies that assigned an id, in order, to pair with the live ones.
+        std::vector<WormsPacketPtr> idReplies;
+
+        // The captured outcome of the session's first Join, if it sent one.
+        std::optional<uint32_t> firstJoinError;
+    };
+
+    struct Totals
+    {
+        std::atomic<uint64_t> sessions{0};
+        std::atomic<uint64_t> connectFailures{0};
+        std::atomic<uint64_t> framesSent{0};
+        std::atomic<uint64_t> bytesSent{0};
+        std::atomic<uint64_t> bytesReceived{0};
+
+        // Sessions whose first Join was answered; mismatched ones got a different outcome than captured.
+        std::atomic<uint64_t> joinsChecked{0};
+        std::atomic<uint64_t> joinMismatches{0};
+
+        // Microseconds each send started after its scheduled time.
+        std::mutex lateMutex;
+        std::vector<uint32_t> late;
+    };
+
+    // Splits what the server wrote to a captured session into packets, keeping the id-assigning replies and
+    // the outcome of the first Join.
+    void NoteOutbound(CapturedSession& session, PacketStream& stream, std::span<const net::byte> bytes)
+    {
+        while (!bytes.empty())
+        {
+            const auto space = stream.prepare();
+            const size_t length = std::min(space.size(), bytes.size());
+            std::memcpy(space.data(), bytes.data(), length);
+            stream.commit(length);
+            bytes = bytes.subspan(length);
+
+            while (true)
+            {
+                const auto [status, data, error] = stream.tryReadPacket();
+                if (status == net::packet_parse_status::error)
+                {
+                    // Starts over rather than staying stuck on the bad bytes.
+                    stream = PacketStream(PacketSource::Server);
+                    return;
+                }
+                if (status == net::packet_parse_status::partial)
+                {
+                    break;
+                }
+
+                const auto& packet = *data;
+                if (IdTranslation::assignsId(packet->code()))
+                {
+                    session.idReplies.push_back(packet);
+                }
+                else if (packet->code() == PacketCode::JoinReply && !session.firstJoinError)
+                {
+                    session.firstJoinError = packet->fields().error.value_or(0);
+                }
+            }
+        }
+    }
+
+    // Groups the records by session and gives each distinct client address its own 127.0.0.x.
+    std::vector<CapturedSession> Sessions(const std::vector<CaptureRecord>& records)
+    {
+        std::map<uint32_t, CapturedSession> sessions;
+        std::map<uint32_t, PacketStream> outbound;
+        std::map<std::vector<net::byte>, uint32_t> sources;
+
+        for (const auto& record : records)
+        {
+            switch (record.event)
+            {
+            case CaptureEvent::Open:
+            {
+                auto& session = sessions[record.session];
+                session.openAt = record.time;
+                const auto [source, added] = sources.try_emplace(record.payload, static_cast<uint32_t>(sources.size()));
+                session.source = source->second;
+                break;
+            }
+
+            case CaptureEvent::Inbound:
+                if (const auto it = sessions.find(record.session); it != sessions.end())
+                {
+                    it->second.frames.push_back({record.time, record.payload, it->second.idReplies.size()});
+                }
+                break;
+
+            case CaptureEvent::Close:
+                if (const auto it = sessions.find(record.session); it != sessions.end())
+                {
+                    it->second.closeAt = record.time;
+                }
+                break;
+
+            case CaptureEvent::Outbound:
+                if (const auto it = sessions.find(record.session); it != sessions.end())
+                {
+                    const auto [stream, added] = outbound.try_emplace(record.session, PacketSource::Server);
+                    NoteOutbound(it->second, stream->second, record.payload);
+                }
+                break;
+            }
+        }
+
+        std::vector<CapturedSession> result;
+        result.reserve(sessions.size());
+        for (auto& session : sessions | std::views::values)
+        {
+            result.push_back(std::move(session));
+        }
+        return result;
+    }
+
+    class Replayer : public std::enable_shared_from_this<Replayer>
+    {
+    public:
+        // executor must be a strand; run, the reader and the timers all share it.
+        Replayer(const asio::any_io_executor& executor, const Options& options, const CapturedSession& session,
+                 const Clock::time_point start, IdTranslation& ids, Totals& totals) :
+            options_(options), session_(session), start_(start), ids_(ids), totals_(totals), socket_(executor),
+            timer_(executor), replyTimer_(executor)
+        {
+        }
+
+        awaitable<void> run()
+        {
+            co_await waitUntil(session_.openAt);
+            if (!co_await connect())
+            {
+                co_return;
+            }
+            ++totals_.sessions;
+
+            co_spawn(socket_.get_executor(), [self = shared_from_this()]() -> awaitable<void> // NOLINT(*-avoid-capturing-lambda-coroutines)
+            {
+                co_await self->drain();
+            }, asio::detached);
+
+            std::vector<uint32_t> late;
+            for (const auto& frame : session_.frames)
+            {
+                late.push_back(co_await waitUntil(frame.time));
+                co_await waitForIdReplies(frame.idRepliesBefore);
+
+                const auto bytes = ids_.rewrite(frame.bytes);
+                asio::error_code ec;
+                co_await async_write(socket_, asio::buffer(bytes), asio::redirect_error(use_awaitable, ec));
+                if (ec)
+                {
+                    break;
+                }
+                ++totals_.framesSent;
+                totals_.bytesSent += bytes.size();
+            }
+
+            // A session still open when the capture ended is closed after its last frame.
+            if (session_.closeAt)
+            {
+                co_await waitUntil(*session_.closeAt);
+            }
+
+            asio::error_code ec;
+            socket_.shutdown(tcp::socket::shutdown_both, ec);
+            socket_.close(ec);
+
+            if (session_.firstJoinError && firstJoinError_)
+            {
+                ++totals_.joinsChecked;
+                if (*firstJoinError_ != *session_.firstJoinError)
+                {
+                    ++totals_.joinMismatches;
+                }
+            }
+
+            const std::scoped_lock lock(totals_.lateMutex);
+            totals_.late.insert(totals_.late.end(), late.begin(), late.end());
+        }
+
+    private:
+        awaitable<bool> connect()
+        {
+            asio::error_code ec;
+            const tcp::endpoint server(asio::ip::make_address(options_.host, ec), options_.port);
+            if (!ec)
+            {
+                socket_.open(tcp::v4(), ec);
+            }
+            if (!ec)
+            {
+                const auto source = asio::ip::address_v4((127U << 24) + 1 + session_.source % 254);
+                socket_.bind({source, 0}, ec);
+            }
+            if (!ec)
+            {
+                co_await socket_.async_connect(server, asio::redirect_error(use_awaitable, ec));
+            }
+
+            if (ec)
+            {
+                ++totals_.connectFailures;
+                co_return false;
+            }
+
+            socket_.set_option(tcp::no_delay(true));
+            co_return true;
+        }
+
+        awaitable<void> drain()
+        {
+            while (true)
+            {
+                asio::error_code ec;
+                const size_t read = co_await socket_.async_receive(stream_.prepare(),
+                                                                   asio::redirect_error(use_awaitable, ec));
+                if (read == 0 || ec)
+                {
+                    break;
+                }
+                totals_.bytesReceived += read;
+                stream_.commit(read);
+
+                if (!readReplies())
+                {
+                    break;
+                }
+            }
+
+            // Nothing more arrives, so a frame waiting for a reply goes out as it is.
+            drained_ = true;
+            replyTimer_.cancel();
+        }
+
+        // Pairs the live id-assigning replies with the captured ones and notes the first Join's outcome.
+        // Returns false on output that cannot be parsed.
+        bool readReplies()
+        {
+            while (true)
+            {
+                const auto [status, data, error] = stream_.tryReadPacket();
+                if (status == net::packet_parse_status::partial)
+                {
+                    return true;
+                }
+                if (status == net::packet_parse_status::error)
+                {
+                    return false;
+                }
+
+                const auto& packet = *data;
+                if (IdTranslation::assignsId(packet->code()))
+                {
+                    if (idReplies_ < session_.idReplies.size())
+                    {
+                        ids_.learn(*session_.idReplies[idReplies_], *packet);
+                    }
+                    ++idReplies_;
+                    replyTimer_.cancel();
+                }
+                else if (packet->code() == PacketCode::JoinReply && !firstJoinError_)
+                {
+                    firstJoinError_ = packet->fields().error.value_or(0);
+                }
+            }
+        }
+
+        // Waits until the live server has sent as many id-assigning replies as the client had received, so
+        // the frame's ids can be translated, or until REPLY_WAIT has passed.
+        awaitable<void> waitForIdReplies(const size_t count)
+        {
+            const auto deadline = Clock::now() + REPLY_WAIT;
+            while (idReplies_ < count && !drained_ && Clock::now() < deadline)
+            {
+                replyTimer_.expires_at(deadline);
+                asio::error_code ec;
+                co_await replyTimer_.async_wait(asio::redirect_error(use_awaitable, ec));
+            }
+        }
+
+        // Sleeps until the captured time, scaled by the speed, and returns how late it woke in microseconds.
+        awaitable<uint32_t> waitUntil(const uint64_t capturedNanoseconds)
+        {
+            const auto target = start_ + std::chrono::duration_cast<Clock::duration>(
+                                    std::chrono::duration<double, std::nano>(capturedNanoseconds / options_.speed));
+            timer_.expires_at(target);
+            asio::error_code ec;
+            co_await timer_.async_wait(asio::redirect_error(use_awaitable, ec));
+
+            const auto late = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - target);
+            co_return static_cast<uint32_t>(std::clamp<int64_t>(late.count(), 0, UINT32_MAX));
+        }
+
+        const Options& options_;
+        const CapturedSession& session_;
+        Clock::time_point start_;
+        IdTranslation& ids_;
+        Totals& totals_;
+        tcp::socket socket_;
+        asio::steady_timer timer_;
+
+        PacketStream stream_{PacketSource::Server};
+        asio::steady_timer replyTimer_;
+        size_t idReplies_ = 0;
+        bool drained_ = false;
+        std::optional<uint32_t> firstJoinError_;
+    };
+
+    // Returns false if the program should exit, after printing the usage or an error.
+    bool ParseArguments(const int argc, char** argv, Options& options)
+    {
+        const std::vector<std::string> args(argv + 1, argv + argc);
+        for (size_t i = 0; i < args.size(); ++i)
+        {
+            const std::string& arg = args[i];
+            if (arg == "-h" || arg == "--help")
+            {
+                std::cout << "Usage: worms_replay [options] <capture file>\n"
+                    << "  --host <address>		Server address (default: 127.0.0.1)\n"
+                    << "  -p, --port <port>		Server port (default: 17000)\n"
+                    << "  -s, --speed <factor>		Replay this many times faster than captured (default: 1)\n"
+                    << "  -t, --threads <count>		Client threads (default: " << options.threads << ")\n";
+                return false;
+            }
+
+            if (!arg.starts_with('-'))
+            {
+                options.capture = arg;
+                continue;
+            }
+
+            if (i + 1 == args.size())
+            {
+                std::cerr << "Missing value for " << arg << '\n';
+                return false;
+            }
+
+            const std::string& value = args[++i];
+            if (arg == "--host")
+            {
+                options.host = value;
+            }
+            else if (arg == "-p" || arg == "--port")
+            {
+                options.port = static_cast<uint16_t>(std::stoi(value));
+            }
+            else if (arg == "-s" || arg == "--speed")
+            {
+                options.speed = std::stod(value);
+            }
+            else if (arg == "-t" || arg == "--threads")
+            {
+                options.threads = std::max<size_t>(1, std::stoul(value));
+            }
+            else
+            {
+                std::cerr << "Unknown option " << arg << '\n';
+                return false;
+            }
+        }
+
+        if (options.capture.empty() || options.speed <= 0.0)
+        {
+            std::cerr << "A capture file and a positive speed are required\n";
+            return false;
+        }
+
+        return true;
+    }
+}
+
+int main(const int argc, char** argv)
+{
+    Options options;
+    try
+    {
+        if (!ParseArguments(argc, argv, options))
+        {
+            return 0;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Invalid argument: " << e.what() << '\n';
+        return 1;
+    }
+
+    const auto records = ReadCapture(options.capture);
+    if (!records)
+    {
+        std::cerr << options.capture << " is not a capture file\n";
+        return 1;
+    }
+
+    const auto sessions = Sessions(*records);
+    const uint64_t span = records->empty() ? 0 : records->back().time;
+    std::cout << std::format("{} sessions over {:.1f} s, replaying at {}x against {}:{}\n", sessions.size(),
+                             static_cast<double>(span) / 1e9, options.speed, options.host, options.port);
+
+    asio::io_context context;
+    IdTranslation ids;
+    Totals totals;
+
+    // A short lead, so the first sessions are not late before the threads are up.
+    const auto start = Clock::now() + std::chrono::milliseconds(200);
+    for (const auto& session : sessions)
+    {
+        // run shares the socket with the reader, so it has to run on the same strand.
+        const asio::any_io_executor strand = asio::make_strand(context);
+        auto replayer = std::make_shared<Replayer>(strand, options, session, start, ids, totals);
+        co_spawn(strand, [replayer = std::move(replayer)]() -> awaitable<void> // NOLINT(*-avoid-capturing-lambda-coroutines)
+        {
+            co_await replayer->run();
+        }, asio::detached);
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < options.threads; ++i)
+    {
+        threads.emplace_back([&context] { context.run(); });
+    }
+    context.run();
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::ranges::sort(totals.late);
+    std::cout << std::format("{} sessions replayed in {:.1f} s, {} failed to connect\n", totals.sessions.load(),
+                             seconds, totals.connectFailures.load());
+    std::cout << std::format("{} frames ({} bytes) sent, {} bytes received\n", totals.framesSent.load(),
+                             totals.bytesSent.load(), totals.bytesReceived.load());
+    std::cout << std::format("send lateness p50 {} us, p99 {} us, max {} us\n", Percentile(totals.late, 0.5),
+                             Percentile(totals.late, 0.99), totals.late.empty() ? 0 : totals.late.back());
+
+    // A session whose ids were not translated is refused at its first Join, so this catches a broken replay.
+    const uint64_t mismatches = totals.joinMismatches.load();
+    std::cout << std::format("{} of {} sessions got their first Join answered as captured\n",
+                             totals.joinsChecked.load() - mismatches, totals.joinsChecked.load());
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+#ifndef ADMISSION_CONTROL_HPP
+#define ADMISSION_CONTROL_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+#include <asio/ip/address.hpp>
+
+namespace worms_server
+{
+    struct AdmissionStats
+    {
+        uint64_t rejectedAtCapacity = 0;
+        uint64_t rejectedPerAddress = 0;
+        uint64_t rejectedPending = 0;
+        uint64_t acceptPauses = 0;
+        uint64_t pausedMilliseconds = 0;
+    };
+
+    // Caps the sessions that have connected but not logged in yet, per source address and in total, so a
+    // flood of idle or slow handshakes cannot crowd out logins. Also keeps the counters for the listener's
+    // capacity pauses.
+    class AdmissionControl
+    {
+    public:
+        // Holds one unauthenticated slot until it is released or destroyed.
+        class Ticket
+        {
+        public:
+            Ticket() = default;
+            Ticket(Ticket&& other) noexcept;
+            Ticket& operator=(Ticket&& other) noexcept;
+            ~Ticket();
+
+            Ticket(const Ticket&) = delete;
+            Ticket& operator=(const Ticket&) = delete;
+
+            void release();
+
+        private:
+            friend class AdmissionControl;
+
+            Ticket(AdmissionControl* owner, uint32_t address);
+
+            AdmissionControl* owner_ = nullptr;
+            uint32_t address_ = 0;
+        };
+
+        AdmissionControl(size_t maxPendingPerAddress, size_t maxPending);
+
+        // Takes an unauthenticated slot for a newly accepted connection, or nothing if a cap is reached.
+        [[nodiscard]] std::optional<Ticket> admit(const asio::ip::address& address);
+
+        void countRejectedAtCapacity();
+        void countPause(std::chrono::steady_clock::duration paused);
+
+        [[nodiscard]] AdmissionStats stats() const;
+
+    private:
+        void release(uint32_t address);
+
+        size_t maxPendingPerAddress_;
+        size_t maxPending_;
+
+        std::mutex mutex_;
+        std::unordered_map<uint32_t, uint32_t> pendingPerAddress_;
+        size_t pending_ = 0;
+
+        std::atomic<uint64_t> rejectedAtCapacity_{0};
+        std::atomic<uint64_t> rejectedPerAddress_{0};
+        std::atomic<uint64_t> rejectedPending_{0};
+        std::atomic<uint64_t> acceptPauses_{0};
+        std::atomic<uint64_t> pausedMilliseconds_{0};
+    };
+} // namespace worms_server
+
+#endif // ADMISSION_CONTROL_HPP
@@ -3,12 +3,17 @@
 
 #include <atomic>
 #include <memory>
+#include <span>
 #include <shared_mutex>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 #include <moodycamel/concurrentqueue.h>
 
 #include <asio/ip/address_v4.hpp>
 
+#include "fixed_name.hpp"
+
 namespace worms_server
 {
     class User;
@@ -30,21 +35,69 @@ namespace worms_server
         [[nodiscard]] std::vector<std::shared_ptr<Room>> getRooms() const;
         [[nodiscard]] std::vector<std::shared_ptr<Game>> getGames() const;
 
+        [[nodiscard]] size_t userCount() const;
+        [[nodiscard]] size_t roomCount() const;
+        [[nodiscard]] size_t gameCount() const;
+
         [[nodiscard]] std::vector<std::shared_ptr<User>> getUsersInRoom(uint32_t roomId) const;
         [[nodiscard]] std::shared_ptr<Game> getGameByName(std::string_view name) const;
 
+        [[nodiscard]] bool isUserNameTaken(std::string_view name) const;
+        [[nodiscard]] bool isRoomNameTaken(std::string_view name) const;
+        [[nodiscard]] bool hasUsersInRoom(uint32_t roomId, uint32_t excludedUserId = 0) const;
+        [[nodiscard]] bool hasGamesInRoom(uint32_t roomId, uint32_t excludedGameId = 0) const;
+
         void setUserRoomId(uint32_t userId, uint32_t roomId);
 
         void addUser(std::shared_ptr<User> user);
         void removeUser(uint32_t id);
+        void removeUsers(std::span<const uint32_t> ids);
+
+        // Removes the user like removeUser but keeps its id out of reuse until recycleId, so a notification
+        // still naming it never reaches clients after a newcomer took the id.
+        void detachUser(uint32_t id);
 
         void addRoom(std::shared_ptr<Room> room);
         void removeRoom(uint32_t id);
 
+        // Removes the listed rooms that no user or game is in any more, and returns their ids.
+        std::vector<uint32_t> removeEmptyRooms(std::span<const uint32_t> ids);
+
         void addGame(std::shared_ptr<Game> game);
         void removeGame(uint32_t id);
 
+        // Removes every game hosted under one of the names, in a single pass, and returns them.
+        std::vector<std::shared_ptr<Game>> removeGamesByName(std::span<const std::string_view> names);
+
     private:
+        // Entities are stored column-wise: slot i of every vector describes the same entity, so scans
+        // only touch the fields they test. Removal swaps the last slot into the hole.
+        struct UserTable
+        {
+            std::unordered_map<uint32_t, uint32_t> slots;
+            std::vector<uint32_t> ids;
+            std::vector<uint32_t> roomIds;
+            std::vector<FixedName> names;
+            std::vector<std::shared_ptr<User>> objects;
+        };
+
+        struct RoomTable
+        {
+            std::unordered_map<uint32_t, uint32_t> slots;
+            std::vector<uint32_t> ids;
+            std::vector<FixedName> names;
+            std::vector<std::shared_ptr<Room>> objects;
+        };
+
+        struct GameTable
+        {
+            std::unordered_map<uint32_t, uint32_t> slots;
+            std::vector<uint32_t> ids;
+            std::vector<uint32_t> roomIds;
+            std::vector<FixedName> names;
+            std::vector<std::shared_ptr<Game>> objects;
+        };
+
         mutable std::shared_mutex usersMutex_;
         mutable std::shared_mutex roomsMutex_;
         mutable std::shared_mutex gamesMutex_;
@@ -52,9 +105,9 @@ namespace worms_server
         std::atomic_uint32_t nextId_ = 0x1000U;
         moodycamel::ConcurrentQueue<uint32_t> recycledIds_;
 
-        std::unordered_map<uint32_t, std::shared_ptr<User>> users_;
-        std::unordered_map<uint32_t, std::shared_ptr<Room>> rooms_;
-        std::unordered_map<uint32_t, std::shared_ptr<Game>> games_;
+        UserTable users_;
+        RoomTable rooms_;
+        GameTable games_;
     };
 } // namespace worms_server
 
@@ -0,0 +1,47 @@
+#ifndef DISCONNECT_BATCHER_HPP
+#define DISCONNECT_BATCHER_HPP
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include <asio.hpp>
+
+namespace worms_server
+{
+    class User;
+
+    // Collects the users whose sessions ended within a short window and notifies the survivors together:
+    // one pass over the game and room tables, and one combined Leave/Close/DisconnectUser buffer per
+    // survivor, so a router flap dropping D of N clients costs N writes instead of D x N.
+    class DisconnectBatcher
+    {
+    public:
+        [[nodiscard]] static DisconnectBatcher& getInstance();
+
+        // How long the first disconnect of a batch waits for others; set once at startup.
+        void setWindow(std::chrono::milliseconds window);
+
+        // Removes a logged-in user whose session ended from the database at once, so its name is free and
+        // broadcasts skip it, and queues the notifications about it for the next batch.
+        void submit(const asio::any_io_executor& executor, std::shared_ptr<User> user);
+
+        // Removes the users, their hosted games and the rooms left empty, then notifies the survivors.
+        static void teardown(std::span<const std::shared_ptr<User>> users);
+
+    private:
+        asio::awaitable<void> flushAfter(std::chrono::milliseconds window);
+
+        // Removes the games and rooms the users leave behind, notifies the survivors and frees the user ids.
+        static void notify(std::span<const std::shared_ptr<User>> users);
+
+        std::chrono::milliseconds window_{0};
+        std::mutex mutex_;
+        std::vector<std::shared_ptr<User>> pending_;
+        bool scheduled_ = false;
+    };
+} // namespace worms_server
+
+#endif // DISCONNECT_BATCHER_HPP
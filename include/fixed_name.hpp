@@ -0,0 +1,37 @@
+#ifndef FIXED_NAME_HPP
+#define FIXED_NAME_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace worms_server
+{
+    // Inline name storage sized to the wire field, so entities and lookup columns need no heap string.
+    class FixedName
+    {
+    public:
+        static constexpr size_t CAPACITY = 20;
+
+        FixedName() = default;
+
+        explicit FixedName(const std::string_view name) : length_(static_cast<uint8_t>(std::min(name.size(), CAPACITY)))
+        {
+            std::copy_n(name.data(), length_, chars_.data());
+        }
+
+        [[nodiscard]] std::string_view view() const
+        {
+            return {chars_.data(), length_};
+        }
+
+        bool operator==(const FixedName& other) const = default;
+
+    private:
+        std::array<char, CAPACITY> chars_{};
+        uint8_t length_ = 0;
+    };
+} // namespace worms_server
+
+#endif // FIXED_NAME_HPP
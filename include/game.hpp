@@ -8,6 +8,7 @@
 #include "spdlog/spdlog.h"
 
 #include <asio/ip/address_v4.hpp>
+#include "fixed_name.hpp"
 #include "session_info.hpp"
 
 namespace worms_server
@@ -25,7 +26,8 @@ namespace worms_server
 
         [[nodiscard]] uint32_t getId() const;
         [[nodiscard]] std::string_view getName() const;
-        [[nodiscard]] const SessionInfo& getSessionInfo() const;
+        [[nodiscard]] Nation getNation() const;
+        [[nodiscard]] SessionInfo getSessionInfo() const;
         [[nodiscard]] asio::ip::address_v4 getAddress() const;
         [[nodiscard]] uint32_t getRoomId() const;
 
@@ -37,10 +39,11 @@ namespace worms_server
 
     private:
         uint32_t id_;
-        std::string name_;
-        SessionInfo sessionInfo_;
-        asio::ip::address_v4 address_;
         uint32_t roomId_;
+        FixedName name_;
+        Nation nation_;
+        SessionAccess access_;
+        asio::ip::address_v4 address_;
     };
 } // namespace worms_server
 
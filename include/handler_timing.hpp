@@ -0,0 +1,132 @@
+#ifndef HANDLER_TIMING_HPP
+#define HANDLER_TIMING_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "packet_code.hpp"
+#include "rate_limiter.hpp"
+#include "server_clock.hpp"
+
+namespace worms_server
+{
+    // Latency histogram in the style of HdrHistogram: each power of two of nanoseconds is split into 16
+    // linear sub-buckets, so a value is placed within 1/16 of itself from 16 ns up to about 34 s.
+    class LatencyHistogram
+    {
+    public:
+        static constexpr size_t SUB_BUCKETS = 16;
+        static constexpr size_t BUCKETS = 512;
+
+        void record(const std::chrono::nanoseconds latency)
+        {
+            const auto value = static_cast<uint64_t>(std::max<int64_t>(0, latency.count()));
+            counts_[indexOf(value)].fetch_add(1, std::memory_order_relaxed);
+            sum_.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        // Adds this histogram's counts and sum to the totals.
+        void addTo(std::array<uint64_t, BUCKETS>& counts, uint64_t& sum) const;
+
+        [[nodiscard]] static constexpr size_t indexOf(const uint64_t value)
+        {
+            if (value < SUB_BUCKETS)
+            {
+                return value;
+            }
+
+            const size_t shift = std::bit_width(value) - 5;
+            const size_t index = SUB_BUCKETS + shift * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS);
+            return std::min(index, BUCKETS - 1);
+        }
+
+        // The largest value that falls in the bucket.
+        [[nodiscard]] static constexpr uint64_t highestIn(const size_t index)
+        {
+            if (index < SUB_BUCKETS)
+            {
+                return index;
+            }
+
+            const size_t shift = (index - SUB_BUCKETS) / SUB_BUCKETS;
+            const uint64_t lowest = (SUB_BUCKETS + (index - SUB_BUCKETS) % SUB_BUCKETS) << shift;
+            return lowest + (uint64_t{1} << shift) - 1;
+        }
+
+    private:
+        std::array<std::atomic<uint64_t>, BUCKETS> counts_{};
+        std::atomic<uint64_t> sum_{0};
+    };
+
+    struct LatencySummary
+    {
+        uint64_t count = 0;
+        std::chrono::nanoseconds sum{0};
+        std::chrono::nanoseconds p50{0};
+        std::chrono::nanoseconds p90{0};
+        std::chrono::nanoseconds p99{0};
+        std::chrono::nanoseconds p999{0};
+        std::chrono::nanoseconds max{0};
+    };
+
+    // Percentiles of counts summed from one or more LatencyHistograms; each is the top of its bucket.
+    [[nodiscard]] LatencySummary SummarizeLatency(const std::array<uint64_t, LatencyHistogram::BUCKETS>& counts,
+                                                  uint64_t sum);
+
+    // Handler time runs from dispatch to the handler's return; end to end runs from the read that
+    // completed the packet to the last packet the handler enqueued for any client.
+    struct HandlerCodeStats
+    {
+        LatencySummary handler;
+        LatencySummary endToEnd;
+        uint64_t slow = 0;
+    };
+
+    // One entry per code PacketHandler dispatches, in RATE_LIMITED_CODES order.
+    using HandlerStats = std::array<HandlerCodeStats, RATE_LIMITED_CODES.size()>;
+
+    // What the running dispatch has enqueued so far on this thread. PacketHandler's handlers never
+    // suspend, so a dispatch starts and finishes on one thread with nothing interleaved.
+    struct DispatchTrace
+    {
+        bool active = false;
+        uint32_t enqueued = 0;
+        ServerClock::time_point lastEnqueue;
+    };
+
+    inline thread_local DispatchTrace currentDispatch;
+
+    // Called wherever a packet is queued for a client, so the running dispatch learns its fan-out.
+    inline void NoteDispatchEnqueue()
+    {
+        if (auto& trace = currentDispatch; trace.active)
+        {
+            ++trace.enqueued;
+            trace.lastEnqueue = ServerClock::now();
+        }
+    }
+
+    // Dispatches slower than this end to end are logged, at most a few per second; zero logs none.
+    // Set once at startup.
+    void SetSlowHandlerThreshold(std::chrono::milliseconds threshold);
+
+    void BeginDispatch();
+
+    // Records the dispatch of code that began at started, for a packet completed at received.
+    void FinishDispatch(PacketCode code, std::string_view userName, ServerClock::time_point received,
+                        ServerClock::time_point started);
+
+    // Sums every thread's histograms.
+    [[nodiscard]] HandlerStats GetHandlerStats();
+
+    // Appends the per-code latencies as Prometheus summaries.
+    void AppendHandlerMetrics(std::string& out);
+} // namespace worms_server
+
+#endif // HANDLER_TIMING_HPP
@@ -0,0 +1,53 @@
+#ifndef ID_TRANSLATION_HPP
+#define ID_TRANSLATION_HPP
+
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "framed_packet_reader.hpp"
+#include "packet_code.hpp"
+
+namespace worms_server
+{
+    class WormsPacket;
+    struct PacketFields;
+
+    // Maps the user, room and game ids one server handed out to the ones another server handed out for the
+    // same requests, so client frames captured against or sent to the first can be sent to the second.
+    // Ids are learned from paired LoginReply, CreateRoomReply and CreateGameReply packets; they are global
+    // to a lobby, so one translation is shared by every session. Thread-safe.
+    class IdTranslation
+    {
+    public:
+        // Whether replies with this code carry a new id in value1.
+        [[nodiscard]] static constexpr bool assignsId(const PacketCode code)
+        {
+            return code == PacketCode::LoginReply || code == PacketCode::CreateRoomReply
+                || code == PacketCode::CreateGameReply;
+        }
+
+        // Pairs the id in the first server's reply with the one in the second server's reply to the same
+        // request. Ignored unless both are successful replies of the same id-assigning code.
+        void learn(const WormsPacket& original, const WormsPacket& translated);
+
+        // The second server's id for original, or original itself if it was never learned.
+        [[nodiscard]] uint32_t translate(uint32_t original) const;
+
+        // Translates the ids in value0, value2, value3 and value10 of a client packet. Returns whether any
+        // changed.
+        bool translateFields(PacketFields& fields) const;
+
+        // A client frame with its ids translated. The frame comes back unchanged if it cannot be parsed or
+        // names no learned id.
+        [[nodiscard]] std::vector<net::byte> rewrite(std::span<const net::byte> frame) const;
+
+    private:
+        mutable std::mutex mutex_;
+        std::unordered_map<uint32_t, uint32_t> ids_;
+    };
+} // namespace worms_server
+
+#endif // ID_TRANSLATION_HPP
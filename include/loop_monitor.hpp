@@ -0,0 +1,98 @@
+#ifndef LOOP_MONITOR_HPP
+#define LOOP_MONITOR_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <asio.hpp>
+
+#include "handler_timing.hpp"
+
+namespace worms_server
+{
+    struct LoopThreadSlot;
+
+    // Names what the calling io thread is doing until the scope ends, so a stall report can say where
+    // the thread is stuck. Costs a clock read and a few relaxed stores; does nothing off the io threads.
+    class LoopActivity
+    {
+    public:
+        // what must outlive the scope, e.g. a string literal; a nonzero code is reported with it.
+        explicit LoopActivity(const char* what, uint32_t code = 0);
+        ~LoopActivity();
+
+        LoopActivity(const LoopActivity&) = delete;
+        LoopActivity& operator=(const LoopActivity&) = delete;
+
+    private:
+        LoopThreadSlot* slot_;
+        const char* previousWhat_ = nullptr;
+        uint32_t previousCode_ = 0;
+        int64_t previousSince_ = 0;
+    };
+
+    struct LoopThreadStats
+    {
+        // How late the probe timers fired on this thread.
+        LatencySummary lag;
+        uint64_t stalls = 0;
+    };
+
+    // Watches the io threads for scheduling lag. One probe per thread sleeps on a timer and records how
+    // late it wakes into the histogram of whichever thread ran it, so a thread busy in a long handler, a
+    // blocking log write or a contended Database lock shows up as lag. A watchdog thread outside the
+    // io_context warns when a probe is overdue or a thread has been in one LoopActivity past the stall
+    // threshold, with a snapshot of what every io thread is doing.
+    class LoopMonitor
+    {
+    public:
+        [[nodiscard]] static LoopMonitor& getInstance();
+
+        [[nodiscard]] static bool enabled()
+        {
+            return enabled_.load(std::memory_order_relaxed);
+        }
+
+        // Spawns the probes on context and starts the watchdog. The io threads call attach as they start.
+        void start(asio::io_context& context, size_t threads, std::chrono::milliseconds stallThreshold);
+
+        // Stops the watchdog; the probes end with the io_context.
+        void stop();
+
+        // Marks the calling thread as io thread index, below the thread count given to start.
+        void attach(size_t index);
+
+        [[nodiscard]] std::vector<LoopThreadStats> stats() const;
+
+        void logReport() const;
+
+        // Appends the lag percentiles per thread as a Prometheus summary.
+        void appendMetrics(std::string& out) const;
+
+    private:
+        LoopMonitor() = default;
+
+        asio::awaitable<void> probe(size_t index);
+        void watch(const std::stop_token& stop);
+        [[nodiscard]] std::string snapshot(int64_t now) const;
+
+        static std::atomic<bool> enabled_;
+
+        std::vector<std::unique_ptr<LoopThreadSlot>> threads_;
+
+        // When each probe's timer is due, in steady_clock nanoseconds; zero while the probe is running.
+        std::unique_ptr<std::atomic<int64_t>[]> probeDue_;
+        size_t probeCount_ = 0;
+
+        int64_t stallThreshold_ = 0;
+        std::atomic<uint64_t> loopStalls_{0};
+        std::jthread watchdog_;
+    };
+} // namespace worms_server
+
+#endif // LOOP_MONITOR_HPP
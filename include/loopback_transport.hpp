@@ -0,0 +1,66 @@
+#ifndef LOOPBACK_TRANSPORT_HPP
+#define LOOPBACK_TRANSPORT_HPP
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "framed_packet_reader.hpp"
+#include "transport.hpp"
+
+namespace worms_server
+{
+    // In-process stand-in for a TCP connection: two ends joined by byte queues, with no socket and no
+    // kernel in between. A write lands in the peer's queue at once and never blocks; a receive waits until
+    // bytes arrive or either end closes, and still drains what was written before the close. Both ends
+    // must be used from one thread and destroyed before their io_context.
+    class LoopbackTransport final : public Transport
+    {
+    public:
+        // Returns the server end and the client end of a new connection from clientAddress.
+        [[nodiscard]] static std::pair<std::unique_ptr<LoopbackTransport>, std::unique_ptr<LoopbackTransport>>
+        createPair(const asio::any_io_executor& executor, asio::ip::address_v4 clientAddress);
+
+        [[nodiscard]] asio::any_io_executor executor() override;
+        [[nodiscard]] asio::ip::address_v4 remoteAddress() const override;
+        [[nodiscard]] bool isOpen() const override;
+
+        asio::awaitable<size_t> receive(asio::mutable_buffer buffer, asio::error_code& ec) override;
+        asio::awaitable<void> write(std::span<const asio::const_buffer> buffers, asio::error_code& ec) override;
+        void close() override;
+
+    private:
+        struct Queue
+        {
+            explicit Queue(const asio::any_io_executor& executor);
+
+            std::vector<net::byte> bytes;
+            size_t head = 0;
+
+            // Never expires; cancelled to wake the receiver.
+            asio::steady_timer wake;
+        };
+
+        struct Connection
+        {
+            explicit Connection(const asio::any_io_executor& executor);
+
+            Queue toServer;
+            Queue toClient;
+            bool closed = false;
+        };
+
+        LoopbackTransport(std::shared_ptr<Connection> connection, bool serverEnd, asio::ip::address_v4 peer,
+                          asio::any_io_executor executor);
+
+        [[nodiscard]] Queue& incoming() const;
+        [[nodiscard]] Queue& outgoing() const;
+
+        std::shared_ptr<Connection> connection_;
+        bool serverEnd_;
+        asio::ip::address_v4 peer_;
+        asio::any_io_executor executor_;
+    };
+} // namespace worms_server
+
+#endif // LOOPBACK_TRANSPORT_HPP
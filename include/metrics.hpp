@@ -0,0 +1,189 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <asio.hpp>
+
+#include "framed_packet_reader.hpp"
+#include "packet_code.hpp"
+
+namespace worms_server
+{
+    enum class MetricCounter : uint8_t
+    {
+        ConnectionsAccepted,
+        ConnectionsRefused,
+        Logins,
+        LoginFailures,
+        ParseErrors,
+        BytesIn,
+        BytesOut,
+    };
+
+    inline constexpr size_t METRIC_COUNTERS = 7;
+
+    // Sharded like the counters, so a gauge that goes up on one thread and down on another still sums right.
+    enum class MetricGauge : uint8_t
+    {
+        Connections,
+    };
+
+    inline constexpr size_t METRIC_GAUGES = 1;
+
+    enum class MetricHistogram : uint8_t
+    {
+        // Packets a session's writer had queued each time it woke up.
+        OutboxDepth,
+        // Recipients of one broadcast.
+        BroadcastFanout,
+    };
+
+    inline constexpr size_t METRIC_HISTOGRAMS = 2;
+
+    // Every code either side sends, in the order their per-code counters are exported.
+    inline constexpr std::array<std::pair<PacketCode, std::string_view>, 22> METERED_CODES{{
+        {PacketCode::ListRooms, "ListRooms"},
+        {PacketCode::ListItem, "ListItem"},
+        {PacketCode::ListEnd, "ListEnd"},
+        {PacketCode::ListUsers, "ListUsers"},
+        {PacketCode::ListGames, "ListGames"},
+        {PacketCode::Login, "Login"},
+        {PacketCode::LoginReply, "LoginReply"},
+        {PacketCode::CreateRoom, "CreateRoom"},
+        {PacketCode::CreateRoomReply, "CreateRoomReply"},
+        {PacketCode::Join, "Join"},
+        {PacketCode::JoinReply, "JoinReply"},
+        {PacketCode::Leave, "Leave"},
+        {PacketCode::LeaveReply, "LeaveReply"},
+        {PacketCode::DisconnectUser, "DisconnectUser"},
+        {PacketCode::Close, "Close"},
+        {PacketCode::CloseReply, "CloseReply"},
+        {PacketCode::CreateGame, "CreateGame"},
+        {PacketCode::CreateGameReply, "CreateGameReply"},
+        {PacketCode::ChatRoom, "ChatRoom"},
+        {PacketCode::ChatRoomReply, "ChatRoomReply"},
+        {PacketCode::ConnectGame, "ConnectGame"},
+        {PacketCode::ConnectGameReply, "ConnectGameReply"},
+    }};
+
+    // Slot of every code in METERED_CODES, indexed by code value; codes outside it share the last slot.
+    inline constexpr size_t METERED_CODE_LIMIT = static_cast<size_t>(PacketCode::ConnectGameReply) + 1;
+    inline constexpr auto METERED_CODE_SLOTS = []
+    {
+        std::array<uint8_t, METERED_CODE_LIMIT> slots{};
+        slots.fill(static_cast<uint8_t>(METERED_CODES.size()));
+        for (size_t slot = 0; slot < METERED_CODES.size(); ++slot)
+        {
+            slots[static_cast<size_t>(METERED_CODES[slot].first)] = static_cast<uint8_t>(slot);
+        }
+        return slots;
+    }();
+
+    // Power-of-two buckets: bucket b counts values below 2^b that did not fit bucket b - 1; the last
+    // one takes everything from 2^(HISTOGRAM_BUCKETS - 2) up.
+    inline constexpr size_t HISTOGRAM_BUCKETS = 18;
+
+    // One thread's share of every metric. Threads are spread over a fixed set of shards and only add to
+    // their own, so recording is one relaxed atomic add on a line no other thread is writing; a scrape
+    // sums the shards.
+    struct alignas(64) MetricShard
+    {
+        std::array<std::atomic<uint64_t>, METRIC_COUNTERS> counters{};
+        std::array<std::atomic<int64_t>, METRIC_GAUGES> gauges{};
+        std::array<std::atomic<uint64_t>, METERED_CODES.size() + 1> packetsIn{};
+        std::array<std::atomic<uint64_t>, METERED_CODES.size() + 1> packetsOut{};
+
+        struct Histogram
+        {
+            std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS> buckets{};
+            std::atomic<uint64_t> sum{0};
+        };
+
+        std::array<Histogram, METRIC_HISTOGRAMS> histograms{};
+    };
+
+    // Picks this thread's shard the first time it records.
+    [[nodiscard]] MetricShard& AssignMetricShard();
+
+    [[nodiscard]] inline MetricShard& LocalMetricShard()
+    {
+        thread_local MetricShard& shard = AssignMetricShard();
+        return shard;
+    }
+
+    inline void CountMetric(const MetricCounter counter, const uint64_t amount = 1)
+    {
+        LocalMetricShard().counters[static_cast<size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    inline void AdjustMetric(const MetricGauge gauge, const int64_t delta)
+    {
+        LocalMetricShard().gauges[static_cast<size_t>(gauge)].fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    inline void ObserveMetric(const MetricHistogram histogram, const uint64_t value)
+    {
+        auto& [buckets, sum] = LocalMetricShard().histograms[static_cast<size_t>(histogram)];
+        const size_t bucket = std::min<size_t>(std::bit_width(value), HISTOGRAM_BUCKETS - 1);
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    inline void CountPacketIn(const PacketCode code)
+    {
+        const auto value = static_cast<size_t>(code);
+        const size_t slot = value < METERED_CODE_LIMIT ? METERED_CODE_SLOTS[value] : METERED_CODES.size();
+        LocalMetricShard().packetsIn[slot].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Counts the bytes of an outbound buffer and each frame in it by code.
+    void CountPacketsOut(std::span<const net::byte> buffer);
+
+    // Aggregates the shards into the Prometheus text exposition format. Gauges that are cheaper to read
+    // at scrape time than to keep up to date, such as the lobby's table sizes, are registered as callbacks.
+    class Metrics
+    {
+    public:
+        [[nodiscard]] static Metrics& getInstance();
+
+        // Registers a gauge read on every scrape; call at startup.
+        void addGauge(std::string name, std::string help, std::function<double()> read);
+
+        // Registers a function that appends its own families to every scrape; call at startup.
+        void addCollector(std::function<void(std::string&)> append);
+
+        [[nodiscard]] std::string render() const;
+
+    private:
+        struct CallbackGauge
+        {
+            std::string name;
+            std::string help;
+            std::function<double()> read;
+        };
+
+        Metrics() = default;
+
+        mutable std::mutex gaugesMutex_;
+        std::vector<CallbackGauge> gauges_;
+        std::vector<std::function<void(std::string&)>> collectors_;
+    };
+
+    // Answers GET /metrics on 127.0.0.1:port until the io_context stops, and GET /trace with the span
+    // tracer's Chrome trace JSON while tracing is on.
+    asio::awaitable<void> ServeMetrics(uint16_t port);
+} // namespace worms_server
+
+#endif // METRICS_HPP
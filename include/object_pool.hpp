@@ -0,0 +1,155 @@
+#ifndef OBJECT_POOL_HPP
+#define OBJECT_POOL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+
+#include "moodycamel/concurrentqueue.h"
+
+namespace worms_server
+{
+    struct SlabPoolStats
+    {
+        size_t capacity = 0;
+        size_t inUse = 0;
+        uint64_t fallbacks = 0;
+    };
+
+    // Preallocated slab of fixed-size blocks for one object type, meant for std::allocate_shared so the
+    // object and its control block come out of the slab together. Without a reserve() call, or once the
+    // slab is exhausted, allocations fall through to the global heap.
+    template <typename T>
+    class SlabPool
+    {
+    public:
+        // Room for the shared_ptr control block that allocate_shared places in front of the object.
+        static constexpr size_t CONTROL_BLOCK_SLACK = 64;
+        static constexpr size_t BLOCK_ALIGNMENT = alignof(std::max_align_t) > alignof(T)
+                                                      ? alignof(std::max_align_t)
+                                                      : alignof(T);
+        static constexpr size_t BLOCK_SIZE =
+            (sizeof(T) + CONTROL_BLOCK_SLACK + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+
+        // Must run before the first allocation, typically at server startup.
+        static void reserve(const size_t count)
+        {
+            auto& pool = instance();
+            if (pool.begin_ != nullptr || count == 0)
+            {
+                return;
+            }
+
+            const size_t bytes = count * BLOCK_SIZE;
+            pool.begin_ = static_cast<std::byte*>(::operator new(bytes, std::align_val_t{BLOCK_ALIGNMENT}));
+            pool.end_ = pool.begin_ + bytes;
+            pool.capacity_ = count;
+
+            // Fault the pages in now so RSS reaches its plateau at startup instead of under load.
+            std::memset(pool.begin_, 0, bytes);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                pool.free_.enqueue(pool.begin_ + i * BLOCK_SIZE);
+            }
+        }
+
+        [[nodiscard]] static void* allocate(const size_t bytes, const size_t alignment)
+        {
+            auto& pool = instance();
+            if (bytes <= BLOCK_SIZE && alignment <= BLOCK_ALIGNMENT)
+            {
+                if (std::byte* block = nullptr; pool.free_.try_dequeue(block))
+                {
+                    pool.inUse_.fetch_add(1, std::memory_order_relaxed);
+                    return block;
+                }
+            }
+
+            if (pool.capacity_ != 0)
+            {
+                pool.fallbacks_.fetch_add(1, std::memory_order_relaxed);
+            }
+            return ::operator new(bytes, std::align_val_t{alignment});
+        }
+
+        static void deallocate(void* pointer, const size_t alignment) noexcept
+        {
+            auto& pool = instance();
+            if (auto* block = static_cast<std::byte*>(pointer); block >= pool.begin_ && block < pool.end_)
+            {
+                pool.inUse_.fetch_sub(1, std::memory_order_relaxed);
+                pool.free_.enqueue(block);
+                return;
+            }
+
+            ::operator delete(pointer, std::align_val_t{alignment});
+        }
+
+        [[nodiscard]] static SlabPoolStats stats()
+        {
+            const auto& pool = instance();
+            return {.capacity = pool.capacity_,
+                    .inUse = pool.inUse_.load(std::memory_order_relaxed),
+                    .fallbacks = pool.fallbacks_.load(std::memory_order_relaxed)};
+        }
+
+    private:
+        static SlabPool& instance()
+        {
+            // Leaked on purpose: singletons destroyed after it, like SessionResume, still free pooled objects.
+            static SlabPool& pool = *new SlabPool;
+            return pool;
+        }
+
+        // The slab itself is never released: blocks may still be returned during static destruction.
+        std::byte* begin_ = nullptr;
+        std::byte* end_ = nullptr;
+        size_t capacity_ = 0;
+        std::atomic<size_t> inUse_{0};
+        std::atomic<uint64_t> fallbacks_{0};
+        moodycamel::ConcurrentQueue<std::byte*> free_;
+    };
+
+    // Allocator for std::allocate_shared<Pooled>; every rebound type draws from SlabPool<Pooled>.
+    template <typename Pooled, typename T = Pooled>
+    class SlabAllocator
+    {
+    public:
+        using value_type = T;
+
+        template <typename U>
+        struct rebind
+        {
+            using other = SlabAllocator<Pooled, U>;
+        };
+
+        SlabAllocator() noexcept = default;
+
+        template <typename U>
+        SlabAllocator(const SlabAllocator<Pooled, U>&) noexcept // NOLINT(*-explicit-constructor)
+        {
+        }
+
+        [[nodiscard]] T* allocate(const size_t count)
+        {
+            return static_cast<T*>(SlabPool<Pooled>::allocate(sizeof(T) * count, alignof(T)));
+        }
+
+        void deallocate(T* pointer, size_t) noexcept
+        {
+            SlabPool<Pooled>::deallocate(pointer, alignof(T));
+        }
+
+        template <typename U>
+        bool operator==(const SlabAllocator<Pooled, U>&) const noexcept
+        {
+            return true;
+        }
+    };
+} // namespace worms_server
+
+#endif // OBJECT_POOL_HPP
@@ -0,0 +1,213 @@
+#ifndef PACKET_BUFFER_HPP
+#define PACKET_BUFFER_HPP
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "packet_buffers.hpp"
+
+namespace worms_server
+{
+    class PacketBufferPtr;
+
+    struct PacketPoolStats
+    {
+        uint64_t pooled = 0;
+        uint64_t heap = 0;
+    };
+
+    // Immutable outbound wire bytes, with the reference count in the same allocation as the payload.
+    // Buffers up to 1000 payload bytes come from per-thread size-classed caches; a buffer released on
+    // another thread is handed back to the cache of the thread that allocated it.
+    class PacketBuffer
+    {
+    public:
+        // Allocates a buffer of exactly size bytes and lets fill write the payload before it is shared.
+        template <typename Fill>
+        [[nodiscard]] static PacketBufferPtr create(size_t size, Fill&& fill);
+
+        [[nodiscard]] const net::byte* data() const
+        {
+            return reinterpret_cast<const net::byte*>(this + 1);
+        }
+
+        [[nodiscard]] size_t size() const
+        {
+            return size_;
+        }
+
+        [[nodiscard]] std::span<const net::byte> bytes() const
+        {
+            return {data(), size_};
+        }
+
+        PacketBuffer(const PacketBuffer&) = delete;
+        PacketBuffer& operator=(const PacketBuffer&) = delete;
+
+    private:
+        friend class PacketBufferPtr;
+
+        PacketBuffer(uint32_t size, uint32_t sizeClass, void* owner);
+
+        [[nodiscard]] static PacketBufferPtr allocate(size_t size);
+
+        [[nodiscard]] std::span<net::byte> writable()
+        {
+            return {reinterpret_cast<net::byte*>(this + 1), size_};
+        }
+
+        void retain()
+        {
+            refs_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void release();
+
+        std::atomic<uint32_t> refs_{1};
+        uint32_t size_;
+        uint32_t sizeClass_;
+        void* owner_;
+    };
+
+    // Intrusive shared handle to a PacketBuffer.
+    class PacketBufferPtr
+    {
+    public:
+        PacketBufferPtr() = default;
+
+        PacketBufferPtr(std::nullptr_t) // NOLINT(*-explicit-constructor)
+        {
+        }
+
+        PacketBufferPtr(const PacketBufferPtr& other) : buffer_(other.buffer_)
+        {
+            if (buffer_ != nullptr)
+            {
+                buffer_->retain();
+            }
+        }
+
+        PacketBufferPtr(PacketBufferPtr&& other) noexcept : buffer_(std::exchange(other.buffer_, nullptr))
+        {
+        }
+
+        PacketBufferPtr& operator=(PacketBufferPtr other) noexcept
+        {
+            std::swap(buffer_, other.buffer_);
+            return *this;
+        }
+
+        ~PacketBufferPtr()
+        {
+            if (buffer_ != nullptr)
+            {
+                buffer_->release();
+            }
+        }
+
+        [[nodiscard]] const PacketBuffer* get() const
+        {
+            return buffer_;
+        }
+
+        const PacketBuffer* operator->() const
+        {
+            return buffer_;
+        }
+
+        const PacketBuffer& operator*() const
+        {
+            return *buffer_;
+        }
+
+        explicit operator bool() const
+        {
+            return buffer_ != nullptr;
+        }
+
+        bool operator==(const PacketBufferPtr& other) const = default;
+
+    private:
+        friend class PacketBuffer;
+
+        explicit PacketBufferPtr(PacketBuffer* buffer) : buffer_(buffer)
+        {
+        }
+
+        PacketBuffer* buffer_ = nullptr;
+    };
+
+    template <typename Fill>
+    PacketBufferPtr PacketBuffer::create(const size_t size, Fill&& fill)
+    {
+        PacketBufferPtr buffer = allocate(size);
+        std::forward<Fill>(fill)(buffer.buffer_->writable());
+        return buffer;
+    }
+
+    // Sums the pool counters of every thread cache.
+    [[nodiscard]] PacketPoolStats GetPacketPoolStats();
+
+    // Joins packets into one buffer in order; a single packet is returned as is and no packets yield nullptr.
+    [[nodiscard]] PacketBufferPtr JoinPackets(std::span<const PacketBufferPtr> packets);
+
+    // Little-endian writer over a fixed span, mirroring the net::packet_writer calls the codec uses.
+    class PacketWriter
+    {
+    public:
+        explicit PacketWriter(const std::span<net::byte> target) : target_(target)
+        {
+        }
+
+        template <typename T>
+            requires std::is_integral_v<T>
+        void write_le(const T value)
+        {
+            T le = value;
+            if constexpr (std::endian::native != std::endian::little && sizeof(T) > 1)
+            {
+                le = std::byteswap(value);
+            }
+            write_bytes(std::as_bytes(std::span{&le, 1}));
+        }
+
+        void write_bytes(const std::span<const net::byte> bytes)
+        {
+            if (bytes.size() > target_.size() - position_)
+            {
+                throw std::length_error("Packet writer overflow");
+            }
+            std::memcpy(target_.data() + position_, bytes.data(), bytes.size());
+            position_ += bytes.size();
+        }
+
+        void write(const net::byte value)
+        {
+            write_bytes(std::span{&value, 1});
+        }
+
+        template <size_t N>
+        void write(const std::array<net::byte, N>& bytes)
+        {
+            write_bytes(bytes);
+        }
+
+        [[nodiscard]] size_t position() const
+        {
+            return position_;
+        }
+
+    private:
+        std::span<net::byte> target_;
+        size_t position_ = 0;
+    };
+} // namespace worms_server
+
+#endif // PACKET_BUFFER_HPP
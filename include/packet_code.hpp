@@ -57,6 +57,36 @@ namespace worms_server
             return false;
         }
     }
+
+    // Codes a client receives: replies, list entries, and relayed chat and presence.
+    static constexpr bool ServerPacketCodeExists(const uint32_t code)
+    {
+        switch (code)
+        {
+        case static_cast<uint32_t>(PacketCode::ListItem):
+        case static_cast<uint32_t>(PacketCode::ListEnd):
+        case static_cast<uint32_t>(PacketCode::Login):
+        case static_cast<uint32_t>(PacketCode::LoginReply):
+        case static_cast<uint32_t>(PacketCode::CreateRoom):
+        case static_cast<uint32_t>(PacketCode::CreateRoomReply):
+        case static_cast<uint32_t>(PacketCode::Join):
+        case static_cast<uint32_t>(PacketCode::JoinReply):
+        case static_cast<uint32_t>(PacketCode::Leave):
+        case static_cast<uint32_t>(PacketCode::LeaveReply):
+        case static_cast<uint32_t>(PacketCode::DisconnectUser):
+        case static_cast<uint32_t>(PacketCode::Close):
+        case static_cast<uint32_t>(PacketCode::CloseReply):
+        case static_cast<uint32_t>(PacketCode::CreateGame):
+        case static_cast<uint32_t>(PacketCode::CreateGameReply):
+        case static_cast<uint32_t>(PacketCode::ChatRoom):
+        case static_cast<uint32_t>(PacketCode::ChatRoomReply):
+        case static_cast<uint32_t>(PacketCode::ConnectGameReply):
+            return true;
+
+        default:
+            return false;
+        }
+    }
 } // namespace worms_server
 
 #endif // PACKET_CODE_HPP
@@ -8,6 +8,7 @@
 #include <memory>
 #include "asio.hpp"
 
+#include "server_clock.hpp"
 #include "worms_packet.hpp"
 
 using asio::awaitable;
@@ -24,7 +25,18 @@ namespace worms_server
     class PacketHandler final
     {
     public:
+        // Dispatches packet to its handler and times it; received is when the read that completed it returned.
         static awaitable<bool> handlePacket(
+            std::shared_ptr<User> clientUser,
+            std::shared_ptr<Database> database,
+            WormsPacketPtr packet,
+            ServerClock::time_point received);
+
+        // Answers a packet the server declined to handle with the failure reply the client expects for its code.
+        static void rejectPacket(const std::shared_ptr<User>& clientUser, PacketCode code);
+
+    private:
+        static awaitable<bool> dispatch(
             std::shared_ptr<User> clientUser,
             std::shared_ptr<Database> database,
             WormsPacketPtr packet);
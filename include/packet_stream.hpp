@@ -0,0 +1,48 @@
+#ifndef PACKET_STREAM_HPP
+#define PACKET_STREAM_HPP
+
+#include <span>
+#include <string>
+#include <vector>
+
+#include <asio/buffer.hpp>
+
+#include "worms_packet.hpp"
+
+namespace worms_server
+{
+    // Receive buffer the socket reads into directly, split into framed WormsPackets in place.
+    // Readable bytes live in [head_, tail_); the socket fills the space after tail_. The bytes of the
+    // packet returned last stay untouched until the next tryReadPacket() or prepare() call, so handlers
+    // may keep views into currentFrame() while they run.
+    class PacketStream
+    {
+    public:
+        static constexpr size_t CAPACITY = 4096;
+
+        explicit PacketStream(PacketSource source = PacketSource::Client);
+
+        // Writable space at the tail. Compacts first if less than a full receive's worth is left.
+        [[nodiscard]] asio::mutable_buffer prepare();
+        void commit(size_t bytes);
+
+        [[nodiscard]] net::deserialization_result<WormsPacketPtr, std::string> tryReadPacket();
+
+        [[nodiscard]] std::span<const net::byte> currentFrame() const;
+        [[nodiscard]] size_t buffered() const;
+
+    private:
+        static constexpr size_t MIN_RECEIVE_SPACE = 1024;
+
+        void releaseFrame();
+        void compact();
+
+        PacketSource source_;
+        std::vector<net::byte> storage_;
+        size_t head_ = 0;
+        size_t tail_ = 0;
+        size_t frameLength_ = 0;
+    };
+} // namespace worms_server
+
+#endif // PACKET_STREAM_HPP
@@ -0,0 +1,59 @@
+#ifndef PRESENCE_COALESCER_HPP
+#define PRESENCE_COALESCER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include <asio.hpp>
+
+#include "packet_buffer.hpp"
+#include "presence_key.hpp"
+
+namespace worms_server
+{
+    // Fans lobby-wide presence packets (Login, DisconnectUser, CreateRoom, Join, Leave, Close,
+    // CreateGame) out to every logged-in user. While a tick is running, packets published during the
+    // tick are joined into one buffer that most recipients share and get in one enqueue, in publish
+    // order, so a burst of M events costs N enqueues instead of M x N. Users excluded from an event or
+    // logged in mid-tick get pieces of the tick that are joined once and shared, and the writer sends
+    // them in one vectored write. Without a tick, packets go out immediately.
+    class PresenceCoalescer
+    {
+    public:
+        [[nodiscard]] static PresenceCoalescer& getInstance();
+
+        // Coalesces until the executor's io_context stops.
+        asio::awaitable<void> run(std::chrono::milliseconds tick);
+
+        // Sends packet to every logged-in user except excludedUserId. The key reaches the session outboxes
+        // only when the packet is sent on its own; a tick's joined buffer is never compacted.
+        void publish(PacketBufferPtr packet, uint32_t excludedUserId = 0, PresenceKey key = {});
+
+        // Called before a new user is added, so the events already waiting in this tick skip them.
+        void noteLogin(uint32_t userId);
+
+    private:
+        struct Event
+        {
+            PacketBufferPtr packet;
+            uint32_t excludedUserId;
+        };
+
+        struct LateJoiner
+        {
+            uint32_t userId;
+            size_t firstEvent;
+        };
+
+        void flush();
+
+        std::atomic<bool> enabled_{false};
+        std::mutex mutex_;
+        std::vector<Event> pending_;
+        std::vector<LateJoiner> lateJoiners_;
+    };
+} // namespace worms_server
+
+#endif // PRESENCE_COALESCER_HPP
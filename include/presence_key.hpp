@@ -0,0 +1,109 @@
+#ifndef PRESENCE_KEY_HPP
+#define PRESENCE_KEY_HPP
+
+#include <cstdint>
+
+namespace worms_server
+{
+    enum class PresenceKind : uint8_t
+    {
+        None,
+        User,
+        Room,
+        Game,
+        Member,
+    };
+
+    enum class PresenceChange : uint8_t
+    {
+        Open,
+        // Re-announces state that is already open, e.g. a Join sent again when a user joins a game.
+        Refresh,
+        Close,
+    };
+
+    // Names the piece of lobby state a presence packet opens (Login, CreateRoom, CreateGame, Join) or
+    // closes (DisconnectUser, Close, Leave), so a session outbox can drop pairs that cancel out before
+    // either is written. Packets without a key are never dropped. A relayed chat packet has kind None but
+    // names its sender and room, so a pair it depends on is kept.
+    struct PresenceKey
+    {
+        PresenceKind kind = PresenceKind::None;
+        PresenceChange change = PresenceChange::Open;
+
+        // The user, room or game; for Member, the user or game that joined.
+        uint32_t subject = 0;
+
+        // For Member, the room or game that was joined.
+        uint32_t scope = 0;
+
+        static constexpr PresenceKey loggedIn(const uint32_t userId)
+        {
+            return {PresenceKind::User, PresenceChange::Open, userId, 0};
+        }
+
+        static constexpr PresenceKey disconnected(const uint32_t userId)
+        {
+            return {PresenceKind::User, PresenceChange::Close, userId, 0};
+        }
+
+        static constexpr PresenceKey roomCreated(const uint32_t roomId)
+        {
+            return {PresenceKind::Room, PresenceChange::Open, roomId, 0};
+        }
+
+        static constexpr PresenceKey roomClosed(const uint32_t roomId)
+        {
+            return {PresenceKind::Room, PresenceChange::Close, roomId, 0};
+        }
+
+        static constexpr PresenceKey gameCreated(const uint32_t gameId)
+        {
+            return {PresenceKind::Game, PresenceChange::Open, gameId, 0};
+        }
+
+        static constexpr PresenceKey gameClosed(const uint32_t gameId)
+        {
+            return {PresenceKind::Game, PresenceChange::Close, gameId, 0};
+        }
+
+        static constexpr PresenceKey joined(const uint32_t memberId, const uint32_t roomId)
+        {
+            return {PresenceKind::Member, PresenceChange::Open, memberId, roomId};
+        }
+
+        static constexpr PresenceKey rejoined(const uint32_t memberId, const uint32_t roomId)
+        {
+            return {PresenceKind::Member, PresenceChange::Refresh, memberId, roomId};
+        }
+
+        static constexpr PresenceKey left(const uint32_t memberId, const uint32_t roomId)
+        {
+            return {PresenceKind::Member, PresenceChange::Close, memberId, roomId};
+        }
+
+        static constexpr PresenceKey relayed(const uint32_t senderId, const uint32_t roomId)
+        {
+            return {PresenceKind::None, PresenceChange::Open, senderId, roomId};
+        }
+
+        [[nodiscard]] constexpr bool sameState(const PresenceKey& other) const
+        {
+            return kind == other.kind && subject == other.subject && scope == other.scope;
+        }
+
+        // Whether this is a Join or Leave involving the given user, room or game.
+        [[nodiscard]] constexpr bool mentions(const uint32_t id) const
+        {
+            return kind == PresenceKind::Member && (subject == id || scope == id);
+        }
+
+        // Whether this is a relayed packet from the given user or in the given room.
+        [[nodiscard]] constexpr bool dependsOn(const uint32_t id) const
+        {
+            return kind == PresenceKind::None && id != 0 && (subject == id || scope == id);
+        }
+    };
+} // namespace worms_server
+
+#endif // PRESENCE_KEY_HPP
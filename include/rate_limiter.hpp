@@ -0,0 +1,82 @@
+#ifndef RATE_LIMITER_HPP
+#define RATE_LIMITER_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "packet_code.hpp"
+#include "server_clock.hpp"
+
+namespace worms_server
+{
+    enum class RateLimitAction : uint8_t
+    {
+        // Answer with the failure reply the client already understands.
+        Reply,
+        // Hold the packet, and with it the session's reader, until the bucket has a token again.
+        Delay,
+        Disconnect,
+    };
+
+    struct RateLimitRule
+    {
+        // Zero leaves the code unlimited.
+        uint32_t perSecond = 0;
+        uint32_t burst = 1;
+        RateLimitAction action = RateLimitAction::Reply;
+    };
+
+    // The codes a logged-in client may send; a rule set holds one rule per code, in this order.
+    inline constexpr std::array RATE_LIMITED_CODES{
+        PacketCode::ListRooms, PacketCode::ListUsers,  PacketCode::ListGames, PacketCode::CreateRoom,
+        PacketCode::Join,      PacketCode::Leave,      PacketCode::Close,     PacketCode::CreateGame,
+        PacketCode::ChatRoom,  PacketCode::ConnectGame,
+    };
+
+    using RateLimitRules = std::array<RateLimitRule, RATE_LIMITED_CODES.size()>;
+
+    struct RateLimitCounts
+    {
+        uint64_t replied = 0;
+        uint64_t delayed = 0;
+        uint64_t disconnected = 0;
+    };
+
+    using RateLimitStats = std::array<RateLimitCounts, RATE_LIMITED_CODES.size()>;
+
+    [[nodiscard]] RateLimitRules DefaultRateLimitRules();
+
+    // Applies "<code>=<per-second>/<burst>[:reply|delay|disconnect]" or "<code>=off", where code is a
+    // PacketCode name such as ChatRoom or its number. Returns false and leaves rules alone if malformed.
+    [[nodiscard]] bool ParseRateLimitRule(std::string_view spec, RateLimitRules& rules);
+
+    // Sums the actions taken so far, per code.
+    [[nodiscard]] RateLimitStats GetRateLimitStats();
+
+    struct RateLimitVerdict
+    {
+        RateLimitAction action;
+        // For Delay, how long to hold the packet.
+        std::chrono::nanoseconds wait;
+    };
+
+    // One token bucket per rate-limited code, kept as a GCRA theoretical arrival time, so admitting a
+    // packet is a table lookup and a compare. Owned by a session and only touched by its reader.
+    class RateLimiter
+    {
+    public:
+        // Installs the rules for every session; call once at startup.
+        static void setRules(const RateLimitRules& rules);
+
+        // Returns nothing if the packet may be handled now, otherwise the action to take.
+        [[nodiscard]] std::optional<RateLimitVerdict> admit(PacketCode code, ServerClock::time_point now);
+
+    private:
+        std::array<int64_t, RATE_LIMITED_CODES.size()> arrivals_{};
+    };
+} // namespace worms_server
+
+#endif // RATE_LIMITER_HPP
@@ -0,0 +1,74 @@
+#ifndef RECYCLING_ALLOCATOR_HPP
+#define RECYCLING_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include <asio/bind_allocator.hpp>
+
+namespace worms_server
+{
+    struct RecyclingAllocatorStats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t bytesRecycled = 0;
+
+        [[nodiscard]] double hitRate() const
+        {
+            const auto total = hits + misses;
+            return total == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(total);
+        }
+    };
+
+    namespace detail
+    {
+        [[nodiscard]] void* RecyclingAllocate(size_t size, size_t alignment);
+        void RecyclingDeallocate(void* pointer, size_t size, size_t alignment) noexcept;
+    } // namespace detail
+
+    // Sums the counters of every thread cache, including the ones of threads that already exited.
+    [[nodiscard]] RecyclingAllocatorStats GetRecyclingAllocatorStats();
+
+    // Stateless allocator backed by per-thread, size-classed free lists. Used for asio operation
+    // storage and spawned coroutine state so the steady-state packet path never reaches malloc.
+    template <typename T>
+    class RecyclingAllocator
+    {
+    public:
+        using value_type = T;
+
+        RecyclingAllocator() noexcept = default;
+
+        template <typename U>
+        RecyclingAllocator(const RecyclingAllocator<U>&) noexcept // NOLINT(*-explicit-constructor)
+        {
+        }
+
+        [[nodiscard]] T* allocate(const size_t count)
+        {
+            return static_cast<T*>(detail::RecyclingAllocate(sizeof(T) * count, alignof(T)));
+        }
+
+        void deallocate(T* pointer, const size_t count) noexcept
+        {
+            detail::RecyclingDeallocate(pointer, sizeof(T) * count, alignof(T));
+        }
+
+        template <typename U>
+        bool operator==(const RecyclingAllocator<U>&) const noexcept
+        {
+            return true;
+        }
+    };
+
+    // Binds the recycling allocator to a completion token, e.g. Recycled(redirect_error(use_awaitable, ec)).
+    template <typename CompletionToken>
+    auto Recycled(CompletionToken&& token)
+    {
+        return asio::bind_allocator(RecyclingAllocator<void>(), std::forward<CompletionToken>(token));
+    }
+} // namespace worms_server
+
+#endif // RECYCLING_ALLOCATOR_HPP
@@ -8,6 +8,7 @@
 #include <string>
 #include <asio/ip/address_v4.hpp>
 
+#include "fixed_name.hpp"
 #include "session_info.hpp"
 #include "spdlog/spdlog.h"
 
@@ -25,7 +26,8 @@ namespace worms_server
 
         [[nodiscard]] uint32_t getId() const;
         [[nodiscard]] std::string_view getName() const;
-        [[nodiscard]] const SessionInfo& getSessionInfo() const;
+        [[nodiscard]] Nation getNation() const;
+        [[nodiscard]] SessionInfo getSessionInfo() const;
         [[nodiscard]] asio::ip::address_v4 getAddress() const;
 
         Room(const Room& other) = delete;
@@ -38,8 +40,8 @@ namespace worms_server
 
     private:
         uint32_t id_;
-        std::string name_;
-        SessionInfo sessionInfo_;
+        FixedName name_;
+        Nation nation_;
         asio::ip::address_v4 address_;
     };
 } // namespace worms_server
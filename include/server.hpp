@@ -6,6 +6,16 @@
 #define SERVER_HPP
 
 #include <asio.hpp>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <thread>
+
+#include "admission_control.hpp"
+#include "rate_limiter.hpp"
+#include "socket_options.hpp"
+#include "transport.hpp"
 
 using asio::awaitable;
 using asio::use_awaitable;
@@ -13,25 +23,102 @@ using namespace asio;
 
 namespace worms_server
 {
+    struct ServerOptions
+    {
+        uint16_t port = 17000;
+        size_t maxConnections = 10000;
+        size_t maxThreads = std::thread::hardware_concurrency();
+
+        // Connections that have not logged in yet, per source address and in total.
+        size_t maxPendingPerAddress = 4;
+        size_t maxPendingLogins = 256;
+
+        // Preallocate session and user slabs for maxConnections up front.
+        bool preallocate = false;
+
+        // Coalesce lobby presence broadcasts into one write per user per tick; zero sends them immediately.
+        std::chrono::milliseconds presenceTick{0};
+
+        // How long a disconnect waits for others to tear down with; zero batches only simultaneous ones.
+        // Until then the dropped user stays listed, keeps its name and is still a broadcast target.
+        std::chrono::milliseconds disconnectWindow{0};
+
+        // How long a dropped user stays in the lobby for a reconnect from the same address; zero disconnects at once.
+        std::chrono::milliseconds resumeGrace{0};
+
+        // Kernel-side dead peer detection for client sockets.
+        KeepaliveOptions keepalive;
+
+        // A client that leaves a write pending this long is treated as dead; zero disables the check.
+        std::chrono::seconds writeStallTimeout{20};
+
+        // Token bucket per packet code for every logged-in user.
+        RateLimitRules rateLimits = DefaultRateLimitRules();
+
+        // Record every session's traffic to this file for worms_replay; empty records nothing.
+        std::filesystem::path capturePath;
+
+        // Tee every client session to a candidate server at this address and compare its replies.
+        std::optional<ip::tcp::endpoint> shadowTarget;
+
+        // Log packets whose handling took longer than this from receive to the last reply queued; zero logs none.
+        std::chrono::milliseconds slowHandlerThreshold{100};
+
+        // Warn when an io thread or the whole event loop is held up this long; zero disables the watchdog.
+        std::chrono::milliseconds stallThreshold{500};
+
+        // Record lifecycle spans for one session in this many; zero traces nothing. The trace is served at
+        // /trace on the metrics port and written to worms_trace_<time>.json on SIGUSR1.
+        uint32_t traceSample = 0;
+
+        // Serve Prometheus metrics on 127.0.0.1 at this port; zero serves none.
+        uint16_t metricsPort = 0;
+    };
+
     class Server
     {
     public:
-        Server(uint16_t port, size_t maxConnections);
+        explicit Server(const ServerOptions& options);
 
         void run(size_t threadCount);
         void stop();
 
+        // Starts the background services without the TCP listener, for a caller that drives context()
+        // itself and brings its own connections, e.g. LoopbackTransports under virtual time.
+        void start();
+
+        // Admits a connection that did not come through the listener. Returns false if it was refused.
+        bool connect(std::unique_ptr<Transport> transport);
+
+        [[nodiscard]] io_context& context();
+
         static std::atomic_uint32_t connectionCount;
 
     private:
         awaitable<void> listener();
+        awaitable<void> waitForCapacity();
+
+        // Takes an unauthenticated slot for a new connection, or nothing if it has to be refused.
+        [[nodiscard]] std::optional<AdmissionControl::Ticket> admit(const ip::address& address);
+        void startSession(std::unique_ptr<Transport> transport, AdmissionControl::Ticket ticket);
+
+        // Writes the span trace to a file each time the trace signal arrives.
+        void awaitTraceSignal();
 
         uint16_t port_;
         size_t maxConnections_;
+        std::chrono::milliseconds presenceTick_;
+        uint16_t metricsPort_;
+        std::chrono::milliseconds stallThreshold_;
+        KeepaliveOptions keepalive_;
+
+        // Declared before the io_context so it outlives the sessions holding its tickets.
+        AdmissionControl admission_;
 
         thread_pool threadPool_;
         io_context ioContext_;
         signal_set signals_;
+        signal_set traceSignals_;
         bool running_;
     };
 } // namespace worms_server
@@ -0,0 +1,74 @@
+#ifndef SERVER_CLOCK_HPP
+#define SERVER_CLOCK_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#include <asio/basic_waitable_timer.hpp>
+#include <asio/io_context.hpp>
+#include <asio/wait_traits.hpp>
+
+namespace worms_server
+{
+    // The clock behind every server timer and timeout. It follows std::chrono::steady_clock until virtual
+    // time is switched on; from then on it only moves when advanced, so a lobby driven from one thread
+    // fires its timers in the same order on every run and skips idle minutes at once.
+    struct ServerClock
+    {
+        using duration = std::chrono::steady_clock::duration;
+        using rep = duration::rep;
+        using period = duration::period;
+        using time_point = std::chrono::time_point<ServerClock>;
+        static constexpr bool is_steady = true;
+
+        [[nodiscard]] static time_point now() noexcept
+        {
+            if (!virtual_.load(std::memory_order_relaxed)) [[likely]]
+            {
+                return time_point(std::chrono::steady_clock::now().time_since_epoch());
+            }
+            return time_point(duration(virtualNow_.load(std::memory_order_acquire)));
+        }
+
+        // Freezes the clock at its current reading. Call before any timer is armed.
+        static void useVirtualTime();
+        static void advance(duration step);
+
+        [[nodiscard]] static bool isVirtual()
+        {
+            return virtual_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        static std::atomic<bool> virtual_;
+        static std::atomic<rep> virtualNow_;
+    };
+
+    // Under virtual time a deadline is never reached by waiting, so the io_context sleeps at most a
+    // millisecond at a time and the driver moves the clock instead.
+    struct ServerWaitTraits : asio::wait_traits<ServerClock>
+    {
+        static ServerClock::duration to_wait_duration(const ServerClock::duration& duration)
+        {
+            return ServerClock::isVirtual() ? std::min<ServerClock::duration>(duration, MAX_VIRTUAL_WAIT) : duration;
+        }
+
+        static ServerClock::duration to_wait_duration(const ServerClock::time_point& time)
+        {
+            const auto duration = asio::wait_traits<ServerClock>::to_wait_duration(time);
+            return ServerClock::isVirtual() ? std::min<ServerClock::duration>(duration, MAX_VIRTUAL_WAIT) : duration;
+        }
+
+    private:
+        static constexpr auto MAX_VIRTUAL_WAIT = std::chrono::milliseconds(1);
+    };
+
+    using ServerTimer = asio::basic_waitable_timer<ServerClock, ServerWaitTraits>;
+
+    // Runs everything ready on context, then moves virtual time on by step, until span has passed.
+    // Returns the number of handlers run.
+    size_t AdvanceVirtualTime(asio::io_context& context, ServerClock::duration span, ServerClock::duration step);
+} // namespace worms_server
+
+#endif // SERVER_CLOCK_HPP
@@ -11,7 +11,7 @@
 
 #include "framed_packet_reader.hpp"
 #include "nation.hpp"
-#include "packet_buffers.hpp"
+#include "packet_buffer.hpp"
 
 namespace worms_server
 {
@@ -42,7 +42,7 @@ namespace worms_server
         SessionInfo(
             worms_server::Nation nation, SessionType type, SessionAccess access = SessionAccess::PublicAccess);
 
-        void writeTo(net::packet_writer& writer) const;
+        void writeTo(PacketWriter& writer) const;
 
         [[nodiscard]] static net::deserialization_result<SessionInfo, std::string> readFrom(
             net::packet_reader& reader);
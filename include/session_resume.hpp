@@ -0,0 +1,78 @@
+#ifndef SESSION_RESUME_HPP
+#define SESSION_RESUME_HPP
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include <asio.hpp>
+
+#include "session_info.hpp"
+
+namespace worms_server
+{
+    class User;
+    class UserSession;
+
+    struct SessionResumeStats
+    {
+        uint64_t suspended = 0;
+        uint64_t resumed = 0;
+    };
+
+    struct ResumedSession
+    {
+        std::shared_ptr<User> user;
+        // The ended session, holding what was broadcast to the user while it was suspended.
+        std::shared_ptr<UserSession> session;
+    };
+
+    // Keeps users whose connection dropped in the lobby, silently, for a short grace window. A login with
+    // the same name, from the same address and by the same client build and team within the window takes
+    // the suspended user over, so a network blip costs no DisconnectUser/Login broadcasts. Once the window
+    // runs out the user is torn down as usual.
+    class SessionResume
+    {
+    public:
+        [[nodiscard]] static SessionResume& getInstance();
+
+        // Zero disables suspending; set once at startup.
+        void setGrace(std::chrono::milliseconds grace);
+
+        // Suspends a user whose session ended, keeping the session so broadcasts still queue on it.
+        // Returns false if the user has to be disconnected now, because resuming is off or the user hosts
+        // a game that died with the connection.
+        bool suspend(const asio::any_io_executor& executor, std::shared_ptr<User> user,
+                     std::shared_ptr<UserSession> session, asio::ip::address_v4 address, const SessionInfo& client);
+
+        // Takes over a suspended user with this name, address and client info, if there is one.
+        [[nodiscard]] ResumedSession resume(std::string_view name, asio::ip::address_v4 address,
+                                            const SessionInfo& client);
+
+        [[nodiscard]] SessionResumeStats stats() const;
+
+    private:
+        struct Suspended
+        {
+            std::shared_ptr<User> user;
+            std::shared_ptr<UserSession> session;
+            asio::ip::address_v4 address;
+            SessionInfo client;
+            uint64_t generation;
+        };
+
+        asio::awaitable<void> expire(uint64_t generation);
+
+        std::chrono::milliseconds grace_{0};
+        std::mutex mutex_;
+        std::vector<Suspended> suspended_;
+        uint64_t nextGeneration_ = 0;
+        std::atomic<uint64_t> suspendedCount_{0};
+        std::atomic<uint64_t> resumedCount_{0};
+    };
+} // namespace worms_server
+
+#endif // SESSION_RESUME_HPP
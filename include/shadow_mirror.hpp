@@ -0,0 +1,217 @@
+#ifndef SHADOW_MIRROR_HPP
+#define SHADOW_MIRROR_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <asio.hpp>
+
+#include "id_translation.hpp"
+#include "packet_buffer.hpp"
+#include "packet_code.hpp"
+#include "packet_stream.hpp"
+#include "server_clock.hpp"
+#include "worms_packet.hpp"
+
+namespace worms_server
+{
+    // The requests the mirror times, each answered by exactly one reply code.
+    inline constexpr std::array MIRRORED_CODES{
+        PacketCode::Login,      PacketCode::ListRooms, PacketCode::ListUsers, PacketCode::ListGames,
+        PacketCode::CreateRoom, PacketCode::Join,      PacketCode::Leave,     PacketCode::Close,
+        PacketCode::CreateGame, PacketCode::ChatRoom,  PacketCode::ConnectGame,
+    };
+
+    struct ShadowLatency
+    {
+        uint64_t count = 0;
+        // Upper bounds of the power-of-two buckets the percentiles fall in.
+        std::chrono::microseconds p50{0};
+        std::chrono::microseconds p99{0};
+        std::chrono::microseconds max{0};
+    };
+
+    struct ShadowCodeStats
+    {
+        ShadowLatency production;
+        ShadowLatency candidate;
+    };
+
+    struct ShadowStats
+    {
+        uint64_t sessions = 0;
+        uint64_t connectFailures = 0;
+
+        // Reply pairs compared; an outcome mismatch differs in the error field, a byte mismatch anywhere.
+        // Replies that assign an id are compared on outcome only.
+        uint64_t compared = 0;
+        uint64_t outcomeMismatches = 0;
+        uint64_t byteMismatches = 0;
+
+        // Requests a server had not answered when the session ended.
+        uint64_t unanswered = 0;
+
+        // Sessions the candidate closed while the client was still connected to production.
+        uint64_t candidateDisconnects = 0;
+        std::array<ShadowCodeStats, MIRRORED_CODES.size()> codes{};
+    };
+
+    // Parses "<IPv4 address>:<port>". Returns false and leaves target alone if malformed.
+    [[nodiscard]] bool ParseShadowTarget(std::string_view spec, asio::ip::tcp::endpoint& target);
+
+    // The candidate side of one client session: its own connection to the candidate server, fed the
+    // client's frames with their ids translated and read for replies that are never delivered. Called from
+    // the session's reader and writer; everything else happens on its strand.
+    class ShadowSession final : public std::enable_shared_from_this<ShadowSession>
+    {
+    public:
+        ShadowSession(const asio::any_io_executor& executor, const asio::ip::tcp::endpoint& target);
+
+        // Connects to the candidate and starts forwarding; frames passed in before then are queued.
+        void start();
+
+        // A frame the client sent. The reply to it is timed from this call on both servers.
+        void inbound(std::span<const net::byte> frame, PacketCode code);
+
+        // A buffer the production server wrote to the client.
+        void outbound(const PacketBufferPtr& buffer);
+
+        // Ends the mirror once the candidate has answered what it was sent, or after a grace period.
+        void close();
+
+    private:
+        struct Pending
+        {
+            PacketCode code;
+            ServerClock::time_point at;
+        };
+
+        struct Reply
+        {
+            WormsPacketPtr packet;
+            std::vector<net::byte> bytes;
+        };
+
+        struct Outgoing
+        {
+            std::vector<net::byte> bytes;
+            PacketCode code;
+        };
+
+        // One server's output as seen by this session.
+        struct Side
+        {
+            PacketStream stream{PacketSource::Server};
+            std::deque<Pending> pending;
+            std::deque<Reply> replies;
+            bool candidate = false;
+        };
+
+        asio::awaitable<void> run();
+        asio::awaitable<void> reader();
+
+        // Whether the candidate still owes a reply that assigns an id to a request already sent to it. Later
+        // frames may name that id, so they wait for it.
+        [[nodiscard]] bool awaitingId() const;
+
+        // The frame as the candidate has to see it: production ids translated and a CreateGame address
+        // replaced by this connection's, which is where the candidate sees the client.
+        [[nodiscard]] std::vector<net::byte> translate(const Outgoing& frame) const;
+
+        // Matches the frames buffered in side's stream to its pending requests. Returns false on bad data.
+        bool drain(Side& side, ServerClock::time_point at);
+        void compareReplies();
+        void finish();
+
+        asio::strand<asio::any_io_executor> strand_;
+        asio::ip::tcp::endpoint target_;
+        asio::ip::tcp::socket socket_;
+        ServerTimer wake_;
+
+        std::deque<Outgoing> outgoing_;
+
+        // Requests at the back of candidate_.pending that are still in outgoing_.
+        size_t unsent_ = 0;
+        Side production_;
+        Side candidate_;
+        bool connected_ = false;
+        bool closing_ = false;
+        bool finished_ = false;
+    };
+
+    // Tees every client session to a candidate server so a new build can be judged on live traffic
+    // without a client ever seeing its output. For each request both servers answer, the mirror records
+    // how long each took to put the reply on the wire and compares the two replies. Broadcasts are not
+    // compared: their order depends on how each server interleaves sessions. The two lobbies hand out
+    // different ids, so ids in client frames are translated through the paired id-assigning replies,
+    // and those replies are compared on outcome only.
+    //
+    // Every candidate session comes from this server's address, so the candidate has to be started with
+    // --max-pending-per-ip as high as --max-pending-logins, or it refuses logins production accepts.
+    class ShadowMirror
+    {
+    public:
+        [[nodiscard]] static ShadowMirror& getInstance();
+
+        [[nodiscard]] static bool enabled()
+        {
+            return enabled_.load(std::memory_order_relaxed);
+        }
+
+        // Mirrors every session started from now on to target.
+        void setTarget(const asio::ip::tcp::endpoint& target);
+
+        // Starts the candidate side of a new client session, or returns nothing if mirroring is off.
+        [[nodiscard]] std::shared_ptr<ShadowSession> open(const asio::any_io_executor& executor);
+
+        // Logs a report every interval until the io_context stops.
+        asio::awaitable<void> run(std::chrono::seconds interval);
+
+        void logReport() const;
+
+        [[nodiscard]] ShadowStats stats() const;
+
+    private:
+        friend class ShadowSession;
+
+        static constexpr size_t LATENCY_BUCKETS = 25;
+
+        // Bucket b counts latencies of fewer than 2^b microseconds that did not fit bucket b - 1.
+        struct Histogram
+        {
+            std::array<std::atomic<uint64_t>, LATENCY_BUCKETS> buckets{};
+            std::atomic<int64_t> maxMicroseconds{0};
+        };
+
+        ShadowMirror() = default;
+
+        void recordLatency(PacketCode code, bool candidate, ServerClock::duration latency);
+
+        // Production's user, room and game ids mapped to the candidate's.
+        IdTranslation ids_;
+        [[nodiscard]] static ShadowLatency summarize(const Histogram& histogram);
+
+        static std::atomic<bool> enabled_;
+
+        asio::ip::tcp::endpoint target_;
+        std::array<std::array<Histogram, 2>, MIRRORED_CODES.size()> latencies_{};
+
+        std::atomic<uint64_t> sessions_{0};
+        std::atomic<uint64_t> connectFailures_{0};
+        std::atomic<uint64_t> compared_{0};
+        std::atomic<uint64_t> outcomeMismatches_{0};
+        std::atomic<uint64_t> byteMismatches_{0};
+        std::atomic<uint64_t> unanswered_{0};
+        std::atomic<uint64_t> candidateDisconnects_{0};
+    };
+} // namespace worms_server
+
+#endif // SHADOW_MIRROR_HPP
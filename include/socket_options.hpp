@@ -0,0 +1,31 @@
+#ifndef SOCKET_OPTIONS_HPP
+#define SOCKET_OPTIONS_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+#include <asio.hpp>
+
+namespace worms_server
+{
+    // TCP liveness settings for accepted sockets. A peer that stops answering keepalive probes, or leaves
+    // sent data unacknowledged for userTimeout, is reset by the kernel within a minute rather than after
+    // the two hour OS default. Zero idle leaves keepalive timing to the OS; zero userTimeout leaves it unset.
+    struct KeepaliveOptions
+    {
+        std::chrono::seconds idle{30};
+        std::chrono::seconds interval{5};
+        uint32_t probes = 3;
+        std::chrono::milliseconds userTimeout{20000};
+    };
+
+    // Turns keepalive on and applies whatever of the settings the platform supports; a setting the
+    // kernel refuses is logged and skipped.
+    void ApplyKeepalive(asio::ip::tcp::socket& socket, const KeepaliveOptions& options);
+
+    // Parses <idle>/<interval>/<probes> in seconds, or "os" for the OS defaults, into options.
+    [[nodiscard]] bool ParseKeepalive(std::string_view spec, KeepaliveOptions& options);
+} // namespace worms_server
+
+#endif // SOCKET_OPTIONS_HPP
@@ -0,0 +1,159 @@
+#ifndef SPAN_TRACER_HPP
+#define SPAN_TRACER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <asio.hpp>
+
+#include "packet_code.hpp"
+#include "server_clock.hpp"
+
+namespace worms_server
+{
+    enum class TracePhase : uint8_t
+    {
+        // A span that began and ended on one thread.
+        Complete,
+        // The ends of a span that may cross a suspension, such as a write; paired by session.
+        AsyncBegin,
+        AsyncEnd,
+    };
+
+    struct TraceEvent
+    {
+        // Must outlive the tracer, e.g. a string literal.
+        const char* name = nullptr;
+        // Nanoseconds on ServerClock.
+        int64_t start = 0;
+        int64_t duration = 0;
+        uint32_t session = 0;
+        TracePhase phase = TracePhase::Complete;
+        // An optional argument shown with the span, e.g. a lock's wait time; argName null means none.
+        const char* argName = nullptr;
+        int64_t arg = 0;
+    };
+
+    // Open Complete spans on this thread. Database lock spans are only recorded inside one, so they nest
+    // under the packet or teardown that took the lock and cost an integer test everywhere else.
+    inline thread_local uint32_t traceDepth = 0;
+
+    [[nodiscard]] inline bool TraceActive()
+    {
+        return traceDepth != 0;
+    }
+
+    [[nodiscard]] inline int64_t TraceNow()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(ServerClock::now().time_since_epoch()).count();
+    }
+
+    // Records session lifecycle spans for a sample of sessions into per-thread rings that keep the latest
+    // events, so it can stay on in production with bounded memory. A snapshot of the rings is exported as
+    // Chrome trace JSON, which chrome://tracing and the Perfetto UI both open. Taking the snapshot only
+    // copies the rings; formatting and writing it happen on a thread of the tracer's own.
+    class SpanTracer
+    {
+    public:
+        [[nodiscard]] static SpanTracer& getInstance();
+
+        [[nodiscard]] static bool enabled()
+        {
+            return enabled_.load(std::memory_order_relaxed);
+        }
+
+        // Traces one session in every sampleEvery.
+        void start(uint32_t sampleEvery);
+
+        // The trace id for a new session, or zero if it is not sampled.
+        [[nodiscard]] uint32_t sampleSession();
+
+        void record(const TraceEvent& event);
+
+        // The JSON of a snapshot taken now, formatted on the export thread; resumes on the caller's executor.
+        [[nodiscard]] asio::awaitable<std::string> exportJson();
+
+        // Writes a snapshot taken now to path from the export thread and logs the outcome.
+        void writeJson(std::filesystem::path path);
+
+    private:
+        class Ring;
+
+        struct ThreadEvents
+        {
+            uint32_t thread;
+            std::vector<TraceEvent> events;
+        };
+
+        SpanTracer() = default;
+
+        Ring& localRing();
+
+        [[nodiscard]] std::vector<ThreadEvents> snapshot() const;
+        [[nodiscard]] static std::string format(const std::vector<ThreadEvents>& snapshot);
+
+        static std::atomic<bool> enabled_;
+
+        uint32_t sampleEvery_ = 1;
+        std::atomic<uint32_t> sessions_{0};
+
+        mutable std::mutex ringsMutex_;
+        std::vector<std::shared_ptr<Ring>> rings_;
+
+        // Created by start, so a server that never traces starts no thread.
+        std::optional<asio::thread_pool> exporter_;
+    };
+
+    // Records a Complete span for the rest of the scope when traced is set. Must not span a suspension.
+    class TraceScope
+    {
+    public:
+        TraceScope(const bool traced, const char* name, const uint32_t session = 0) :
+            name_(traced ? name : nullptr), session_(session)
+        {
+            if (name_ != nullptr)
+            {
+                start_ = TraceNow();
+                ++traceDepth;
+            }
+        }
+
+        ~TraceScope()
+        {
+            if (name_ != nullptr)
+            {
+                --traceDepth;
+                SpanTracer::getInstance().record(
+                    {.name = name_, .start = start_, .duration = TraceNow() - start_, .session = session_});
+            }
+        }
+
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+
+    private:
+        const char* name_;
+        uint32_t session_;
+        int64_t start_ = 0;
+    };
+
+    inline void TraceAsync(const uint32_t session, const char* name, const TracePhase phase)
+    {
+        if (session != 0)
+        {
+            SpanTracer::getInstance().record({.name = name, .start = TraceNow(), .session = session, .phase = phase});
+        }
+    }
+
+    // The span name for handling code, e.g. "ListUsers".
+    [[nodiscard]] const char* TracePacketName(PacketCode code);
+} // namespace worms_server
+
+#endif // SPAN_TRACER_HPP
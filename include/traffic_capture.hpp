@@ -0,0 +1,103 @@
+#ifndef TRAFFIC_CAPTURE_HPP
+#define TRAFFIC_CAPTURE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "framed_packet_reader.hpp"
+
+namespace worms_server
+{
+    enum class CaptureEvent : uint8_t
+    {
+        // Payload is the client's IPv4 address, four bytes in network order.
+        Open,
+        // A frame the client sent.
+        Inbound,
+        // One buffer the server wrote; joined presence buffers hold several frames back to back.
+        Outbound,
+        Close,
+    };
+
+    struct CaptureRecord
+    {
+        // Nanoseconds since the capture started, on ServerClock.
+        uint64_t time;
+        uint32_t session;
+        CaptureEvent event;
+        std::vector<net::byte> payload;
+    };
+
+    struct CaptureStats
+    {
+        uint64_t records = 0;
+        uint64_t bytes = 0;
+        uint64_t dropped = 0;
+    };
+
+    // Records session traffic to a file for worms_replay. Each thread appends to its own lock-free
+    // single-producer ring, so recording is a copy and two atomic stores; a background thread drains the
+    // rings to disk. A record that does not fit in a full ring is dropped and counted rather than waited for.
+    //
+    // File layout: the 8-byte magic "W2CAP\0\0\1", then per record time (u64), session (u32), event (u8),
+    // payload length (u32), all little-endian, and the payload. Records from different threads are not in
+    // time order; ReadCapture sorts them.
+    class TrafficCapture
+    {
+    public:
+        [[nodiscard]] static TrafficCapture& getInstance();
+
+        [[nodiscard]] static bool enabled()
+        {
+            return enabled_.load(std::memory_order_relaxed);
+        }
+
+        // Starts recording to path, replacing it. Returns false if the file cannot be opened.
+        bool start(const std::filesystem::path& path);
+
+        // Flushes what is left and closes the file.
+        void stop();
+
+        [[nodiscard]] uint32_t nextSessionId();
+
+        void record(uint32_t session, CaptureEvent event, std::span<const net::byte> payload);
+
+        [[nodiscard]] CaptureStats stats() const;
+
+    private:
+        class Ring;
+
+        TrafficCapture() = default;
+
+        Ring& localRing();
+        void flushLoop(const std::stop_token& stop);
+        void drain();
+
+        static std::atomic<bool> enabled_;
+
+        std::mutex ringsMutex_;
+        std::vector<std::shared_ptr<Ring>> rings_;
+
+        std::unique_ptr<std::FILE, int (*)(std::FILE*)> file_{nullptr, &std::fclose};
+        std::jthread flusher_;
+        int64_t startedAt_ = 0;
+
+        std::atomic<uint32_t> nextSessionId_{1};
+        std::atomic<uint64_t> records_{0};
+        std::atomic<uint64_t> bytes_{0};
+        std::atomic<uint64_t> dropped_{0};
+    };
+
+    // Loads a capture file and returns its records in time order, or nothing if it is not a capture.
+    [[nodiscard]] std::optional<std::vector<CaptureRecord>> ReadCapture(const std::filesystem::path& path);
+} // namespace worms_server
+
+#endif // TRAFFIC_CAPTURE_HPP
@@ -0,0 +1,53 @@
+#ifndef TRANSPORT_HPP
+#define TRANSPORT_HPP
+
+#include <cstddef>
+#include <span>
+
+#include <asio.hpp>
+
+namespace worms_server
+{
+    // Byte stream a session talks to its client over: a TCP socket in the server, or an in-process
+    // LoopbackTransport when a test drives the lobby itself.
+    class Transport
+    {
+    public:
+        virtual ~Transport() = default;
+
+        [[nodiscard]] virtual asio::any_io_executor executor() = 0;
+
+        // The client's address, captured when the connection was made.
+        [[nodiscard]] virtual asio::ip::address_v4 remoteAddress() const = 0;
+        [[nodiscard]] virtual bool isOpen() const = 0;
+
+        // Reads at least one byte into buffer. Returns zero with ec set once the stream has ended or failed.
+        virtual asio::awaitable<size_t> receive(asio::mutable_buffer buffer, asio::error_code& ec) = 0;
+
+        // Writes all of buffers, in order.
+        virtual asio::awaitable<void> write(std::span<const asio::const_buffer> buffers, asio::error_code& ec) = 0;
+
+        // Shuts both directions down; a receive or write in progress completes with an error.
+        virtual void close() = 0;
+    };
+
+    class TcpTransport final : public Transport
+    {
+    public:
+        explicit TcpTransport(asio::ip::tcp::socket socket);
+
+        [[nodiscard]] asio::any_io_executor executor() override;
+        [[nodiscard]] asio::ip::address_v4 remoteAddress() const override;
+        [[nodiscard]] bool isOpen() const override;
+
+        asio::awaitable<size_t> receive(asio::mutable_buffer buffer, asio::error_code& ec) override;
+        asio::awaitable<void> write(std::span<const asio::const_buffer> buffers, asio::error_code& ec) override;
+        void close() override;
+
+    private:
+        asio::ip::tcp::socket socket_;
+        asio::ip::address_v4 address_;
+    };
+} // namespace worms_server
+
+#endif // TRANSPORT_HPP
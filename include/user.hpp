@@ -5,15 +5,20 @@
 #ifndef USER_HPP
 #define USER_HPP
 
+#include <atomic>
 #include <memory>
+#include <span>
 #include <string>
 #include "spdlog/spdlog.h"
 
 #include <asio/ip/address_v4.hpp>
+#include "fixed_name.hpp"
+#include "presence_key.hpp"
 #include "session_info.hpp"
 
 namespace worms_server
 {
+    class Database;
     class UserSession;
 
     class User
@@ -28,25 +33,39 @@ namespace worms_server
 
         [[nodiscard]] uint32_t getId() const;
         [[nodiscard]] std::string_view getName() const;
-        [[nodiscard]] const SessionInfo& getSessionInfo() const;
+        [[nodiscard]] Nation getNation() const;
+        [[nodiscard]] SessionInfo getSessionInfo() const;
         [[nodiscard]] uint32_t getRoomId() const;
-        void setRoomId(uint32_t roomId);
 
-        void sendPacket(const net::shared_bytes_ptr& packet) const;
+        void sendPacket(const PacketBufferPtr& packet, PresenceKey key = {}) const;
+
+        // Queues several broadcast buffers that must reach the client in this order.
+        void sendPackets(std::span<const PacketBufferPtr> packets) const;
+        void sendReply(const PacketBufferPtr& packet) const;
+
+        // Queues a list response as one run on the reply lane, answering the request ahead of queued broadcasts.
+        void sendSnapshot(std::span<const PacketBufferPtr> packets) const;
 
         asio::ip::address_v4 getAddress() const;
 
+        // Points the user at the session of a client that reconnected within the resume grace window.
+        void rebind(const std::shared_ptr<UserSession>& session);
+
         User(const User& other) = delete;
         User(User&& other) noexcept = delete;
         User& operator=(const User& other) = delete;
         User& operator=(User&& other) noexcept = delete;
 
     private:
+        // Room changes go through Database::setUserRoomId so its lookup columns stay in sync.
+        friend class Database;
+        void setRoomId(uint32_t roomId);
+
         uint32_t id_;
-        std::string name_;
-        SessionInfo sessionInfo_;
         std::atomic<uint32_t> roomId_;
-        std::weak_ptr<UserSession> session_;
+        FixedName name_;
+        Nation nation_;
+        std::atomic<std::weak_ptr<UserSession>> session_;
     };
 } // namespace worms_server
 
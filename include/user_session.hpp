@@ -5,11 +5,20 @@
 #ifndef USER_SESSION_HPP
 #define USER_SESSION_HPP
 
-#include "moodycamel/concurrentqueue.h"
-
 #include <asio.hpp>
 #include <coroutine>
-#include "packet_buffers.hpp"
+#include <deque>
+#include <mutex>
+#include "admission_control.hpp"
+#include "packet_buffer.hpp"
+#include "packet_stream.hpp"
+#include "presence_key.hpp"
+#include "rate_limiter.hpp"
+#include "server_clock.hpp"
+#include "session_info.hpp"
+#include "shadow_mirror.hpp"
+#include "traffic_capture.hpp"
+#include "transport.hpp"
 
 namespace worms_server
 {
@@ -26,32 +35,126 @@ namespace worms_server
     class UserSession final : public std::enable_shared_from_this<UserSession>
     {
     public:
-        explicit UserSession(asio::ip::tcp::socket socket);
+        UserSession(std::unique_ptr<Transport> transport, AdmissionControl::Ticket admission);
         ~UserSession();
 
+        // Must be spawned on strand(), which the writer and the socket are also used from.
         awaitable<void> run();
 
-        void sendPacket(const net::shared_bytes_ptr& packet);
+        [[nodiscard]] const asio::strand<asio::any_io_executor>& strand() const
+        {
+            return strand_;
+        }
+
+        // Queues broadcast traffic: relayed chat and presence updates. A presence key lets the writer drop
+        // the packet if a later one cancels it while this client is behind.
+        void sendPacket(const PacketBufferPtr& packet, PresenceKey key = {});
+
+        // Queues unkeyed broadcast buffers through one producer, so they keep their order in the outbox.
+        void sendPackets(std::span<const PacketBufferPtr> packets);
+
+        // Queues a direct reply to this client's own request; the writer sends replies ahead of broadcasts.
+        void sendReply(const PacketBufferPtr& packet);
+
+        // Queues a multi-packet reply, such as a list response, as one run on the reply lane. Like any reply
+        // it keeps an open and a close queued on either side of it from being compacted away.
+        void sendReplies(std::span<const PacketBufferPtr> packets);
+
+        // Moves the broadcasts still queued on a resumed user's ended session to this one.
+        void adoptBacklog(UserSession& previous);
         asio::ip::address_v4 addressV4() const;
 
+        // Nonzero if this session was sampled for span tracing.
+        [[nodiscard]] uint32_t traceId() const
+        {
+            return traceId_;
+        }
+
+        // A write pending for longer than this drops the connection; zero never does. Set once at startup.
+        static void setWriteStallTimeout(std::chrono::seconds timeout);
+
         UserSession(const UserSession& other) = delete;
         UserSession(UserSession&& other) noexcept = delete;
         UserSession& operator=(const UserSession& other) = delete;
         UserSession& operator=(UserSession&& other) noexcept = delete;
 
+        struct OutboxEntry
+        {
+            PacketBufferPtr packet;
+            PresenceKey key;
+
+            // Replies queued before this entry; a reply in between an open and its close may carry the
+            // opened state, so the pair has to reach the client.
+            uint32_t replyEpoch = 0;
+        };
+
     private:
         awaitable<std::shared_ptr<User>> handleLogin();
         awaitable<void> handleSession();
         awaitable<void> writer();
+        awaitable<void> watchWrites();
+
+        // Stops the writer and the write watchdog and closes the transport, all on the strand.
+        void closeConnection();
+
+        // Cancels the writer's idle wait, on the strand.
+        void wakeWriter();
+
+        // Gives back this session's slot under the connection limit, once.
+        void releaseConnection();
+
+        // Records an event for this session if traffic capture is on.
+        void capture(CaptureEvent event, std::span<const net::byte> payload = {}) const;
+
+        static std::chrono::seconds writeStallTimeout_;
 
         std::shared_ptr<Database> database_;
         std::atomic<bool> isShuttingDown_{false};
-        asio::ip::tcp::socket socket_;
+        std::unique_ptr<Transport> transport_;
+
+        // Captured on accept, so it is still known after the peer has gone.
+        asio::ip::address_v4 address_;
+
+        // What the client sent in its Login, which a resume has to match.
+        SessionInfo loginInfo_;
+        AdmissionControl::Ticket admission_;
+
+        // Zero unless traffic capture was on when the session started.
+        uint32_t captureId_ = 0;
+
+        // Zero unless span tracing was on and sampled this session.
+        uint32_t traceId_ = 0;
+
+        // The candidate server's copy of this session, if shadow mirroring is on.
+        std::shared_ptr<ShadowSession> shadow_;
 
         std::shared_ptr<User> user_;
+        PacketStream stream_;
+        RateLimiter rateLimiter_;
+
+        // Cleared when the client broke the protocol or the rate limit, so its user is not held for a resume.
+        bool resumable_ = true;
+
+        // Set once the slot under the connection limit is given back, which a suspend does early.
+        bool connectionReleased_ = false;
+
+        ServerTimer timer_;
+
+        // Only touched on the strand, by watchWrites and closeConnection.
+        ServerTimer stallTimer_;
+
+        // Both lanes sit behind one mutex, so entries leave in the order they were queued whichever
+        // thread queued them, and every broadcast's reply epoch is exact.
+        std::mutex outboxMutex_;
+        std::deque<PacketBufferPtr> replies_;
+        std::deque<OutboxEntry> packets_;
+        uint32_t replyEpoch_ = 0;
+
+        // Set while the writer waits for work; whoever queues next clears it and wakes the writer.
+        bool writerIdle_ = false;
 
-        asio::steady_timer timer_;
-        moodycamel::ConcurrentQueue<net::shared_bytes_ptr> packets_;
+        // ServerClock ticks at which the pending write started, zero while the writer is idle.
+        std::atomic<int64_t> writeStartedAt_{0};
         asio::strand<asio::any_io_executor> strand_;
     };
 } // namespace worms_server
@@ -6,7 +6,7 @@
 #include <string>
 
 #include "framed_packet_reader.hpp"
-#include "packet_buffers.hpp"
+#include "packet_buffer.hpp"
 #include "packet_code.hpp"
 #include "session_info.hpp"
 
@@ -21,6 +21,9 @@ namespace worms_server
 {
     using WormsPacketPtr = std::shared_ptr<WormsPacket>;
 
+    // Which side sent the bytes being parsed, and so which packet codes are valid.
+    enum class PacketSource : uint8_t { Client, Server };
+
     struct PacketFields
     {
         std::optional<uint32_t> value0, value1, value2, value3, value4, value10, dataLength;
@@ -37,12 +40,16 @@ namespace worms_server
         static constexpr size_t MAX_NAME_LENGTH = 20;
         static std::atomic<bool> useWindows1252Encoding;
 
-        static net::shared_bytes_ptr freeze(PacketCode code, PacketFields fields = {});
+        static PacketBufferPtr freeze(PacketCode code, PacketFields fields = {});
 
         explicit WormsPacket(PacketCode code, PacketFields fields = {});
 
         [[nodiscard]] static net::deserialization_result<WormsPacketPtr, std::string> readFrom(
-            net::packet_reader& reader);
+            net::packet_reader& reader, PacketSource source = PacketSource::Client);
+
+        // Computes the wire length of the packet at the start of bytes from its flags alone, without decoding it.
+        [[nodiscard]] static net::deserialization_result<size_t, std::string> peekFrameLength(
+            std::span<const net::byte> bytes, PacketSource source = PacketSource::Client);
 
         [[nodiscard]] PacketCode code() const;
         [[nodiscard]] size_t dataLength() const;
@@ -54,23 +61,31 @@ namespace worms_server
         constexpr uint32_t getFlagsFromFields() const;
 
         template <PacketCode Code>
-        static const net::shared_bytes_ptr& getCachedPacket()
+        static const PacketBufferPtr& getCachedPacket()
         {
             static const auto PACKET = freeze(Code);
             return PACKET;
         }
 
 
-        static const net::shared_bytes_ptr& getListEndPacket()
+        static const PacketBufferPtr& getListEndPacket()
         {
             return getCachedPacket<PacketCode::ListEnd>();
         }
 
     private:
+        struct EncodedStrings
+        {
+            std::optional<std::string> data;
+            std::optional<std::string> name;
+        };
+
         static inline std::string encodeString(const std::string& input);
         static inline std::string decodeString(const std::string& input);
 
-        void writeTo(net::packet_writer& writer) const;
+        [[nodiscard]] EncodedStrings encodeStrings() const;
+        [[nodiscard]] size_t wireLength(const EncodedStrings& encoded) const;
+        void writeTo(PacketWriter& writer, const EncodedStrings& encoded) const;
         PacketCode code_;
         uint32_t flags_;
         PacketFields fields_;
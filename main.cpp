@@ -10,10 +10,47 @@
 #include "spdlog/sinks/stdout_color_sinks.h"
 
 #include "server.hpp"
+#include "shadow_mirror.hpp"
 #include "user_session.hpp"
 
+#if defined(WORMS_IO_URING_FALLBACK)
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <liburing.h>
+#include <unistd.h>
+#endif
+
 namespace
 {
+#if defined(WORMS_IO_URING_FALLBACK)
+    // The io_uring build cannot switch to epoll at runtime, so on a kernel without io_uring (too old, or
+    // blocked by seccomp as in many containers) it hands over to the epoll build next to it.
+    void EnsureIoUringOrFallBack(char** argv)
+    {
+        io_uring ring{};
+        const int result = io_uring_queue_init(8, &ring, 0);
+        if (result == 0)
+        {
+            io_uring_queue_exit(&ring);
+            spdlog::info("Using the io_uring backend");
+            return;
+        }
+
+        std::error_code ec;
+        const auto fallback = std::filesystem::read_symlink("/proc/self/exe", ec).parent_path() /
+                              WORMS_IO_URING_FALLBACK;
+        spdlog::warn("io_uring is not available ({}), starting {} instead", std::strerror(-result), fallback.string());
+        spdlog::shutdown();
+
+        argv[0] = const_cast<char*>(fallback.c_str());
+        execv(fallback.c_str(), argv);
+
+        std::cerr << "Failed to start " << fallback << ": " << std::strerror(errno) << '\n';
+        std::exit(1);
+    }
+#endif
+
     void InitializeLogging()
     {
         spdlog::init_thread_pool(8192, 1); // queue size, number of threads
@@ -39,8 +76,7 @@ namespace
         std::atexit([]() { spdlog::shutdown(); });
     }
 
-    bool ParseCommandLineArguments(
-        const int argc, char** argv, uint16_t& port, size_t& maxConnections, size_t& maxThreads) // NOLINT(*-easily-swappable-parameters)
+    bool ParseCommandLineArguments(const int argc, char** argv, worms_server::ServerOptions& options)
     {
         const auto rawArgs = std::span(argv, static_cast<size_t>(argc));
         std::vector<std::string> args;
@@ -50,42 +86,188 @@ namespace
             args.emplace_back(p);
         }
 
+        options.preallocate = std::ranges::find(args, "--preallocate") != args.end();
+
         for (const auto argsSlide = std::ranges::slide_view(args, 2); const auto& arg : argsSlide)
         {
             if (arg[0] == "-p" || arg[0] == "--port")
             {
-                port = static_cast<uint16_t>(std::stoi(arg[1]));
-                if (port <= 1024)
+                options.port = static_cast<uint16_t>(std::stoi(arg[1]));
+                if (options.port <= 1024)
                 {
                     std::cerr << "Invalid port number, defaulting to 17000\n";
-                    port = 17000;
+                    options.port = 17000;
                 }
             }
 
             if (arg[0] == "-c" || arg[0] == "--connections")
             {
-                maxConnections = std::stoi(arg[1]);
-                if (maxConnections < 1)
+                options.maxConnections = std::stoi(arg[1]);
+                if (options.maxConnections < 1)
                 {
                     std::cerr << "Invalid connection count, defaulting to 1000\n";
-                    maxConnections = 1000;
+                    options.maxConnections = 1000;
                 }
             }
 
             if (arg[0] == "-t" || arg[0] == "--threads")
             {
-                maxThreads = std::stoi(arg[1]);
-                if (maxThreads < 1)
+                options.maxThreads = std::stoi(arg[1]);
+                if (options.maxThreads < 1)
                 {
                     std::cerr << "Invalid thread count, defaulting to " << std::thread::hardware_concurrency() << "\n";
-                    maxThreads = std::thread::hardware_concurrency();
+                    options.maxThreads = std::thread::hardware_concurrency();
                 }
-                else if (maxThreads > std::thread::hardware_concurrency())
+                else if (options.maxThreads > std::thread::hardware_concurrency())
                 {
                     std::cerr << "Thread count cannot be higher than the number of "
                         "cores, defaulting to "
                         << std::thread::hardware_concurrency() << "\n";
-                    maxThreads = std::thread::hardware_concurrency();
+                    options.maxThreads = std::thread::hardware_concurrency();
+                }
+            }
+
+            if (arg[0] == "--max-pending-per-ip")
+            {
+                options.maxPendingPerAddress = std::stoi(arg[1]);
+                if (options.maxPendingPerAddress < 1)
+                {
+                    std::cerr << "Invalid pending login count, defaulting to 4\n";
+                    options.maxPendingPerAddress = 4;
+                }
+            }
+
+            if (arg[0] == "--max-pending-logins")
+            {
+                options.maxPendingLogins = std::stoi(arg[1]);
+                if (options.maxPendingLogins < 1)
+                {
+                    std::cerr << "Invalid pending login count, defaulting to 256\n";
+                    options.maxPendingLogins = 256;
+                }
+            }
+
+            if (arg[0] == "--presence-tick")
+            {
+                options.presenceTick = std::chrono::milliseconds(std::stoi(arg[1]));
+                if (options.presenceTick.count() < 0 || options.presenceTick.count() > 1000)
+                {
+                    std::cerr << "Invalid presence tick, disabling presence coalescing\n";
+                    options.presenceTick = std::chrono::milliseconds(0);
+                }
+            }
+
+            if (arg[0] == "--disconnect-window")
+            {
+                options.disconnectWindow = std::chrono::milliseconds(std::stoi(arg[1]));
+                if (options.disconnectWindow.count() < 0 || options.disconnectWindow.count() > 1000)
+                {
+                    std::cerr << "Invalid disconnect window, defaulting to 0\n";
+                    options.disconnectWindow = std::chrono::milliseconds(0);
+                }
+            }
+
+            if (arg[0] == "--resume-grace")
+            {
+                options.resumeGrace = std::chrono::milliseconds(std::stoi(arg[1]));
+                if (options.resumeGrace.count() < 0 || options.resumeGrace.count() > 60000)
+                {
+                    std::cerr << "Invalid resume grace, disabling session resume\n";
+                    options.resumeGrace = std::chrono::milliseconds(0);
+                }
+            }
+
+            if (arg[0] == "--keepalive" && !worms_server::ParseKeepalive(arg[1], options.keepalive))
+            {
+                std::cerr << "Invalid keepalive '" << arg[1] << "', using 30/5/3\n";
+            }
+
+            if (arg[0] == "--user-timeout")
+            {
+                options.keepalive.userTimeout = std::chrono::milliseconds(std::stoi(arg[1]));
+                if (options.keepalive.userTimeout.count() < 0)
+                {
+                    std::cerr << "Invalid user timeout, defaulting to 20000\n";
+                    options.keepalive.userTimeout = std::chrono::milliseconds(20000);
+                }
+            }
+
+            if (arg[0] == "--write-stall-timeout")
+            {
+                options.writeStallTimeout = std::chrono::seconds(std::stoi(arg[1]));
+                if (options.writeStallTimeout.count() < 0)
+                {
+                    std::cerr << "Invalid write stall timeout, defaulting to 20\n";
+                    options.writeStallTimeout = std::chrono::seconds(20);
+                }
+            }
+
+            if (arg[0] == "--rate-limit" && !worms_server::ParseRateLimitRule(arg[1], options.rateLimits))
+            {
+                std::cerr << "Invalid rate limit '" << arg[1] << "', ignoring it\n";
+            }
+
+            if (arg[0] == "--capture")
+            {
+                options.capturePath = arg[1];
+            }
+
+            if (arg[0] == "--slow-handler")
+            {
+                options.slowHandlerThreshold = std::chrono::milliseconds(std::stoi(arg[1]));
+                if (options.slowHandlerThreshold.count() < 0)
+                {
+                    std::cerr << "Invalid slow handler threshold, defaulting to 100\n";
+                    options.slowHandlerThreshold = std::chrono::milliseconds(100);
+                }
+            }
+
+            if (arg[0] == "--stall-threshold")
+            {
+                options.stallThreshold = std::chrono::milliseconds(std::stoi(arg[1]));
+                if (options.stallThreshold.count() < 0)
+                {
+                    std::cerr << "Invalid stall threshold, defaulting to 500\n";
+                    options.stallThreshold = std::chrono::milliseconds(500);
+                }
+            }
+
+            if (arg[0] == "--trace-sample")
+            {
+                const int sample = std::stoi(arg[1]);
+                if (sample < 0)
+                {
+                    std::cerr << "Invalid trace sample, not tracing\n";
+                }
+                else
+                {
+                    options.traceSample = static_cast<uint32_t>(sample);
+                }
+            }
+
+            if (arg[0] == "--metrics-port")
+            {
+                const int port = std::stoi(arg[1]);
+                if (port < 0 || port > 65535)
+                {
+                    std::cerr << "Invalid metrics port, not serving metrics\n";
+                }
+                else
+                {
+                    options.metricsPort = static_cast<uint16_t>(port);
+                }
+            }
+
+            if (arg[0] == "--shadow")
+            {
+                asio::ip::tcp::endpoint target;
+                if (worms_server::ParseShadowTarget(arg[1], target))
+                {
+                    options.shadowTarget = target;
+                }
+                else
+                {
+                    std::cerr << "Invalid shadow target '" << arg[1] << "', not mirroring\n";
                 }
             }
 
@@ -100,6 +282,42 @@ namespace
                     << "  -t, --threads <count>		Maximum number of "
                     "threads (default: "
                     << std::thread::hardware_concurrency() << ")\n"
+                    << "  --preallocate				Preallocate session memory for "
+                    "every connection at startup\n"
+                    << "  --max-pending-per-ip <count>	Connections per address "
+                    "that have not logged in yet (default: 4)\n"
+                    << "  --max-pending-logins <count>	Connections in total "
+                    "that have not logged in yet (default: 256)\n"
+                    << "  --presence-tick <ms>		Batch lobby presence "
+                    "updates per tick (default: 0, off)\n"
+                    << "  --disconnect-window <ms>	Batch the teardown of "
+                    "users dropped within the window (default: 0)\n"
+                    << "				Dropped users stay listed and "
+                    "keep their name until then\n"
+                    << "  --resume-grace <ms>		Keep dropped users for a "
+                    "reconnect (default: 0, off)\n"
+                    << "  --keepalive <idle>/<interval>/<probes>	TCP keepalive "
+                    "in seconds, or os (default: 30/5/3)\n"
+                    << "  --user-timeout <ms>		TCP_USER_TIMEOUT for "
+                    "unacknowledged data (default: 20000, 0 = unset)\n"
+                    << "  --write-stall-timeout <s>	Drop clients whose writes "
+                    "stall this long (default: 20, 0 = off)\n"
+                    << "  --rate-limit <rule>		Set a per-user limit, e.g. "
+                    "ChatRoom=5/10:reply or ListUsers=off\n"
+                    << "  --capture <file>		Record all session traffic "
+                    "for worms_replay\n"
+                    << "  --slow-handler <ms>		Log packets handled slower "
+                    "than this (default: 100, 0 = off)\n"
+                    << "  --stall-threshold <ms>	Warn when an io thread "
+                    "stalls this long (default: 500, 0 = off)\n"
+                    << "  --trace-sample <n>		Trace one session in n "
+                    "(default: 0, off)\n"
+                    << "  --metrics-port <port>		Serve Prometheus metrics "
+                    "on 127.0.0.1 (default: 0, off)\n"
+                    << "  --shadow <address>:<port>	Mirror client traffic "
+                    "to a candidate server and compare\n"
+                    << "				Start the candidate with "
+                    "--max-pending-per-ip raised to match\n"
                     << "  -h, --help				Print this help message\n"
                     << '\n' << std::flush;
                 return true;
@@ -111,21 +329,22 @@ namespace
 
 int main(const int argc, char** argv)
 {
-    size_t maxThreads = std::thread::hardware_concurrency();
-
     try
     {
-        uint16_t port = 17000;
-        size_t maxConnections = 10000;
+        worms_server::ServerOptions options;
         InitializeLogging();
 
-        if (ParseCommandLineArguments(argc, argv, port, maxConnections, maxThreads))
+#if defined(WORMS_IO_URING_FALLBACK)
+        EnsureIoUringOrFallBack(argv);
+#endif
+
+        if (ParseCommandLineArguments(argc, argv, options))
         {
             return 0;
         }
 
-        worms_server::Server server(port, maxConnections);
-        server.run(maxThreads);
+        worms_server::Server server(options);
+        server.run(options.maxThreads);
     }
     catch (const std::exception& e)
     {
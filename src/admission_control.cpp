@@ -0,0 +1,100 @@
+#include "admission_control.hpp"
+
+#include <utility>
+
+namespace worms_server
+{
+    AdmissionControl::Ticket::Ticket(AdmissionControl* owner, const uint32_t address) :
+        owner_(owner), address_(address)
+    {
+    }
+
+    AdmissionControl::Ticket::Ticket(Ticket&& other) noexcept :
+        owner_(std::exchange(other.owner_, nullptr)), address_(other.address_)
+    {
+    }
+
+    AdmissionControl::Ticket& AdmissionControl::Ticket::operator=(Ticket&& other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            owner_ = std::exchange(other.owner_, nullptr);
+            address_ = other.address_;
+        }
+        return *this;
+    }
+
+    AdmissionControl::Ticket::~Ticket()
+    {
+        release();
+    }
+
+    void AdmissionControl::Ticket::release()
+    {
+        if (auto* owner = std::exchange(owner_, nullptr))
+        {
+            owner->release(address_);
+        }
+    }
+
+    AdmissionControl::AdmissionControl(const size_t maxPendingPerAddress, const size_t maxPending) :
+        maxPendingPerAddress_(maxPendingPerAddress), maxPending_(maxPending)
+    {
+    }
+
+    std::optional<AdmissionControl::Ticket> AdmissionControl::admit(const asio::ip::address& address)
+    {
+        // The listener is IPv4 only; anything else shares one bucket.
+        const uint32_t key = address.is_v4() ? address.to_v4().to_uint() : 0;
+
+        const std::scoped_lock lock(mutex_);
+        if (pending_ >= maxPending_)
+        {
+            rejectedPending_.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+
+        auto& count = pendingPerAddress_[key];
+        if (count >= maxPendingPerAddress_)
+        {
+            rejectedPerAddress_.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+
+        ++count;
+        ++pending_;
+        return Ticket(this, key);
+    }
+
+    void AdmissionControl::release(const uint32_t address)
+    {
+        const std::scoped_lock lock(mutex_);
+        if (const auto it = pendingPerAddress_.find(address); it != pendingPerAddress_.end() && --it->second == 0)
+        {
+            pendingPerAddress_.erase(it);
+        }
+        --pending_;
+    }
+
+    void AdmissionControl::countRejectedAtCapacity()
+    {
+        rejectedAtCapacity_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void AdmissionControl::countPause(const std::chrono::steady_clock::duration paused)
+    {
+        acceptPauses_.fetch_add(1, std::memory_order_relaxed);
+        pausedMilliseconds_.fetch_add(std::chrono::duration_cast<std::chrono::milliseconds>(paused).count(),
+                                      std::memory_order_relaxed);
+    }
+
+    AdmissionStats AdmissionControl::stats() const
+    {
+        return {.rejectedAtCapacity = rejectedAtCapacity_.load(std::memory_order_relaxed),
+                .rejectedPerAddress = rejectedPerAddress_.load(std::memory_order_relaxed),
+                .rejectedPending = rejectedPending_.load(std::memory_order_relaxed),
+                .acceptPauses = acceptPauses_.load(std::memory_order_relaxed),
+                .pausedMilliseconds = pausedMilliseconds_.load(std::memory_order_relaxed)};
+    }
+} // namespace worms_server
@@ -4,12 +4,74 @@
 
 #include "database.hpp"
 
+#include <algorithm>
 #include <ranges>
+#include <unordered_set>
 
 #include "game.hpp"
 #include "room.hpp"
+#include "span_tracer.hpp"
+#include "string_utils.hpp"
 #include "user.hpp"
 
+namespace
+{
+    using namespace worms_server;
+
+    // Takes a lock on mutex. Inside a traced span on this thread it also records the hold as a span
+    // nested under that one, with the wait to acquire it as an argument.
+    template <typename Lock>
+    class TracedLock
+    {
+    public:
+        TracedLock(std::shared_mutex& mutex, const char* name) :
+            name_(TraceActive() ? name : nullptr), requested_(name_ != nullptr ? TraceNow() : 0), lock_(mutex),
+            acquired_(name_ != nullptr ? TraceNow() : 0)
+        {
+        }
+
+        ~TracedLock()
+        {
+            if (name_ != nullptr)
+            {
+                SpanTracer::getInstance().record({.name = name_, .start = acquired_,
+                                                  .duration = TraceNow() - acquired_, .argName = "wait_ns",
+                                                  .arg = acquired_ - requested_});
+            }
+        }
+
+        TracedLock(const TracedLock&) = delete;
+        TracedLock& operator=(const TracedLock&) = delete;
+
+    private:
+        const char* name_;
+        int64_t requested_;
+        Lock lock_;
+        int64_t acquired_;
+    };
+
+    using ReadLock = TracedLock<std::shared_lock<std::shared_mutex>>;
+    using WriteLock = TracedLock<std::unique_lock<std::shared_mutex>>;
+
+    // Moves the last slot of every column into the erased slot and shrinks the table by one.
+    template <typename Table, typename... Columns>
+    void EraseSlot(Table& table, const uint32_t slot, Columns&... columns)
+    {
+        const auto last = static_cast<uint32_t>(table.ids.size() - 1);
+        table.slots.erase(table.ids[slot]);
+
+        if (slot != last)
+        {
+            table.ids[slot] = table.ids[last];
+            ((columns[slot] = std::move(columns[last])), ...);
+            table.slots[table.ids[slot]] = slot;
+        }
+
+        table.ids.pop_back();
+        (columns.pop_back(), ...);
+    }
+}
+
 namespace worms_server
 {
     std::shared_ptr<Database> Database::getInstance()
@@ -66,68 +128,71 @@ namespace worms_server
 
     std::shared_ptr<User> Database::getUser(const uint32_t id) const
     {
-        const std::shared_lock lock(usersMutex_);
-        const auto it = users_.find(id);
-        return it != users_.end() ? it->second : nullptr;
+        const ReadLock lock(usersMutex_, "Database users read");
+        const auto it = users_.slots.find(id);
+        return it != users_.slots.end() ? users_.objects[it->second] : nullptr;
     }
 
     std::shared_ptr<Room> Database::getRoom(const uint32_t id) const
     {
-        const std::shared_lock lock(roomsMutex_);
-        const auto it = rooms_.find(id);
-        return it != rooms_.end() ? it->second : nullptr;
+        const ReadLock lock(roomsMutex_, "Database rooms read");
+        const auto it = rooms_.slots.find(id);
+        return it != rooms_.slots.end() ? rooms_.objects[it->second] : nullptr;
     }
 
     std::shared_ptr<Game> Database::getGame(const uint32_t id) const
     {
-        const std::shared_lock lock(gamesMutex_);
-        const auto it = games_.find(id);
-        return it != games_.end() ? it->second : nullptr;
+        const ReadLock lock(gamesMutex_, "Database games read");
+        const auto it = games_.slots.find(id);
+        return it != games_.slots.end() ? games_.objects[it->second] : nullptr;
     }
 
     std::vector<std::shared_ptr<User>> Database::getUsers() const
     {
-        const std::shared_lock lock(usersMutex_);
-        std::vector<std::shared_ptr<User>> users;
-
-        users.reserve(users_.size());
-        std::ranges::copy(users_ | std::views::values, std::back_inserter(users));
-
-        return users;
+        const ReadLock lock(usersMutex_, "Database users read");
+        return users_.objects;
     }
 
     std::vector<std::shared_ptr<Room>> Database::getRooms() const
     {
-        const std::shared_lock lock(roomsMutex_);
-        std::vector<std::shared_ptr<Room>> rooms;
-
-        rooms.reserve(rooms_.size());
-        std::ranges::copy(rooms_ | std::views::values, std::back_inserter(rooms));
-        return rooms;
+        const ReadLock lock(roomsMutex_, "Database rooms read");
+        return rooms_.objects;
     }
 
     std::vector<std::shared_ptr<Game>> Database::getGames() const
     {
-        const std::shared_lock lock(gamesMutex_);
-        std::vector<std::shared_ptr<Game>> games;
+        const ReadLock lock(gamesMutex_, "Database games read");
+        return games_.objects;
+    }
 
-        games.reserve(games_.size());
-        std::ranges::copy(games_ | std::views::values, std::back_inserter(games));
-        return games;
+    size_t Database::userCount() const
+    {
+        const ReadLock lock(usersMutex_, "Database users read");
+        return users_.ids.size();
+    }
+
+    size_t Database::roomCount() const
+    {
+        const ReadLock lock(roomsMutex_, "Database rooms read");
+        return rooms_.ids.size();
+    }
+
+    size_t Database::gameCount() const
+    {
+        const ReadLock lock(gamesMutex_, "Database games read");
+        return games_.ids.size();
     }
 
     std::vector<std::shared_ptr<User>> Database::getUsersInRoom(const uint32_t roomId) const
     {
-        const std::shared_lock usersLock(usersMutex_);
+        const ReadLock usersLock(usersMutex_, "Database users read");
 
         std::vector<std::shared_ptr<User>> users;
-
-        users.reserve(rooms_.size());
-        for (const auto& user : users_ | std::views::values)
+        for (size_t slot = 0; slot < users_.roomIds.size(); ++slot)
         {
-            if (user->getRoomId() == roomId)
+            if (users_.roomIds[slot] == roomId)
             {
-                users.emplace_back(user);
+                users.emplace_back(users_.objects[slot]);
             }
         }
 
@@ -136,23 +201,65 @@ namespace worms_server
 
     std::shared_ptr<Game> Database::getGameByName(std::string_view name) const
     {
-        const std::shared_lock lock(gamesMutex_);
+        const ReadLock lock(gamesMutex_, "Database games read");
 
-        auto view = games_ | std::views::values;
-        const auto it = std::ranges::find_if(view, [name](const auto& game) { return game->getName() == name; });
+        const auto it = std::ranges::find(games_.names, name, &FixedName::view);
+        return it != games_.names.end() ? games_.objects[it - games_.names.begin()] : nullptr;
+    }
 
-        return (it != view.end()) ? *it : nullptr;
+    bool Database::isUserNameTaken(const std::string_view name) const
+    {
+        const ReadLock lock(usersMutex_, "Database users read");
+        return std::ranges::any_of(users_.names, [name](const FixedName& taken)
+        {
+            return EqualsCaseInsensitive(taken.view(), name);
+        });
+    }
+
+    bool Database::isRoomNameTaken(const std::string_view name) const
+    {
+        const ReadLock lock(roomsMutex_, "Database rooms read");
+        return std::ranges::any_of(rooms_.names, [name](const FixedName& taken)
+        {
+            return EqualsCaseInsensitive(taken.view(), name);
+        });
+    }
+
+    bool Database::hasUsersInRoom(const uint32_t roomId, const uint32_t excludedUserId) const
+    {
+        const ReadLock lock(usersMutex_, "Database users read");
+        for (size_t slot = 0; slot < users_.roomIds.size(); ++slot)
+        {
+            if (users_.roomIds[slot] == roomId && users_.ids[slot] != excludedUserId)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Database::hasGamesInRoom(const uint32_t roomId, const uint32_t excludedGameId) const
+    {
+        const ReadLock lock(gamesMutex_, "Database games read");
+        for (size_t slot = 0; slot < games_.roomIds.size(); ++slot)
+        {
+            if (games_.roomIds[slot] == roomId && games_.ids[slot] != excludedGameId)
+            {
+                return true;
+            }
+        }
+        return false;
     }
 
     void Database::setUserRoomId(const uint32_t userId, const uint32_t roomId) // NOLINT(*-easily-swappable-parameters)
     {
-        const std::unique_lock lock(usersMutex_);
-        const auto it = std::ranges::find_if(
-            users_, [userId](const auto& user) -> bool { return user.second->getId() == userId; });
+        const WriteLock lock(usersMutex_, "Database users write");
+        const auto it = users_.slots.find(userId);
 
-        if (it != std::end(users_))
+        if (it != users_.slots.end())
         {
-            it->second->setRoomId(roomId);
+            users_.roomIds[it->second] = roomId;
+            users_.objects[it->second]->setRoomId(roomId);
             return;
         }
 
@@ -161,43 +268,157 @@ namespace worms_server
 
     void Database::addUser(std::shared_ptr<User> user)
     {
-        const std::scoped_lock lock(usersMutex_);
+        const WriteLock lock(usersMutex_, "Database users write");
         const uint32_t id = user->getId();
-        users_[id] = std::move(user);
+        if (const auto it = users_.slots.find(id); it != users_.slots.end())
+        {
+            EraseSlot(users_, it->second, users_.roomIds, users_.names, users_.objects);
+        }
+
+        users_.slots[id] = static_cast<uint32_t>(users_.ids.size());
+        users_.ids.push_back(id);
+        users_.roomIds.push_back(user->getRoomId());
+        users_.names.emplace_back(user->getName());
+        users_.objects.push_back(std::move(user));
     }
 
     void Database::removeUser(const uint32_t id)
     {
-        const std::scoped_lock lock(usersMutex_);
-        users_.erase(id);
+        const WriteLock lock(usersMutex_, "Database users write");
+        if (const auto it = users_.slots.find(id); it != users_.slots.end())
+        {
+            EraseSlot(users_, it->second, users_.roomIds, users_.names, users_.objects);
+        }
         recycledIds_.enqueue(id);
     }
 
+    void Database::detachUser(const uint32_t id)
+    {
+        const WriteLock lock(usersMutex_, "Database users write");
+        if (const auto it = users_.slots.find(id); it != users_.slots.end())
+        {
+            EraseSlot(users_, it->second, users_.roomIds, users_.names, users_.objects);
+        }
+    }
+
+    void Database::removeUsers(const std::span<const uint32_t> ids)
+    {
+        const WriteLock lock(usersMutex_, "Database users write");
+        for (const uint32_t id : ids)
+        {
+            if (const auto it = users_.slots.find(id); it != users_.slots.end())
+            {
+                EraseSlot(users_, it->second, users_.roomIds, users_.names, users_.objects);
+            }
+        }
+        recycledIds_.enqueue_bulk(ids.begin(), ids.size());
+    }
+
     void Database::addRoom(std::shared_ptr<Room> room)
     {
-        const std::scoped_lock lock(roomsMutex_);
+        const WriteLock lock(roomsMutex_, "Database rooms write");
         const uint32_t id = room->getId();
-        rooms_[id] = std::move(room);
+        if (const auto it = rooms_.slots.find(id); it != rooms_.slots.end())
+        {
+            EraseSlot(rooms_, it->second, rooms_.names, rooms_.objects);
+        }
+
+        rooms_.slots[id] = static_cast<uint32_t>(rooms_.ids.size());
+        rooms_.ids.push_back(id);
+        rooms_.names.emplace_back(room->getName());
+        rooms_.objects.push_back(std::move(room));
     }
 
     void Database::removeRoom(const uint32_t id)
     {
-        const std::scoped_lock lock(roomsMutex_);
-        rooms_.erase(id);
+        const WriteLock lock(roomsMutex_, "Database rooms write");
+        if (const auto it = rooms_.slots.find(id); it != rooms_.slots.end())
+        {
+            EraseSlot(rooms_, it->second, rooms_.names, rooms_.objects);
+        }
         recycledIds_.enqueue(id);
     }
 
+    std::vector<uint32_t> Database::removeEmptyRooms(const std::span<const uint32_t> ids)
+    {
+        std::unordered_set<uint32_t> candidates(ids.begin(), ids.end());
+        candidates.erase(0);
+
+        {
+            const ReadLock lock(usersMutex_, "Database users read");
+            for (const uint32_t roomId : users_.roomIds)
+            {
+                candidates.erase(roomId);
+            }
+        }
+
+        {
+            const ReadLock lock(gamesMutex_, "Database games read");
+            for (const uint32_t roomId : games_.roomIds)
+            {
+                candidates.erase(roomId);
+            }
+        }
+
+        std::vector<uint32_t> removed;
+        const WriteLock lock(roomsMutex_, "Database rooms write");
+        for (const uint32_t id : candidates)
+        {
+            if (const auto it = rooms_.slots.find(id); it != rooms_.slots.end())
+            {
+                EraseSlot(rooms_, it->second, rooms_.names, rooms_.objects);
+                recycledIds_.enqueue(id);
+                removed.push_back(id);
+            }
+        }
+        return removed;
+    }
+
     void Database::addGame(std::shared_ptr<Game> game)
     {
-        const std::scoped_lock lock(gamesMutex_);
+        const WriteLock lock(gamesMutex_, "Database games write");
         const uint32_t id = game->getId();
-        games_[id] = std::move(game);
+        if (const auto it = games_.slots.find(id); it != games_.slots.end())
+        {
+            EraseSlot(games_, it->second, games_.roomIds, games_.names, games_.objects);
+        }
+
+        games_.slots[id] = static_cast<uint32_t>(games_.ids.size());
+        games_.ids.push_back(id);
+        games_.roomIds.push_back(game->getRoomId());
+        games_.names.emplace_back(game->getName());
+        games_.objects.push_back(std::move(game));
     }
 
     void Database::removeGame(const uint32_t id)
     {
-        const std::scoped_lock lock(gamesMutex_);
-        games_.erase(id);
+        const WriteLock lock(gamesMutex_, "Database games write");
+        if (const auto it = games_.slots.find(id); it != games_.slots.end())
+        {
+            EraseSlot(games_, it->second, games_.roomIds, games_.names, games_.objects);
+        }
         recycledIds_.enqueue(id);
     }
+
+    std::vector<std::shared_ptr<Game>> Database::removeGamesByName(const std::span<const std::string_view> names)
+    {
+        const std::unordered_set<std::string_view> hosts(names.begin(), names.end());
+
+        std::vector<std::shared_ptr<Game>> removed;
+        const WriteLock lock(gamesMutex_, "Database games write");
+        for (uint32_t slot = 0; slot < games_.ids.size();)
+        {
+            if (!hosts.contains(games_.names[slot].view()))
+            {
+                ++slot;
+                continue;
+            }
+
+            // The swapped-in game lands in this slot, so test it before moving on.
+            recycledIds_.enqueue(games_.ids[slot]);
+            removed.push_back(games_.objects[slot]);
+            EraseSlot(games_, slot, games_.roomIds, games_.names, games_.objects);
+        }
+        return removed;
+    }
 } // namespace worms_server
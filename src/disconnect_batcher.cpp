@@ -0,0 +1,193 @@
+#include "disconnect_batcher.hpp"
+
+#include <unordered_map>
+#include <utility>
+
+#include "spdlog/spdlog.h"
+
+#include "database.hpp"
+#include "game.hpp"
+#include "loop_monitor.hpp"
+#include "packet_code.hpp"
+#include "presence_coalescer.hpp"
+#include "recycling_allocator.hpp"
+#include "server_clock.hpp"
+#include "span_tracer.hpp"
+#include "user.hpp"
+#include "worms_packet.hpp"
+
+namespace worms_server
+{
+    DisconnectBatcher& DisconnectBatcher::getInstance()
+    {
+        static DisconnectBatcher instance;
+        return instance;
+    }
+
+    void DisconnectBatcher::setWindow(const std::chrono::milliseconds window)
+    {
+        window_ = window;
+    }
+
+    void DisconnectBatcher::submit(const asio::any_io_executor& executor, std::shared_ptr<User> user)
+    {
+        if (user == nullptr || user->getId() == 0)
+        {
+            return;
+        }
+
+        Database::getInstance()->detachUser(user->getId());
+
+        {
+            const std::scoped_lock lock(mutex_);
+            pending_.push_back(std::move(user));
+            if (std::exchange(scheduled_, true))
+            {
+                return;
+            }
+        }
+
+        // Even without a window, co_spawn posts, so disconnects arriving before it runs share the batch.
+        co_spawn(executor, flushAfter(window_), Recycled(asio::detached));
+    }
+
+    asio::awaitable<void> DisconnectBatcher::flushAfter(const std::chrono::milliseconds window)
+    {
+        if (window.count() > 0)
+        {
+            ServerTimer timer(co_await asio::this_coro::executor, window);
+            asio::error_code ec;
+            co_await timer.async_wait(Recycled(asio::redirect_error(asio::use_awaitable, ec)));
+        }
+
+        std::vector<std::shared_ptr<User>> users;
+        {
+            const std::scoped_lock lock(mutex_);
+            users.swap(pending_);
+            scheduled_ = false;
+        }
+
+        if (users.size() > 1)
+        {
+            spdlog::info("Tearing down {} disconnected users in one batch", users.size());
+        }
+
+        notify(users);
+    }
+
+    void DisconnectBatcher::teardown(const std::span<const std::shared_ptr<User>> users)
+    {
+        const auto database = Database::getInstance();
+        for (const auto& user : users)
+        {
+            database->detachUser(user->getId());
+        }
+
+        notify(users);
+    }
+
+    void DisconnectBatcher::notify(const std::span<const std::shared_ptr<User>> users)
+    {
+        if (users.empty())
+        {
+            return;
+        }
+
+        const LoopActivity activity("tearing down disconnected users");
+
+        // Batches are rare next to packets, so every one is traced rather than sampled.
+        const TraceScope trace(SpanTracer::enabled(), "disconnect batch");
+        const auto database = Database::getInstance();
+
+        std::vector<uint32_t> userIds;
+        std::vector<std::string_view> names;
+        userIds.reserve(users.size());
+        names.reserve(users.size());
+        for (const auto& user : users)
+        {
+            spdlog::debug("User Session: Disconnecting user {}", user->getName());
+            userIds.push_back(user->getId());
+            names.push_back(user->getName());
+        }
+
+        // Games are named after their host, so abandoned games are the ones named like a dropped user.
+        const auto games = database->removeGamesByName(names);
+        std::unordered_map<std::string_view, const Game*> hostedGames;
+        for (const auto& game : games)
+        {
+            hostedGames.emplace(game->getName(), game.get());
+        }
+
+        std::vector<PacketBufferPtr> packets;
+        std::vector<PresenceKey> keys;
+        std::vector<uint32_t> leftRoomIds;
+        packets.reserve(users.size() * 2 + games.size() * 2);
+        keys.reserve(packets.capacity());
+
+        const auto add = [&](PacketBufferPtr packet, const PresenceKey key)
+        {
+            packets.push_back(std::move(packet));
+            keys.push_back(key);
+        };
+
+        for (const auto& user : users)
+        {
+            uint32_t roomId = user->getRoomId();
+            uint32_t leftId = user->getId();
+
+            // Close abandoned game; the game, not its host, is what leaves the room
+            if (const auto it = hostedGames.find(user->getName()); it != hostedGames.end())
+            {
+                const Game* game = it->second;
+                add(WormsPacket::freeze(PacketCode::Leave, {.value2 = game->getId(), .value10 = user->getId()}),
+                    PresenceKey::left(user->getId(), game->getId()));
+                add(WormsPacket::freeze(PacketCode::Close, {.value10 = game->getId()}),
+                    PresenceKey::gameClosed(game->getId()));
+
+                roomId = game->getRoomId();
+                leftId = game->getId();
+            }
+
+            if (database->getRoom(roomId) != nullptr)
+            {
+                add(WormsPacket::freeze(PacketCode::Leave, {.value2 = roomId, .value10 = leftId}),
+                    PresenceKey::left(leftId, roomId));
+                leftRoomIds.push_back(roomId);
+            }
+        }
+
+        // Close abandoned rooms
+        for (const uint32_t roomId : database->removeEmptyRooms(leftRoomIds))
+        {
+            add(WormsPacket::freeze(PacketCode::Close, {.value10 = roomId}), PresenceKey::roomClosed(roomId));
+        }
+
+        // Notify other users we've disconnected
+        for (const uint32_t userId : userIds)
+        {
+            add(WormsPacket::freeze(PacketCode::DisconnectUser, {.value10 = userId}),
+                PresenceKey::disconnected(userId));
+        }
+
+        // A lone disconnect keeps its packets apart so slow outboxes can still cancel them against the
+        // matching Login, Join or Create; a storm is worth more as one buffer per survivor.
+        auto& presence = PresenceCoalescer::getInstance();
+        if (users.size() == 1)
+        {
+            for (size_t i = 0; i < packets.size(); ++i)
+            {
+                presence.publish(packets[i], 0, keys[i]);
+            }
+        }
+        else
+        {
+            presence.publish(JoinPackets(packets));
+        }
+
+        // Published, so a newcomer given one of these ids logs in after the notifications naming it.
+        for (const uint32_t userId : userIds)
+        {
+            Database::recycleId(userId);
+        }
+    }
+} // namespace worms_server
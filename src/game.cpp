@@ -10,8 +10,7 @@ namespace worms_server
 {
     Game::Game(const uint32_t id, const std::string_view name, const Nation nation, const uint32_t roomId,
                asio::ip::address_v4 address, const SessionAccess access) :
-        id_(id), name_(name), sessionInfo_{nation, SessionType::Game, access}, address_(std::move(address)),
-        roomId_(roomId)
+        id_(id), roomId_(roomId), name_(name), nation_(nation), access_(access), address_(std::move(address))
     {
     }
 
@@ -22,12 +21,17 @@ namespace worms_server
 
     std::string_view Game::getName() const
     {
-        return name_;
+        return name_.view();
     }
 
-    const SessionInfo& Game::getSessionInfo() const
+    Nation Game::getNation() const
     {
-        return sessionInfo_;
+        return nation_;
+    }
+
+    SessionInfo Game::getSessionInfo() const
+    {
+        return {nation_, SessionType::Game, access_};
     }
 
     asio::ip::address_v4 Game::getAddress() const
@@ -0,0 +1,256 @@
+#include "handler_timing.hpp"
+
+#include <cmath>
+#include <format>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+namespace
+{
+    using namespace worms_server;
+
+    constexpr size_t NO_SLOT = RATE_LIMITED_CODES.size();
+
+    constexpr std::array<std::string_view, RATE_LIMITED_CODES.size()> CODE_NAMES{
+        "ListRooms", "ListUsers", "ListGames", "CreateRoom", "Join",
+        "Leave",     "Close",     "CreateGame", "ChatRoom",  "ConnectGame",
+    };
+
+    constexpr uint32_t SLOW_LOGS_PER_SECOND = 10;
+
+    size_t SlotOf(const PacketCode code)
+    {
+        return static_cast<size_t>(std::ranges::find(RATE_LIMITED_CODES, code) - RATE_LIMITED_CODES.begin());
+    }
+
+    // One thread's histograms. Recorded only by its own thread; read by GetHandlerStats.
+    struct HandlerShard
+    {
+        std::array<LatencyHistogram, RATE_LIMITED_CODES.size()> handler;
+        std::array<LatencyHistogram, RATE_LIMITED_CODES.size()> endToEnd;
+        std::array<std::atomic<uint64_t>, RATE_LIMITED_CODES.size()> slow{};
+    };
+
+    // Shards stay registered after their thread exits, so nothing recorded is lost.
+    std::mutex shardsMutex;
+    std::vector<std::shared_ptr<HandlerShard>> shards;
+
+    // Written once at startup, before any session runs.
+    int64_t slowThreshold = 0;
+
+    // The second the slow log is currently counting in, and how many lines it has written in it.
+    std::atomic<int64_t> slowLogSecond{0};
+    std::atomic<uint32_t> slowLogLines{0};
+    std::atomic<uint64_t> slowLogSuppressed{0};
+
+    HandlerShard& LocalShard()
+    {
+        thread_local std::shared_ptr<HandlerShard> shard;
+        if (shard == nullptr)
+        {
+            shard = std::make_shared<HandlerShard>();
+            const std::scoped_lock lock(shardsMutex);
+            shards.push_back(shard);
+        }
+        return *shard;
+    }
+
+    // Admits up to SLOW_LOGS_PER_SECOND lines per second, and counts the rest.
+    bool AdmitSlowLog(const ServerClock::time_point now)
+    {
+        const int64_t second = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
+        if (int64_t current = slowLogSecond.load(std::memory_order_relaxed);
+            current != second && slowLogSecond.compare_exchange_strong(current, second, std::memory_order_relaxed))
+        {
+            slowLogLines.store(0, std::memory_order_relaxed);
+        }
+
+        if (slowLogLines.fetch_add(1, std::memory_order_relaxed) < SLOW_LOGS_PER_SECOND)
+        {
+            return true;
+        }
+
+        slowLogSuppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    void AppendSummary(std::string& out, const std::string_view name, const std::string_view code,
+                       const LatencySummary& latency)
+    {
+        const auto seconds = [](const std::chrono::nanoseconds value)
+        {
+            return std::chrono::duration<double>(value).count();
+        };
+
+        for (const auto& [quantile, value] : {std::pair{"0.5", latency.p50}, std::pair{"0.9", latency.p90},
+                                              std::pair{"0.99", latency.p99}, std::pair{"0.999", latency.p999}})
+        {
+            std::format_to(std::back_inserter(out), "{}{{code=\"{}\",quantile=\"{}\"}} {}\n", name, code, quantile,
+                           seconds(value));
+        }
+        std::format_to(std::back_inserter(out), "{}_sum{{code=\"{}\"}} {}\n{}_count{{code=\"{}\"}} {}\n", name, code,
+                       seconds(latency.sum), name, code, latency.count);
+    }
+}
+
+namespace worms_server
+{
+    void LatencyHistogram::addTo(std::array<uint64_t, BUCKETS>& counts, uint64_t& sum) const
+    {
+        for (size_t index = 0; index < BUCKETS; ++index)
+        {
+            counts[index] += counts_[index].load(std::memory_order_relaxed);
+        }
+        sum += sum_.load(std::memory_order_relaxed);
+    }
+
+    LatencySummary SummarizeLatency(const std::array<uint64_t, LatencyHistogram::BUCKETS>& counts, const uint64_t sum)
+    {
+        LatencySummary result;
+        for (const auto count : counts)
+        {
+            result.count += count;
+        }
+
+        if (result.count == 0)
+        {
+            return result;
+        }
+
+        result.sum = std::chrono::nanoseconds(sum);
+        const auto percentile = [&](const double fraction)
+        {
+            const auto rank = std::max<uint64_t>(
+                1, static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(result.count))));
+            uint64_t seen = 0;
+            for (size_t index = 0; index < counts.size(); ++index)
+            {
+                seen += counts[index];
+                if (seen >= rank)
+                {
+                    return std::chrono::nanoseconds(LatencyHistogram::highestIn(index));
+                }
+            }
+            return std::chrono::nanoseconds(LatencyHistogram::highestIn(counts.size() - 1));
+        };
+
+        result.p50 = percentile(0.5);
+        result.p90 = percentile(0.9);
+        result.p99 = percentile(0.99);
+        result.p999 = percentile(0.999);
+        result.max = percentile(1.0);
+        return result;
+    }
+
+    void SetSlowHandlerThreshold(const std::chrono::milliseconds threshold)
+    {
+        slowThreshold = std::chrono::duration_cast<ServerClock::duration>(threshold).count();
+    }
+
+    void BeginDispatch()
+    {
+        currentDispatch = {.active = true};
+    }
+
+    void FinishDispatch(const PacketCode code, const std::string_view userName,
+                        const ServerClock::time_point received, const ServerClock::time_point started)
+    {
+        const auto finished = ServerClock::now();
+        const auto trace = std::exchange(currentDispatch, {});
+
+        const size_t slot = SlotOf(code);
+        if (slot == NO_SLOT)
+        {
+            return;
+        }
+
+        // A handler that queued nothing is done when it returns.
+        const auto endToEnd = (trace.enqueued != 0 ? trace.lastEnqueue : finished) - received;
+        auto& shard = LocalShard();
+        shard.handler[slot].record(finished - started);
+        shard.endToEnd[slot].record(endToEnd);
+
+        if (slowThreshold == 0 || endToEnd.count() < slowThreshold)
+        {
+            return;
+        }
+
+        shard.slow[slot].fetch_add(1, std::memory_order_relaxed);
+        if (AdmitSlowLog(finished))
+        {
+            const auto micros = [](const ServerClock::duration value)
+            {
+                return std::chrono::duration_cast<std::chrono::microseconds>(value).count();
+            };
+
+            const uint64_t suppressed = slowLogSuppressed.exchange(0, std::memory_order_relaxed);
+            spdlog::warn("Slow {} from {}: {} us in the handler, {} us end to end, {} packets queued{}",
+                         CODE_NAMES[slot], userName, micros(finished - started), micros(endToEnd), trace.enqueued,
+                         suppressed == 0 ? "" : std::format(" ({} slow packets not logged)", suppressed));
+        }
+    }
+
+    HandlerStats GetHandlerStats()
+    {
+        std::vector<std::shared_ptr<HandlerShard>> snapshot;
+        {
+            const std::scoped_lock lock(shardsMutex);
+            snapshot = shards;
+        }
+
+        HandlerStats stats{};
+        std::array<uint64_t, LatencyHistogram::BUCKETS> counts{};
+        for (size_t slot = 0; slot < RATE_LIMITED_CODES.size(); ++slot)
+        {
+            uint64_t sum = 0;
+            counts.fill(0);
+            for (const auto& shard : snapshot)
+            {
+                shard->handler[slot].addTo(counts, sum);
+            }
+            stats[slot].handler = SummarizeLatency(counts, sum);
+
+            sum = 0;
+            counts.fill(0);
+            for (const auto& shard : snapshot)
+            {
+                shard->endToEnd[slot].addTo(counts, sum);
+                stats[slot].slow += shard->slow[slot].load(std::memory_order_relaxed);
+            }
+            stats[slot].endToEnd = SummarizeLatency(counts, sum);
+        }
+        return stats;
+    }
+
+    void AppendHandlerMetrics(std::string& out)
+    {
+        const auto stats = GetHandlerStats();
+
+        out += "# HELP worms_handler_seconds Time spent in PacketHandler, by code\n"
+            "# TYPE worms_handler_seconds summary\n";
+        for (size_t slot = 0; slot < stats.size(); ++slot)
+        {
+            AppendSummary(out, "worms_handler_seconds", CODE_NAMES[slot], stats[slot].handler);
+        }
+
+        out += "# HELP worms_handler_end_to_end_seconds From receiving a packet to the last packet its handler "
+            "queued, by code\n# TYPE worms_handler_end_to_end_seconds summary\n";
+        for (size_t slot = 0; slot < stats.size(); ++slot)
+        {
+            AppendSummary(out, "worms_handler_end_to_end_seconds", CODE_NAMES[slot], stats[slot].endToEnd);
+        }
+
+        out += "# HELP worms_slow_handlers_total Packets over the slow handler threshold, by code\n"
+            "# TYPE worms_slow_handlers_total counter\n";
+        for (size_t slot = 0; slot < stats.size(); ++slot)
+        {
+            std::format_to(std::back_inserter(out), "worms_slow_handlers_total{{code=\"{}\"}} {}\n", CODE_NAMES[slot],
+                           stats[slot].slow);
+        }
+    }
+} // namespace worms_server
@@ -0,0 +1,69 @@
+#include "id_translation.hpp"
+
+#include "worms_packet.hpp"
+
+namespace worms_server
+{
+    void IdTranslation::learn(const WormsPacket& original, const WormsPacket& translated)
+    {
+        if (!assignsId(original.code()) || original.code() != translated.code())
+        {
+            return;
+        }
+
+        const auto& from = original.fields();
+        const auto& to = translated.fields();
+        if (from.error.value_or(1) != 0 || to.error.value_or(1) != 0 || from.value1.value_or(0) == 0
+            || to.value1.value_or(0) == 0)
+        {
+            return;
+        }
+
+        // Both servers reuse freed ids, so a later pairing replaces an earlier one.
+        const std::scoped_lock lock(mutex_);
+        ids_.insert_or_assign(*from.value1, *to.value1);
+    }
+
+    uint32_t IdTranslation::translate(const uint32_t original) const
+    {
+        const std::scoped_lock lock(mutex_);
+        const auto it = ids_.find(original);
+        return it == ids_.end() ? original : it->second;
+    }
+
+    bool IdTranslation::translateFields(PacketFields& fields) const
+    {
+        bool changed = false;
+        const std::scoped_lock lock(mutex_);
+        for (auto* value : {&fields.value0, &fields.value2, &fields.value3, &fields.value10})
+        {
+            const auto it = *value ? ids_.find(**value) : ids_.end();
+            if (it != ids_.end() && it->second != **value)
+            {
+                *value = it->second;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    std::vector<net::byte> IdTranslation::rewrite(const std::span<const net::byte> frame) const
+    {
+        auto reader = net::packet_reader(frame);
+        const auto [status, packet, error] = WormsPacket::readFrom(reader);
+        if (status != net::packet_parse_status::complete)
+        {
+            return {frame.begin(), frame.end()};
+        }
+
+        auto fields = (*packet)->fields();
+        if (!translateFields(fields))
+        {
+            return {frame.begin(), frame.end()};
+        }
+
+        const auto rewritten = WormsPacket::freeze((*packet)->code(), std::move(fields));
+        const auto bytes = rewritten->bytes();
+        return {bytes.begin(), bytes.end()};
+    }
+} // namespace worms_server
@@ -0,0 +1,317 @@
+#include "loop_monitor.hpp"
+
+#include <algorithm>
+#include <array>
+#include <format>
+#include <iterator>
+
+#include "spdlog/spdlog.h"
+
+#include "recycling_allocator.hpp"
+
+namespace worms_server
+{
+    // One io thread's lag histogram and current activity. Written by its own thread, read by the watchdog;
+    // an activity read while it changes may pair one activity's name with another's start, which only
+    // blurs a report.
+    struct LoopThreadSlot
+    {
+        LatencyHistogram lag;
+        std::atomic<int64_t> lastProbe{0};
+        std::atomic<const char*> what{nullptr};
+        std::atomic<uint32_t> code{0};
+        std::atomic<int64_t> since{0};
+        std::atomic<uint64_t> stalls{0};
+    };
+}
+
+namespace
+{
+    using namespace worms_server;
+
+    constexpr auto PROBE_INTERVAL = std::chrono::milliseconds(50);
+
+    thread_local LoopThreadSlot* currentSlot = nullptr;
+
+    // Real time rather than ServerClock: a stall is measured against the wall even under virtual time.
+    int64_t NowNanoseconds()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    int64_t Milliseconds(const int64_t nanoseconds)
+    {
+        return nanoseconds / 1'000'000;
+    }
+}
+
+namespace worms_server
+{
+    LoopActivity::LoopActivity(const char* what, const uint32_t code) :
+        slot_(currentSlot)
+    {
+        if (slot_ == nullptr)
+        {
+            return;
+        }
+
+        previousWhat_ = slot_->what.load(std::memory_order_relaxed);
+        previousCode_ = slot_->code.load(std::memory_order_relaxed);
+        previousSince_ = slot_->since.load(std::memory_order_relaxed);
+        slot_->since.store(NowNanoseconds(), std::memory_order_relaxed);
+        slot_->code.store(code, std::memory_order_relaxed);
+        slot_->what.store(what, std::memory_order_release);
+    }
+
+    LoopActivity::~LoopActivity()
+    {
+        if (slot_ == nullptr)
+        {
+            return;
+        }
+
+        // An enclosing activity resumes with its own start time, so it is not reported as fresh.
+        slot_->since.store(previousSince_, std::memory_order_relaxed);
+        slot_->code.store(previousCode_, std::memory_order_relaxed);
+        slot_->what.store(previousWhat_, std::memory_order_release);
+    }
+
+    std::atomic<bool> LoopMonitor::enabled_{false};
+
+    LoopMonitor& LoopMonitor::getInstance()
+    {
+        static LoopMonitor instance;
+        return instance;
+    }
+
+    void LoopMonitor::start(asio::io_context& context, const size_t threads,
+                            const std::chrono::milliseconds stallThreshold)
+    {
+        threads_.clear();
+        for (size_t index = 0; index < threads; ++index)
+        {
+            threads_.push_back(std::make_unique<LoopThreadSlot>());
+        }
+
+        // One probe per thread, so a single stuck thread holding a probe does not blind the others.
+        probeCount_ = threads;
+        probeDue_ = std::make_unique<std::atomic<int64_t>[]>(probeCount_);
+        stallThreshold_ = std::chrono::duration_cast<std::chrono::nanoseconds>(stallThreshold).count();
+
+        for (size_t index = 0; index < probeCount_; ++index)
+        {
+            co_spawn(context, probe(index), Recycled(asio::detached));
+        }
+
+        watchdog_ = std::jthread([this](const std::stop_token& stop) { watch(stop); });
+        enabled_.store(true, std::memory_order_release);
+        spdlog::info("Watching {} io threads for stalls over {} ms", threads, stallThreshold.count());
+    }
+
+    void LoopMonitor::stop()
+    {
+        if (!enabled_.exchange(false))
+        {
+            return;
+        }
+
+        watchdog_.request_stop();
+        watchdog_.join();
+    }
+
+    void LoopMonitor::attach(const size_t index)
+    {
+        if (index < threads_.size())
+        {
+            currentSlot = threads_[index].get();
+        }
+    }
+
+    std::vector<LoopThreadStats> LoopMonitor::stats() const
+    {
+        std::vector<LoopThreadStats> stats;
+        stats.reserve(threads_.size());
+
+        std::array<uint64_t, LatencyHistogram::BUCKETS> counts{};
+        for (const auto& slot : threads_)
+        {
+            uint64_t sum = 0;
+            counts.fill(0);
+            slot->lag.addTo(counts, sum);
+            stats.push_back({.lag = SummarizeLatency(counts, sum),
+                             .stalls = slot->stalls.load(std::memory_order_relaxed)});
+        }
+        return stats;
+    }
+
+    void LoopMonitor::logReport() const
+    {
+        const auto micros = [](const std::chrono::nanoseconds value)
+        {
+            return std::chrono::duration_cast<std::chrono::microseconds>(value).count();
+        };
+
+        const auto threads = stats();
+        for (size_t index = 0; index < threads.size(); ++index)
+        {
+            if (const auto& [lag, stalls] = threads[index]; lag.count != 0 || stalls != 0)
+            {
+                spdlog::info("Io thread {}: {} probes, lag p50 {} us, p99 {} us, max {} us; {} stalls", index,
+                             lag.count, micros(lag.p50), micros(lag.p99), micros(lag.max), stalls);
+            }
+        }
+
+        if (const auto stalls = loopStalls_.load(std::memory_order_relaxed); stalls != 0)
+        {
+            spdlog::info("Event loop: {} stalls with a probe overdue", stalls);
+        }
+    }
+
+    void LoopMonitor::appendMetrics(std::string& out) const
+    {
+        const auto seconds = [](const std::chrono::nanoseconds value)
+        {
+            return std::chrono::duration<double>(value).count();
+        };
+
+        const auto threads = stats();
+        out += "# HELP worms_loop_lag_seconds How late a periodic timer ran on each io thread\n"
+            "# TYPE worms_loop_lag_seconds summary\n";
+        for (size_t index = 0; index < threads.size(); ++index)
+        {
+            const auto& lag = threads[index].lag;
+            for (const auto& [quantile, value] : {std::pair{"0.5", lag.p50}, std::pair{"0.9", lag.p90},
+                                                  std::pair{"0.99", lag.p99}, std::pair{"0.999", lag.p999}})
+            {
+                std::format_to(std::back_inserter(out), "worms_loop_lag_seconds{{thread=\"{}\",quantile=\"{}\"}} {}\n",
+                               index, quantile, seconds(value));
+            }
+            std::format_to(std::back_inserter(out), "worms_loop_lag_seconds_sum{{thread=\"{}\"}} {}\n"
+                           "worms_loop_lag_seconds_count{{thread=\"{}\"}} {}\n", index, seconds(lag.sum), index,
+                           lag.count);
+        }
+
+        out += "# HELP worms_loop_stalls_total Io threads stuck in one activity past the stall threshold\n"
+            "# TYPE worms_loop_stalls_total counter\n";
+        for (size_t index = 0; index < threads.size(); ++index)
+        {
+            std::format_to(std::back_inserter(out), "worms_loop_stalls_total{{thread=\"{}\"}} {}\n", index,
+                           threads[index].stalls);
+        }
+    }
+
+    asio::awaitable<void> LoopMonitor::probe(const size_t index)
+    {
+        asio::steady_timer timer(co_await asio::this_coro::executor);
+
+        // Staggered so the probes do not all wake on the same tick.
+        std::chrono::steady_clock::time_point due =
+            std::chrono::steady_clock::now() + PROBE_INTERVAL * static_cast<int64_t>(index + 1) /
+            static_cast<int64_t>(probeCount_);
+        while (true)
+        {
+            timer.expires_at(due);
+            const auto dueAt = std::chrono::duration_cast<std::chrono::nanoseconds>(due.time_since_epoch());
+            probeDue_[index].store(dueAt.count(), std::memory_order_relaxed);
+
+            asio::error_code ec;
+            co_await timer.async_wait(Recycled(asio::redirect_error(asio::use_awaitable, ec)));
+            if (ec)
+            {
+                break;
+            }
+
+            const auto now = std::chrono::steady_clock::now();
+            probeDue_[index].store(0, std::memory_order_relaxed);
+            if (auto* slot = currentSlot)
+            {
+                slot->lag.record(now - due);
+                slot->lastProbe.store(NowNanoseconds(), std::memory_order_relaxed);
+            }
+
+            // Counted from now, so ticks missed in a stall are not recorded again as a burst of late probes.
+            due = now + PROBE_INTERVAL;
+        }
+    }
+
+    void LoopMonitor::watch(const std::stop_token& stop)
+    {
+        const auto interval = std::clamp(std::chrono::nanoseconds(stallThreshold_ / 4),
+                                         std::chrono::nanoseconds(std::chrono::milliseconds(10)),
+                                         std::chrono::nanoseconds(std::chrono::milliseconds(100)));
+
+        // Each stall is reported once, when it crosses the threshold.
+        bool loopStalled = false;
+        std::vector<int64_t> reportedSince(threads_.size(), 0);
+
+        while (!stop.stop_requested())
+        {
+            std::this_thread::sleep_for(interval);
+            const int64_t now = NowNanoseconds();
+
+            // A probe nobody has run means every io thread is busy or blocked.
+            int64_t overdue = 0;
+            for (size_t index = 0; index < probeCount_; ++index)
+            {
+                if (const int64_t due = probeDue_[index].load(std::memory_order_relaxed); due != 0)
+                {
+                    overdue = std::max(overdue, now - due);
+                }
+            }
+
+            if (overdue > stallThreshold_ && !loopStalled)
+            {
+                loopStalls_.fetch_add(1, std::memory_order_relaxed);
+                spdlog::warn("Event loop stalled: a timer is {} ms overdue. {}", Milliseconds(overdue), snapshot(now));
+            }
+            loopStalled = overdue > stallThreshold_;
+
+            for (size_t index = 0; index < threads_.size(); ++index)
+            {
+                auto& slot = *threads_[index];
+                const char* what = slot.what.load(std::memory_order_acquire);
+                const int64_t since = slot.since.load(std::memory_order_relaxed);
+                if (what == nullptr || now - since <= stallThreshold_ || reportedSince[index] == since)
+                {
+                    continue;
+                }
+
+                reportedSince[index] = since;
+                slot.stalls.fetch_add(1, std::memory_order_relaxed);
+                const uint32_t code = slot.code.load(std::memory_order_relaxed);
+                spdlog::warn("Io thread {} stalled: {} ms in {}{}. {}", index, Milliseconds(now - since), what,
+                             code == 0 ? "" : std::format(" {}", code), snapshot(now));
+            }
+        }
+    }
+
+    std::string LoopMonitor::snapshot(const int64_t now) const
+    {
+        std::string out = "Io threads:";
+        for (size_t index = 0; index < threads_.size(); ++index)
+        {
+            const auto& slot = *threads_[index];
+            const char* what = slot.what.load(std::memory_order_acquire);
+            const uint32_t code = slot.code.load(std::memory_order_relaxed);
+            const int64_t since = slot.since.load(std::memory_order_relaxed);
+
+            std::format_to(std::back_inserter(out), "{} [{}] ", index == 0 ? "" : ";", index);
+            if (what == nullptr)
+            {
+                const int64_t lastProbe = slot.lastProbe.load(std::memory_order_relaxed);
+                std::format_to(std::back_inserter(out), "idle or untracked, last probe {}",
+                               lastProbe == 0 ? "never" : std::format("{} ms ago", Milliseconds(now - lastProbe)));
+            }
+            else if (code != 0)
+            {
+                std::format_to(std::back_inserter(out), "{} {} for {} ms", what, code, Milliseconds(now - since));
+            }
+            else
+            {
+                std::format_to(std::back_inserter(out), "{} for {} ms", what, Milliseconds(now - since));
+            }
+        }
+        return out;
+    }
+} // namespace worms_server
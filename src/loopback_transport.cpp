@@ -0,0 +1,123 @@
+#include "loopback_transport.hpp"
+
+#include <cstring>
+
+#include "recycling_allocator.hpp"
+
+namespace worms_server
+{
+    LoopbackTransport::Queue::Queue(const asio::any_io_executor& executor) :
+        wake(executor, asio::steady_timer::time_point::max())
+    {
+    }
+
+    LoopbackTransport::Connection::Connection(const asio::any_io_executor& executor) :
+        toServer(executor), toClient(executor)
+    {
+    }
+
+    LoopbackTransport::LoopbackTransport(std::shared_ptr<Connection> connection, const bool serverEnd,
+                                         const asio::ip::address_v4 peer, asio::any_io_executor executor) :
+        connection_(std::move(connection)), serverEnd_(serverEnd), peer_(peer), executor_(std::move(executor))
+    {
+    }
+
+    std::pair<std::unique_ptr<LoopbackTransport>, std::unique_ptr<LoopbackTransport>> LoopbackTransport::createPair(
+        const asio::any_io_executor& executor, const asio::ip::address_v4 clientAddress)
+    {
+        auto connection = std::make_shared<Connection>(executor);
+        std::unique_ptr<LoopbackTransport> server(
+            new LoopbackTransport(connection, true, clientAddress, executor));
+        std::unique_ptr<LoopbackTransport> client(
+            new LoopbackTransport(std::move(connection), false, asio::ip::address_v4::loopback(), executor));
+        return {std::move(server), std::move(client)};
+    }
+
+    asio::any_io_executor LoopbackTransport::executor()
+    {
+        return executor_;
+    }
+
+    asio::ip::address_v4 LoopbackTransport::remoteAddress() const
+    {
+        return peer_;
+    }
+
+    bool LoopbackTransport::isOpen() const
+    {
+        return !connection_->closed;
+    }
+
+    asio::awaitable<size_t> LoopbackTransport::receive(const asio::mutable_buffer buffer, asio::error_code& ec)
+    {
+        // Hold the connection, so the queue outlives this end if it is destroyed mid-wait.
+        const auto connection = connection_;
+        Queue& queue = incoming();
+
+        while (queue.head == queue.bytes.size() && !connection->closed)
+        {
+            queue.wake.expires_at(asio::steady_timer::time_point::max());
+            asio::error_code waitEc;
+            co_await queue.wake.async_wait(Recycled(asio::redirect_error(asio::use_awaitable, waitEc)));
+        }
+
+        const size_t available = queue.bytes.size() - queue.head;
+        if (available == 0)
+        {
+            ec = asio::error::eof;
+            co_return 0;
+        }
+
+        const size_t length = std::min(available, buffer.size());
+        std::memcpy(buffer.data(), queue.bytes.data() + queue.head, length);
+        queue.head += length;
+        if (queue.head == queue.bytes.size())
+        {
+            queue.bytes.clear();
+            queue.head = 0;
+        }
+
+        co_return length;
+    }
+
+    asio::awaitable<void> LoopbackTransport::write(const std::span<const asio::const_buffer> buffers,
+                                                   asio::error_code& ec)
+    {
+        if (connection_->closed)
+        {
+            ec = asio::error::broken_pipe;
+            co_return;
+        }
+
+        Queue& queue = outgoing();
+        for (const auto& buffer : buffers)
+        {
+            const auto* bytes = static_cast<const net::byte*>(buffer.data());
+            queue.bytes.insert(queue.bytes.end(), bytes, bytes + buffer.size());
+        }
+        queue.wake.cancel();
+        co_return;
+    }
+
+    void LoopbackTransport::close()
+    {
+        if (connection_->closed)
+        {
+            return;
+        }
+
+        connection_->closed = true;
+        connection_->toServer.wake.cancel();
+        connection_->toClient.wake.cancel();
+    }
+
+    LoopbackTransport::Queue& LoopbackTransport::incoming() const
+    {
+        return serverEnd_ ? connection_->toServer : connection_->toClient;
+    }
+
+    LoopbackTransport::Queue& LoopbackTransport::outgoing() const
+    {
+        return serverEnd_ ? connection_->toClient : connection_->toServer;
+    }
+} // namespace worms_server
@@ -0,0 +1,302 @@
+#include "metrics.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <iterator>
+#include <memory>
+#include <tuple>
+#include <variant>
+
+#include <asio/experimental/awaitable_operators.hpp>
+
+#include "spdlog/spdlog.h"
+
+#include "recycling_allocator.hpp"
+#include "span_tracer.hpp"
+#include "worms_packet.hpp"
+
+namespace
+{
+    using namespace worms_server;
+
+    // More shards than io threads, so threads only share one when the pool is unusually large.
+    constexpr size_t SHARDS = 64;
+
+    std::array<MetricShard, SHARDS> shards;
+    std::atomic<size_t> nextShard{0};
+
+    struct CounterInfo
+    {
+        std::string_view name;
+        std::string_view help;
+    };
+
+    constexpr std::array<CounterInfo, METRIC_COUNTERS> COUNTER_INFO{{
+        {"worms_connections_accepted_total", "Connections admitted"},
+        {"worms_connections_refused_total", "Connections refused at capacity or by the login caps"},
+        {"worms_logins_total", "Successful logins, including resumed sessions"},
+        {"worms_login_failures_total", "Connections that closed without logging in"},
+        {"worms_parse_errors_total", "Sessions dropped for malformed client data"},
+        {"worms_bytes_received_total", "Bytes read from clients"},
+        {"worms_bytes_sent_total", "Bytes written to clients"},
+    }};
+
+    constexpr std::array<CounterInfo, METRIC_GAUGES> GAUGE_INFO{{
+        {"worms_connections", "Open client connections"},
+    }};
+
+    constexpr std::array<CounterInfo, METRIC_HISTOGRAMS> HISTOGRAM_INFO{{
+        {"worms_outbox_depth", "Packets queued for a client each time its writer wakes"},
+        {"worms_broadcast_fanout", "Recipients of one broadcast"},
+    }};
+
+    constexpr size_t REQUEST_LIMIT = 4096;
+
+    // A scraper that connects and sends nothing is dropped after this, so it cannot hold a socket open.
+    constexpr auto REQUEST_TIMEOUT = std::chrono::seconds(5);
+
+    uint64_t SumShards(const auto& pick)
+    {
+        uint64_t total = 0;
+        for (const auto& shard : shards)
+        {
+            total += pick(shard).load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    void AppendHeader(std::string& out, const std::string_view name, const std::string_view help,
+                      const std::string_view type)
+    {
+        std::format_to(std::back_inserter(out), "# HELP {} {}\n# TYPE {} {}\n", name, help, name, type);
+    }
+
+    using PacketCounters = decltype(MetricShard::packetsIn);
+
+    void AppendPacketCounters(std::string& out, const std::string_view name, const std::string_view help,
+                              PacketCounters MetricShard::* counters)
+    {
+        AppendHeader(out, name, help, "counter");
+        for (size_t slot = 0; slot <= METERED_CODES.size(); ++slot)
+        {
+            const auto value = SumShards([&](const MetricShard& shard) -> const auto&
+            {
+                return (shard.*counters)[slot];
+            });
+            const auto code = slot < METERED_CODES.size() ? METERED_CODES[slot].second : "Other";
+            std::format_to(std::back_inserter(out), "{}{{code=\"{}\"}} {}\n", name, code, value);
+        }
+    }
+
+    asio::awaitable<void> AnswerScrape(asio::ip::tcp::socket socket)
+    {
+        using namespace asio::experimental::awaitable_operators;
+
+        // The read races the deadline on the socket's strand; whichever finishes first cancels the other, so
+        // nothing outlives the socket.
+        std::string request;
+        asio::steady_timer deadline(socket.get_executor(), REQUEST_TIMEOUT);
+        const auto outcome = co_await (
+            asio::async_read_until(socket, asio::dynamic_buffer(request, REQUEST_LIMIT), "\r\n\r\n",
+                                   Recycled(asio::as_tuple(asio::use_awaitable))) ||
+            deadline.async_wait(Recycled(asio::as_tuple(asio::use_awaitable))));
+        if (outcome.index() != 0 || std::get<0>(std::get<0>(outcome)))
+        {
+            co_return;
+        }
+
+        std::string response;
+        if (request.starts_with("GET /metrics ") || request.starts_with("GET /metrics?"))
+        {
+            const auto body = Metrics::getInstance().render();
+            response = std::format("HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                                   "Content-Length: {}\r\nConnection: close\r\n\r\n{}", body.size(), body);
+        }
+        else if (SpanTracer::enabled() && (request.starts_with("GET /trace ") || request.starts_with("GET /trace?")))
+        {
+            const auto body = co_await SpanTracer::getInstance().exportJson();
+            response = std::format("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                                   "Content-Length: {}\r\nConnection: close\r\n\r\n{}", body.size(), body);
+        }
+        else
+        {
+            response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        }
+
+        asio::error_code ec;
+        co_await asio::async_write(socket, asio::buffer(response),
+                                   Recycled(asio::redirect_error(asio::use_awaitable, ec)));
+        socket.shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+    }
+}
+
+namespace worms_server
+{
+    MetricShard& AssignMetricShard()
+    {
+        return shards[nextShard.fetch_add(1, std::memory_order_relaxed) % SHARDS];
+    }
+
+    void CountPacketsOut(std::span<const net::byte> buffer)
+    {
+        auto& shard = LocalMetricShard();
+        shard.counters[static_cast<size_t>(MetricCounter::BytesOut)].fetch_add(buffer.size(),
+                                                                             std::memory_order_relaxed);
+
+        // Joined presence buffers hold several frames back to back.
+        while (!buffer.empty())
+        {
+            const auto [status, length, error] = WormsPacket::peekFrameLength(buffer, PacketSource::Server);
+            if (status != net::packet_parse_status::complete)
+            {
+                break;
+            }
+
+            uint32_t code = 0;
+            std::memcpy(&code, buffer.data(), sizeof(code));
+            if constexpr (std::endian::native != std::endian::little)
+            {
+                code = std::byteswap(code);
+            }
+
+            const size_t slot = code < METERED_CODE_LIMIT ? METERED_CODE_SLOTS[code] : METERED_CODES.size();
+            shard.packetsOut[slot].fetch_add(1, std::memory_order_relaxed);
+            buffer = buffer.subspan(*length);
+        }
+    }
+
+    Metrics& Metrics::getInstance()
+    {
+        static Metrics instance;
+        return instance;
+    }
+
+    void Metrics::addGauge(std::string name, std::string help, std::function<double()> read)
+    {
+        const std::scoped_lock lock(gaugesMutex_);
+        gauges_.push_back({std::move(name), std::move(help), std::move(read)});
+    }
+
+    void Metrics::addCollector(std::function<void(std::string&)> append)
+    {
+        const std::scoped_lock lock(gaugesMutex_);
+        collectors_.push_back(std::move(append));
+    }
+
+    std::string Metrics::render() const
+    {
+        std::string out;
+        out.reserve(8192);
+
+        for (size_t index = 0; index < METRIC_COUNTERS; ++index)
+        {
+            const auto& [name, help] = COUNTER_INFO[index];
+            AppendHeader(out, name, help, "counter");
+            std::format_to(std::back_inserter(out), "{} {}\n", name,
+                           SumShards([&](const MetricShard& shard) -> const auto& { return shard.counters[index]; }));
+        }
+
+        for (size_t index = 0; index < METRIC_GAUGES; ++index)
+        {
+            const auto& [name, help] = GAUGE_INFO[index];
+            AppendHeader(out, name, help, "gauge");
+            const auto value = SumShards([&](const MetricShard& shard) -> const auto& { return shard.gauges[index]; });
+            std::format_to(std::back_inserter(out), "{} {}\n", name, static_cast<int64_t>(value));
+        }
+
+        {
+            const std::scoped_lock lock(gaugesMutex_);
+            for (const auto& [name, help, read] : gauges_)
+            {
+                AppendHeader(out, name, help, "gauge");
+                std::format_to(std::back_inserter(out), "{} {}\n", name, read());
+            }
+        }
+
+        AppendPacketCounters(out, "worms_packets_received_total", "Packets read from clients, by code",
+                             &MetricShard::packetsIn);
+        AppendPacketCounters(out, "worms_packets_sent_total", "Packets written to clients, by code",
+                             &MetricShard::packetsOut);
+
+        for (size_t index = 0; index < METRIC_HISTOGRAMS; ++index)
+        {
+            const auto& [name, help] = HISTOGRAM_INFO[index];
+            AppendHeader(out, name, help, "histogram");
+
+            // Bucket b holds values below 2^b, so its cumulative count is exported as le 2^b - 1.
+            uint64_t cumulative = 0;
+            for (size_t bucket = 0; bucket + 1 < HISTOGRAM_BUCKETS; ++bucket)
+            {
+                cumulative += SumShards([&](const MetricShard& shard) -> const auto&
+                {
+                    return shard.histograms[index].buckets[bucket];
+                });
+                std::format_to(std::back_inserter(out), "{}_bucket{{le=\"{}\"}} {}\n", name,
+                               (uint64_t{1} << bucket) - 1, cumulative);
+            }
+
+            cumulative += SumShards([&](const MetricShard& shard) -> const auto&
+            {
+                return shard.histograms[index].buckets[HISTOGRAM_BUCKETS - 1];
+            });
+            const auto sum = SumShards([&](const MetricShard& shard) -> const auto&
+            {
+                return shard.histograms[index].sum;
+            });
+            std::format_to(std::back_inserter(out), "{}_bucket{{le=\"+Inf\"}} {}\n{}_sum {}\n{}_count {}\n", name,
+                           cumulative, name, sum, name, cumulative);
+        }
+
+        {
+            const std::scoped_lock lock(gaugesMutex_);
+            for (const auto& append : collectors_)
+            {
+                append(out);
+            }
+        }
+
+        return out;
+    }
+
+    asio::awaitable<void> ServeMetrics(const uint16_t port)
+    {
+        const auto executor = co_await asio::this_coro::executor;
+        asio::ip::tcp::acceptor acceptor(executor);
+
+        asio::error_code ec;
+        const asio::ip::tcp::endpoint endpoint(asio::ip::address_v4::loopback(), port);
+        acceptor.open(endpoint.protocol(), ec);
+        if (!ec)
+        {
+            acceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true), ec);
+            acceptor.bind(endpoint, ec);
+        }
+        if (!ec)
+        {
+            acceptor.listen(asio::socket_base::max_listen_connections, ec);
+        }
+        if (ec)
+        {
+            spdlog::error("Failed to open the metrics endpoint on port {}: {}", port, ec.message());
+            co_return;
+        }
+
+        spdlog::info("Serving metrics on http://127.0.0.1:{}/metrics", port);
+        while (true)
+        {
+            // Each scrape runs on a strand of its own, which its read and deadline share.
+            asio::ip::tcp::socket socket(asio::make_strand(executor));
+            co_await acceptor.async_accept(socket, Recycled(asio::redirect_error(asio::use_awaitable, ec)));
+            if (ec == asio::error::operation_aborted)
+            {
+                break;
+            }
+            if (!ec)
+            {
+                auto strand = socket.get_executor();
+                co_spawn(strand, AnswerScrape(std::move(socket)), Recycled(asio::detached));
+            }
+        }
+    }
+} // namespace worms_server
@@ -0,0 +1,241 @@
+#include "packet_buffer.hpp"
+
+#include <array>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    using namespace worms_server;
+
+    // Block sizes including the header: replies, ListItem/presence packets, short chat, long chat.
+    constexpr std::array<size_t, 4> BLOCK_SIZES{64, 128, 256, 1024};
+    constexpr uint32_t HEAP_CLASS = BLOCK_SIZES.size();
+    constexpr uint32_t MAX_CACHED_PER_CLASS = 4096;
+
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    struct alignas(64) ThreadCache
+    {
+        std::array<FreeBlock*, BLOCK_SIZES.size()> local{};
+        std::array<uint32_t, BLOCK_SIZES.size()> localCount{};
+
+        // Blocks released by other threads; pushed lock-free, taken whole by the owner. An owner that stops
+        // allocating never takes its list, so pushes past MAX_CACHED_PER_CLASS go back to the heap instead.
+        std::array<std::atomic<FreeBlock*>, BLOCK_SIZES.size()> remote{};
+        std::array<std::atomic<uint32_t>, BLOCK_SIZES.size()> remoteCount{};
+
+        std::atomic<uint64_t> pooled{0};
+        std::atomic<uint64_t> heap{0};
+
+        ThreadCache* nextCache = nullptr;
+    };
+
+    // Caches are never freed, so blocks released after their owner thread exited always have a
+    // valid home. An exited thread's cache is adopted by the next thread that needs one.
+    std::atomic<ThreadCache*> allCaches{nullptr};
+    std::mutex orphansMutex;
+    std::vector<ThreadCache*> orphans;
+
+    ThreadCache* AdoptOrCreateCache()
+    {
+        {
+            const std::scoped_lock lock(orphansMutex);
+            if (!orphans.empty())
+            {
+                auto* cache = orphans.back();
+                orphans.pop_back();
+                return cache;
+            }
+        }
+
+        auto* cache = new ThreadCache();
+        cache->nextCache = allCaches.load(std::memory_order_relaxed);
+        while (!allCaches.compare_exchange_weak(cache->nextCache, cache, std::memory_order_release,
+                                                std::memory_order_relaxed))
+        {
+        }
+        return cache;
+    }
+
+    struct CacheHandle
+    {
+        ThreadCache* cache = AdoptOrCreateCache();
+
+        ~CacheHandle()
+        {
+            const std::scoped_lock lock(orphansMutex);
+            orphans.push_back(std::exchange(cache, nullptr));
+        }
+    };
+
+    thread_local CacheHandle cacheHandle;
+
+    // Only the owning thread writes the counters.
+    void Bump(std::atomic<uint64_t>& counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    uint32_t ClassFor(const size_t blockSize)
+    {
+        for (uint32_t i = 0; i < BLOCK_SIZES.size(); ++i)
+        {
+            if (blockSize <= BLOCK_SIZES[i])
+            {
+                return i;
+            }
+        }
+        return HEAP_CLASS;
+    }
+
+    void* TakeBlock(ThreadCache& cache, const uint32_t sizeClass)
+    {
+        if (cache.local[sizeClass] == nullptr)
+        {
+            cache.local[sizeClass] = cache.remote[sizeClass].exchange(nullptr, std::memory_order_acquire);
+            cache.localCount[sizeClass] = 0;
+            for (const auto* block = cache.local[sizeClass]; block != nullptr; block = block->next)
+            {
+                ++cache.localCount[sizeClass];
+            }
+
+            // Only what was taken: a push counted but not yet linked stays counted until the next take.
+            cache.remoteCount[sizeClass].fetch_sub(cache.localCount[sizeClass], std::memory_order_relaxed);
+        }
+
+        if (auto* block = cache.local[sizeClass])
+        {
+            cache.local[sizeClass] = block->next;
+            --cache.localCount[sizeClass];
+            Bump(cache.pooled);
+            return block;
+        }
+
+        Bump(cache.heap);
+        return ::operator new(BLOCK_SIZES[sizeClass]);
+    }
+
+    void ReturnBlock(ThreadCache& owner, void* memory, const uint32_t sizeClass)
+    {
+        auto* block = static_cast<FreeBlock*>(memory);
+
+        if (&owner == cacheHandle.cache)
+        {
+            if (owner.localCount[sizeClass] >= MAX_CACHED_PER_CLASS)
+            {
+                ::operator delete(memory);
+                return;
+            }
+
+            block->next = owner.local[sizeClass];
+            owner.local[sizeClass] = block;
+            ++owner.localCount[sizeClass];
+            return;
+        }
+
+        if (owner.remoteCount[sizeClass].fetch_add(1, std::memory_order_relaxed) >= MAX_CACHED_PER_CLASS)
+        {
+            owner.remoteCount[sizeClass].fetch_sub(1, std::memory_order_relaxed);
+            ::operator delete(memory);
+            return;
+        }
+
+        block->next = owner.remote[sizeClass].load(std::memory_order_relaxed);
+        while (!owner.remote[sizeClass].compare_exchange_weak(block->next, block, std::memory_order_release,
+                                                              std::memory_order_relaxed))
+        {
+        }
+    }
+}
+
+namespace worms_server
+{
+    PacketBuffer::PacketBuffer(const uint32_t size, const uint32_t sizeClass, void* owner) :
+        size_(size), sizeClass_(sizeClass), owner_(owner)
+    {
+    }
+
+    PacketBufferPtr PacketBuffer::allocate(const size_t size)
+    {
+        const size_t blockSize = sizeof(PacketBuffer) + size;
+        const uint32_t sizeClass = ClassFor(blockSize);
+        auto* cache = cacheHandle.cache;
+
+        if (sizeClass == HEAP_CLASS || cache == nullptr)
+        {
+            // Oversized, or allocated while this thread is shutting down.
+            if (cache != nullptr)
+            {
+                Bump(cache->heap);
+            }
+            void* memory = ::operator new(blockSize);
+            return PacketBufferPtr(new (memory) PacketBuffer(static_cast<uint32_t>(size), HEAP_CLASS, nullptr));
+        }
+
+        void* memory = TakeBlock(*cache, sizeClass);
+        return PacketBufferPtr(new (memory) PacketBuffer(static_cast<uint32_t>(size), sizeClass, cache));
+    }
+
+    void PacketBuffer::release()
+    {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        {
+            return;
+        }
+
+        const uint32_t sizeClass = sizeClass_;
+        auto* owner = static_cast<ThreadCache*>(owner_);
+        this->~PacketBuffer();
+
+        if (sizeClass == HEAP_CLASS)
+        {
+            ::operator delete(static_cast<void*>(this));
+            return;
+        }
+
+        ReturnBlock(*owner, this, sizeClass);
+    }
+
+    PacketPoolStats GetPacketPoolStats()
+    {
+        PacketPoolStats stats;
+        for (const auto* cache = allCaches.load(std::memory_order_acquire); cache != nullptr;
+             cache = cache->nextCache)
+        {
+            stats.pooled += cache->pooled.load(std::memory_order_relaxed);
+            stats.heap += cache->heap.load(std::memory_order_relaxed);
+        }
+        return stats;
+    }
+
+    PacketBufferPtr JoinPackets(const std::span<const PacketBufferPtr> packets)
+    {
+        if (packets.size() <= 1)
+        {
+            return packets.empty() ? nullptr : packets.front();
+        }
+
+        size_t totalSize = 0;
+        for (const auto& packet : packets)
+        {
+            totalSize += packet->size();
+        }
+
+        return PacketBuffer::create(totalSize, [&](const std::span<net::byte> target)
+        {
+            size_t offset = 0;
+            for (const auto& packet : packets)
+            {
+                std::memcpy(target.data() + offset, packet->data(), packet->size());
+                offset += packet->size();
+            }
+        });
+    }
+} // namespace worms_server
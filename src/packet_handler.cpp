@@ -6,12 +6,17 @@
 
 #include "spdlog/spdlog.h"
 
+#include <array>
 #include <string_view>
+#include <vector>
 #include "database.hpp"
 #include "game.hpp"
+#include "handler_timing.hpp"
+#include "loop_monitor.hpp"
+#include "metrics.hpp"
 #include "packet_code.hpp"
+#include "presence_coalescer.hpp"
 #include "room.hpp"
-#include "string_utils.hpp"
 #include "user.hpp"
 #include "worms_packet.hpp"
 
@@ -24,16 +29,10 @@ namespace
     awaitable<void> LeaveRoom(std::shared_ptr<Room> room, uint32_t leftId)
     {
         const auto database = Database::getInstance();
-        const auto users = database->getUsers();
         const uint32_t roomId = room == nullptr ? 5 : room->getId();
 
-        const bool roomClosed = room != nullptr && !std::ranges::any_of(users, [leftId, roomId](const auto& user)
-        {
-            return user->getId() != leftId && user->getRoomId() == roomId;
-        }) && !std::ranges::any_of(database->getGames(), [leftId, roomId](const auto& game)
-        {
-            return game->getId() != leftId && game->getRoomId() == roomId;
-        });
+        const bool roomClosed =
+            room != nullptr && !database->hasUsersInRoom(roomId, leftId) && !database->hasGamesInRoom(roomId, leftId);
 
         if (roomClosed)
         {
@@ -44,22 +43,15 @@ namespace
             WormsPacket::freeze(PacketCode::Leave, {.value2 = roomId, .value10 = leftId});
         const auto roomClosePacketBytes = WormsPacket::freeze(PacketCode::Close, {.value10 = roomId});
 
-        for (const auto& user : users)
+        auto& presence = PresenceCoalescer::getInstance();
+        if (room != nullptr)
         {
-            if (user->getId() == leftId)
-            {
-                continue;
-            }
-
-            if (room != nullptr)
-            {
-                user->sendPacket(roomLeavePacketBytes);
-            }
+            presence.publish(roomLeavePacketBytes, leftId, PresenceKey::left(leftId, roomId));
+        }
 
-            if (roomClosed)
-            {
-                user->sendPacket(roomClosePacketBytes);
-            }
+        if (roomClosed)
+        {
+            presence.publish(roomClosePacketBytes, leftId, PresenceKey::roomClosed(roomId));
         }
 
         co_return;
@@ -90,21 +82,24 @@ namespace
                 const auto packetBytes = WormsPacket::freeze(
                     PacketCode::ChatRoom, {.value0 = clientId, .value3 = clientRoomId, .data = message.data()});
 
-                for (const auto& user : database->getUsers())
+                size_t recipients = 0;
+                for (const auto& user : database->getUsersInRoom(clientRoomId))
                 {
-                    if (user->getRoomId() == clientRoomId && user->getId() != clientId)
+                    if (user->getId() != clientId)
                     {
-                        user->sendPacket(packetBytes);
+                        user->sendPacket(packetBytes, PresenceKey::relayed(clientId, clientRoomId));
+                        ++recipients;
                     }
                 }
+                ObserveMetric(MetricHistogram::BroadcastFanout, recipients);
 
                 // Notify sender
-                clientUser->sendPacket(WormsPacket::freeze(PacketCode::ChatRoomReply, {.error = 0}));
+                clientUser->sendReply(WormsPacket::freeze(PacketCode::ChatRoomReply, {.error = 0}));
                 co_return true;
             }
 
             // Notify sender
-            clientUser->sendPacket(WormsPacket::freeze(PacketCode::ChatRoomReply, {.error = 1}));
+            clientUser->sendReply(WormsPacket::freeze(PacketCode::ChatRoomReply, {.error = 1}));
             co_return true;
         }
 
@@ -113,16 +108,17 @@ namespace
             const auto& targetUser = database->getUser(targetId);
             if (targetUser == nullptr || targetUser->getRoomId() != clientRoomId)
             {
-                clientUser->sendPacket(WormsPacket::freeze(PacketCode::ChatRoomReply, {.error = 1}));
+                clientUser->sendReply(WormsPacket::freeze(PacketCode::ChatRoomReply, {.error = 1}));
                 co_return true;
             }
 
             // Notify Target
-            targetUser->sendPacket(WormsPacket::freeze(
-                PacketCode::ChatRoom, {.value0 = clientId, .value3 = targetId, .data = message.data()}));
+            targetUser->sendPacket(WormsPacket::freeze(PacketCode::ChatRoom, {.value0 = clientId, .value3 = targetId,
+                                                                               .data = message.data()}),
+                                   PresenceKey::relayed(clientId, clientRoomId));
 
             // Notify Sender
-            clientUser->sendPacket(WormsPacket::freeze(PacketCode::ChatRoomReply, {.error = 0}));
+            clientUser->sendReply(WormsPacket::freeze(PacketCode::ChatRoomReply, {.error = 0}));
             co_return true;
         }
 
@@ -138,16 +134,18 @@ namespace
             co_return false;
         }
 
+        std::vector<PacketBufferPtr> items;
         for (const auto rooms = database->getRooms(); const auto& room : rooms)
         {
-            clientUser->sendPacket(
+            items.push_back(
                 WormsPacket::freeze(PacketCode::ListItem, {.value1 = room->getId(),
                                                            .name = std::string(room->getName()),
                                                            .data = "",
                                                            .info = room->getSessionInfo()}));
         }
 
-        clientUser->sendPacket(WormsPacket::getListEndPacket());
+        items.push_back(WormsPacket::getListEndPacket());
+        clientUser->sendSnapshot(items);
 
         co_return true;
     }
@@ -162,23 +160,18 @@ namespace
             co_return false;
         }
 
-        const auto users = database->getUsers();
-        const auto roomId = clientUser->getRoomId();
-        for (const auto& user : users)
+        std::vector<PacketBufferPtr> items;
+        for (const auto& user : database->getUsersInRoom(clientUser->getRoomId()))
         {
-            if (user->getRoomId() != roomId)
-            {
-                continue;
-            }
-
-            clientUser->sendPacket(
+            items.push_back(
                 WormsPacket::freeze(PacketCode::ListItem, {.value1 = user->getId(),
                                                            .name = std::string(user->getName()),
                                                            .data = "",
                                                            .info = user->getSessionInfo()}));
         }
 
-        clientUser->sendPacket(WormsPacket::getListEndPacket());
+        items.push_back(WormsPacket::getListEndPacket());
+        clientUser->sendSnapshot(items);
 
         co_return true;
     }
@@ -194,6 +187,7 @@ namespace
         }
 
         const auto games = database->getGames();
+        std::vector<PacketBufferPtr> items;
         for (const auto& game : games)
         {
             if (game->getRoomId() != clientUser->getRoomId())
@@ -201,14 +195,15 @@ namespace
                 continue;
             }
 
-            clientUser->sendPacket(
+            items.push_back(
                 WormsPacket::freeze(PacketCode::ListItem, {.value1 = game->getId(),
                                                            .name = std::string(game->getName()),
                                                            .data = game->getAddress().to_string(),
                                                            .info = game->getSessionInfo()}));
         }
 
-        clientUser->sendPacket(WormsPacket::getListEndPacket());
+        items.push_back(WormsPacket::getListEndPacket());
+        clientUser->sendSnapshot(items);
 
         co_return true;
     }
@@ -226,12 +221,9 @@ namespace
 
         // Check if the room name is valid is not already taken.
         const std::string_view requestedRoomName = *packet->fields().name;
-        if (std::ranges::any_of(database->getRooms(), [requestedRoomName](const auto& room) -> bool
-        {
-            return EqualsCaseInsensitive(requestedRoomName, room->getName());
-        }))
+        if (database->isRoomNameTaken(requestedRoomName))
         {
-            clientUser->sendPacket(WormsPacket::freeze(PacketCode::CreateRoomReply, {.value1 = 0, .error = 1}));
+            clientUser->sendReply(WormsPacket::freeze(PacketCode::CreateRoomReply, {.value1 = 0, .error = 1}));
 
             co_return true;
         }
@@ -250,18 +242,11 @@ namespace
                                                          .info = room->getSessionInfo()});
 
         // notify others
-        for (const auto& user : database->getUsers())
-        {
-            if (user->getId() == clientUser->getId())
-            {
-                continue;
-            }
-
-            user->sendPacket(roomPacketBytes);
-        }
+        PresenceCoalescer::getInstance().publish(
+            roomPacketBytes, clientUser->getId(), PresenceKey::roomCreated(roomId));
 
         // Send the creation room reply packet
-        clientUser->sendPacket(WormsPacket::freeze(PacketCode::CreateRoomReply, {.value1 = roomId, .error = 0}));
+        clientUser->sendReply(WormsPacket::freeze(PacketCode::CreateRoomReply, {.value1 = roomId, .error = 0}));
 
         co_return true;
     }
@@ -277,27 +262,17 @@ namespace
 
         // Require a valid room or game ID.
         // Check rooms
-        if (std::ranges::any_of(database->getRooms(),
-                                [join_id = packet->fields().value2](const auto& room) -> bool
-                                {
-                                    return room->getId() == join_id;
-                                }))
+        if (database->getRoom(*packet->fields().value2) != nullptr)
         {
-            clientUser->setRoomId(*packet->fields().value2);
+            database->setUserRoomId(clientUser->getId(), *packet->fields().value2);
 
             // Notify other users about the join.
             const auto packetBytes = WormsPacket::freeze(
                 PacketCode::Join, {.value2 = packet->fields().value2, .value10 = clientUser->getId()});
-            for (const auto& user : database->getUsers())
-            {
-                if (user->getId() == clientUser->getId())
-                {
-                    continue;
-                }
-                user->sendPacket(packetBytes);
-            }
+            PresenceCoalescer::getInstance().publish(
+                packetBytes, clientUser->getId(), PresenceKey::joined(clientUser->getId(), *packet->fields().value2));
 
-            clientUser->sendPacket(WormsPacket::freeze(PacketCode::JoinReply, {.error = 0}));
+            clientUser->sendReply(WormsPacket::freeze(PacketCode::JoinReply, {.error = 0}));
             co_return true;
         }
 
@@ -312,21 +287,15 @@ namespace
             // Notify other users about the join.
             const auto packetBytes = WormsPacket::freeze(
                 PacketCode::Join, {.value2 = clientUser->getRoomId(), .value10 = clientUser->getId()});
-            for (const auto& user : database->getUsers())
-            {
-                if (user->getId() == clientUser->getId())
-                {
-                    continue;
-                }
-                user->sendPacket(packetBytes);
-            }
+            PresenceCoalescer::getInstance().publish(
+                packetBytes, clientUser->getId(), PresenceKey::rejoined(clientUser->getId(), clientUser->getRoomId()));
 
-            clientUser->sendPacket(WormsPacket::freeze(PacketCode::JoinReply, {.error = 0}));
+            clientUser->sendReply(WormsPacket::freeze(PacketCode::JoinReply, {.error = 0}));
             co_return true;
         }
 
         // Reply to joiner. (failed to find)
-        clientUser->sendPacket(WormsPacket::freeze(PacketCode::JoinReply, {.error = 1}));
+        clientUser->sendReply(WormsPacket::freeze(PacketCode::JoinReply, {.error = 1}));
         co_return true;
     }
 
@@ -344,16 +313,16 @@ namespace
         if (packet->fields().value2 == clientUser->getRoomId())
         {
             co_await LeaveRoom(database->getRoom(clientUser->getRoomId()), clientUser->getId());
-            clientUser->setRoomId(0);
+            database->setUserRoomId(clientUser->getId(), 0);
 
             // Reply to leaver.
-            clientUser->sendPacket(WormsPacket::freeze(PacketCode::LeaveReply, {.error = 0}));
+            clientUser->sendReply(WormsPacket::freeze(PacketCode::LeaveReply, {.error = 0}));
 
             co_return true;
         }
 
         // Reply to leaver. (failed to find)
-        clientUser->sendPacket(WormsPacket::freeze(PacketCode::LeaveReply, {.error = 1}));
+        clientUser->sendReply(WormsPacket::freeze(PacketCode::LeaveReply, {.error = 1}));
 
         co_return true;
     }
@@ -370,7 +339,7 @@ namespace
         // Never sent for games, users disconnect if leaving a game.
         // Reply success to the client, the server decides when to actually
         // close rooms.
-        clientUser->sendPacket(WormsPacket::freeze(PacketCode::CloseReply, {.error = 0}));
+        clientUser->sendReply(WormsPacket::freeze(PacketCode::CloseReply, {.error = 0}));
 
         co_return true;
     }
@@ -404,7 +373,7 @@ namespace
             // Create a new game.
             const auto gameId = Database::getNextId();
             const auto game = std::make_shared<worms_server::Game>(gameId, clientUser->getName(),
-                                                                   clientUser->getSessionInfo().playerNation,
+                                                                   clientUser->getNation(),
                                                                    clientUser->getRoomId(), clientUser->getAddress(),
                                                                    packet->fields().info->access);
             database->addGame(game);
@@ -417,23 +386,17 @@ namespace
                                                              .name = std::string(game->getName()),
                                                              .data = game->getAddress().to_string(),
                                                              .info = game->getSessionInfo()});
-            for (const auto& user : database->getUsers())
-            {
-                if (user->getId() == clientUser->getId())
-                {
-                    continue;
-                }
-                user->sendPacket(packet_bytes);
-            }
+            PresenceCoalescer::getInstance().publish(
+                packet_bytes, clientUser->getId(), PresenceKey::gameCreated(gameId));
 
             // Send reply to host;
-            clientUser->sendPacket(
+            clientUser->sendReply(
                 WormsPacket::freeze(PacketCode::CreateGameReply, {.value1 = gameId, .error = 0}));
         }
 
 
-        clientUser->sendPacket(WormsPacket::freeze(PacketCode::CreateGameReply, {.value1 = 0, .error = 2}));
-        clientUser->sendPacket(WormsPacket::freeze(
+        clientUser->sendReply(WormsPacket::freeze(PacketCode::CreateGameReply, {.value1 = 0, .error = 2}));
+        clientUser->sendReply(WormsPacket::freeze(
             PacketCode::ChatRoom, {.value0 = clientUser->getId(),
                                    .value3 = clientUser->getRoomId(),
                                    .data = "GRP:Cannot host your game. Please use FrontendKitWS with "
@@ -462,11 +425,11 @@ namespace
 
         if (it == games.end())
         {
-            clientUser->sendPacket(WormsPacket::freeze(PacketCode::ConnectGameReply, {.data = "", .error = 1}));
+            clientUser->sendReply(WormsPacket::freeze(PacketCode::ConnectGameReply, {.data = "", .error = 1}));
         }
         else
         {
-            clientUser->sendPacket(WormsPacket::freeze(
+            clientUser->sendReply(WormsPacket::freeze(
                 PacketCode::ConnectGameReply, {.data = (*it)->getAddress().to_string(), .error = 0}));
         }
 
@@ -479,7 +442,20 @@ namespace worms_server
 
 
     awaitable<bool> PacketHandler::handlePacket(std::shared_ptr<User> clientUser,
-                                                std::shared_ptr<Database> database, WormsPacketPtr packet)
+                                                std::shared_ptr<Database> database, WormsPacketPtr packet,
+                                                const ServerClock::time_point received)
+    {
+        const auto code = packet->code();
+        const auto started = ServerClock::now();
+        const LoopActivity activity("handling packet code", static_cast<uint32_t>(code));
+        BeginDispatch();
+        const bool handled = co_await dispatch(clientUser, std::move(database), std::move(packet));
+        FinishDispatch(code, clientUser->getName(), received, started);
+        co_return handled;
+    }
+
+    awaitable<bool> PacketHandler::dispatch(std::shared_ptr<User> clientUser,
+                                            std::shared_ptr<Database> database, WormsPacketPtr packet)
     {
         switch (packet->code())
         {
@@ -530,4 +506,51 @@ namespace worms_server
 
         co_return false;
     }
+
+    void PacketHandler::rejectPacket(const std::shared_ptr<User>& clientUser, const PacketCode code)
+    {
+        switch (code)
+        {
+        case PacketCode::ChatRoom:
+            clientUser->sendReply(WormsPacket::freeze(PacketCode::ChatRoomReply, {.error = 1}));
+            break;
+
+        case PacketCode::ListRooms:
+        case PacketCode::ListUsers:
+        case PacketCode::ListGames:
+        {
+            // Behind any earlier list still queued, like the lists themselves.
+            const std::array end{WormsPacket::getListEndPacket()};
+            clientUser->sendSnapshot(end);
+            break;
+        }
+
+        case PacketCode::CreateRoom:
+            clientUser->sendReply(WormsPacket::freeze(PacketCode::CreateRoomReply, {.value1 = 0, .error = 1}));
+            break;
+
+        case PacketCode::Join:
+            clientUser->sendReply(WormsPacket::freeze(PacketCode::JoinReply, {.error = 1}));
+            break;
+
+        case PacketCode::Leave:
+            clientUser->sendReply(WormsPacket::freeze(PacketCode::LeaveReply, {.error = 1}));
+            break;
+
+        case PacketCode::Close:
+            clientUser->sendReply(WormsPacket::freeze(PacketCode::CloseReply, {.error = 1}));
+            break;
+
+        case PacketCode::CreateGame:
+            clientUser->sendReply(WormsPacket::freeze(PacketCode::CreateGameReply, {.value1 = 0, .error = 2}));
+            break;
+
+        case PacketCode::ConnectGame:
+            clientUser->sendReply(WormsPacket::freeze(PacketCode::ConnectGameReply, {.data = "", .error = 1}));
+            break;
+
+        default:
+            break;
+        }
+    }
 } // namespace worms_server
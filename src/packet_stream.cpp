@@ -0,0 +1,87 @@
+#include "packet_stream.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace worms_server
+{
+    PacketStream::PacketStream(const PacketSource source) : source_(source), storage_(CAPACITY)
+    {
+    }
+
+    asio::mutable_buffer PacketStream::prepare()
+    {
+        releaseFrame();
+
+        if (CAPACITY - tail_ < MIN_RECEIVE_SPACE)
+        {
+            compact();
+        }
+
+        return asio::buffer(storage_.data() + tail_, CAPACITY - tail_);
+    }
+
+    void PacketStream::commit(const size_t bytes)
+    {
+        tail_ = std::min(tail_ + bytes, CAPACITY);
+    }
+
+    net::deserialization_result<WormsPacketPtr, std::string> PacketStream::tryReadPacket()
+    {
+        releaseFrame();
+
+        const std::span<const net::byte> readable(storage_.data() + head_, tail_ - head_);
+        const auto [status, length, error] = WormsPacket::peekFrameLength(readable, source_);
+        if (status != net::packet_parse_status::complete)
+        {
+            return {.status = status, .error = error};
+        }
+
+        auto reader = net::packet_reader(readable.first(*length));
+        auto result = WormsPacket::readFrom(reader, source_);
+        if (result.status == net::packet_parse_status::partial)
+        {
+            // The frame length said the packet is complete, so the fields disagree with the flags.
+            return {.status = net::packet_parse_status::error, .error = "Truncated packet frame"};
+        }
+
+        if (result.status == net::packet_parse_status::complete)
+        {
+            frameLength_ = *length;
+        }
+
+        return result;
+    }
+
+    std::span<const net::byte> PacketStream::currentFrame() const
+    {
+        return {storage_.data() + head_, frameLength_};
+    }
+
+    size_t PacketStream::buffered() const
+    {
+        return tail_ - head_ - frameLength_;
+    }
+
+    void PacketStream::releaseFrame()
+    {
+        head_ += std::exchange(frameLength_, 0);
+        if (head_ == tail_)
+        {
+            head_ = tail_ = 0;
+        }
+    }
+
+    void PacketStream::compact()
+    {
+        const size_t readable = tail_ - head_;
+        if (head_ != 0 && readable != 0)
+        {
+            std::memmove(storage_.data(), storage_.data() + head_, readable);
+        }
+
+        head_ = 0;
+        tail_ = readable;
+    }
+} // namespace worms_server
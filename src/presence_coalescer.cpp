@@ -0,0 +1,229 @@
+#include "presence_coalescer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <span>
+#include <vector>
+
+#include "database.hpp"
+#include "handler_timing.hpp"
+#include "loop_monitor.hpp"
+#include "metrics.hpp"
+#include "recycling_allocator.hpp"
+#include "server_clock.hpp"
+#include "user.hpp"
+
+namespace
+{
+    using namespace worms_server;
+
+    // Joins the selected packets into one buffer; a single packet is passed through without a copy.
+    template <typename Events, typename Predicate>
+    PacketBufferPtr Concatenate(const Events& events, Predicate&& selected)
+    {
+        size_t totalSize = 0;
+        size_t count = 0;
+        const PacketBufferPtr* single = nullptr;
+        for (const auto& event : events)
+        {
+            if (selected(event))
+            {
+                totalSize += event.packet->size();
+                single = &event.packet;
+                ++count;
+            }
+        }
+
+        if (count <= 1)
+        {
+            return count == 0 ? nullptr : *single;
+        }
+
+        return PacketBuffer::create(totalSize, [&](const std::span<net::byte> target)
+        {
+            size_t offset = 0;
+            for (const auto& event : events)
+            {
+                if (selected(event))
+                {
+                    std::memcpy(target.data() + offset, event.packet->data(), event.packet->size());
+                    offset += event.packet->size();
+                }
+            }
+        });
+    }
+}
+
+namespace worms_server
+{
+    PresenceCoalescer& PresenceCoalescer::getInstance()
+    {
+        static PresenceCoalescer instance;
+        return instance;
+    }
+
+    asio::awaitable<void> PresenceCoalescer::run(const std::chrono::milliseconds tick)
+    {
+        ServerTimer timer(co_await asio::this_coro::executor);
+        enabled_ = true;
+
+        while (true)
+        {
+            timer.expires_after(tick);
+
+            asio::error_code ec;
+            co_await timer.async_wait(Recycled(asio::redirect_error(asio::use_awaitable, ec)));
+            if (ec)
+            {
+                break;
+            }
+
+            flush();
+        }
+
+        enabled_ = false;
+        flush();
+    }
+
+    void PresenceCoalescer::publish(PacketBufferPtr packet, const uint32_t excludedUserId, const PresenceKey key)
+    {
+        if (enabled_.load(std::memory_order_acquire))
+        {
+            const std::scoped_lock lock(mutex_);
+            pending_.push_back({std::move(packet), excludedUserId});
+            NoteDispatchEnqueue();
+            return;
+        }
+
+        size_t recipients = 0;
+        for (const auto& user : Database::getInstance()->getUsers())
+        {
+            if (user->getId() != excludedUserId)
+            {
+                user->sendPacket(packet, key);
+                ++recipients;
+            }
+        }
+        ObserveMetric(MetricHistogram::BroadcastFanout, recipients);
+    }
+
+    void PresenceCoalescer::noteLogin(const uint32_t userId)
+    {
+        if (!enabled_.load(std::memory_order_acquire))
+        {
+            return;
+        }
+
+        const std::scoped_lock lock(mutex_);
+        lateJoiners_.push_back({userId, pending_.size()});
+    }
+
+    void PresenceCoalescer::flush()
+    {
+        const LoopActivity activity("flushing presence updates");
+        std::vector<Event> events;
+        std::vector<LateJoiner> lateJoiners;
+        {
+            const std::scoped_lock lock(mutex_);
+            events.swap(pending_);
+            lateJoiners.swap(lateJoiners_);
+        }
+
+        if (events.empty())
+        {
+            return;
+        }
+
+        // Most recipients get the same buffer; only the users some event excludes and the users who
+        // logged in mid-tick need their own selection.
+        std::vector<uint32_t> excludedIds;
+        for (const auto& event : events)
+        {
+            if (event.excludedUserId != 0)
+            {
+                excludedIds.push_back(event.excludedUserId);
+            }
+        }
+        std::ranges::sort(excludedIds);
+        std::ranges::sort(lateJoiners, {}, &LateJoiner::userId);
+
+        // Cut the tick at every excluded event and every late joiner's first event. Each piece between cuts
+        // is joined once, and any recipient's selection is then a run of whole pieces.
+        std::vector<bool> cuts(events.size() + 1, false);
+        for (size_t index = 0; index < events.size(); ++index)
+        {
+            if (events[index].excludedUserId != 0)
+            {
+                cuts[index] = true;
+                cuts[index + 1] = true;
+            }
+        }
+        for (const auto& lateJoiner : lateJoiners)
+        {
+            cuts[lateJoiner.firstEvent] = true;
+        }
+
+        struct Segment
+        {
+            size_t firstEvent;
+            uint32_t excludedUserId;
+            PacketBufferPtr packet;
+        };
+
+        std::vector<Segment> segments;
+        for (size_t first = 0; first < events.size();)
+        {
+            size_t last = first + 1;
+            while (last < events.size() && !cuts[last])
+            {
+                ++last;
+            }
+
+            segments.push_back({first, events[first].excludedUserId,
+                                Concatenate(std::span(events).subspan(first, last - first),
+                                            [](const Event&) { return true; })});
+            first = last;
+        }
+
+        const auto shared = Concatenate(events, [](const Event&) { return true; });
+
+        const auto users = Database::getInstance()->getUsers();
+        size_t recipients = 0;
+
+        std::vector<PacketBufferPtr> own;
+        for (const auto& user : users)
+        {
+            const uint32_t userId = user->getId();
+            const auto lateJoiner = std::ranges::lower_bound(lateJoiners, userId, {}, &LateJoiner::userId);
+            const bool late = lateJoiner != lateJoiners.end() && lateJoiner->userId == userId;
+
+            if (!late && !std::ranges::binary_search(excludedIds, userId))
+            {
+                user->sendPacket(shared);
+                ++recipients;
+                continue;
+            }
+
+            // A piece that excludes someone holds only that one event.
+            own.clear();
+            const size_t firstEvent = late ? lateJoiner->firstEvent : 0;
+            for (auto segment = std::ranges::lower_bound(segments, firstEvent, {}, &Segment::firstEvent);
+                 segment != segments.end(); ++segment)
+            {
+                if (segment->excludedUserId != userId)
+                {
+                    own.push_back(segment->packet);
+                }
+            }
+
+            if (!own.empty())
+            {
+                user->sendPackets(own);
+                ++recipients;
+            }
+        }
+
+        // A user every event of the tick excluded got nothing, so is not counted.
+        ObserveMetric(MetricHistogram::BroadcastFanout, recipients);
+    }
+} // namespace worms_server
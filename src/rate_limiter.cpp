@@ -0,0 +1,250 @@
+#include "rate_limiter.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+
+namespace
+{
+    using namespace worms_server;
+
+    constexpr std::array<std::string_view, RATE_LIMITED_CODES.size()> CODE_NAMES{
+        "ListRooms", "ListUsers", "ListGames", "CreateRoom", "Join",
+        "Leave",     "Close",     "CreateGame", "ChatRoom",  "ConnectGame",
+    };
+
+    constexpr size_t NO_SLOT = RATE_LIMITED_CODES.size();
+
+    constexpr size_t SlotOf(const PacketCode code)
+    {
+        switch (code)
+        {
+        case PacketCode::ListRooms: return 0;
+        case PacketCode::ListUsers: return 1;
+        case PacketCode::ListGames: return 2;
+        case PacketCode::CreateRoom: return 3;
+        case PacketCode::Join: return 4;
+        case PacketCode::Leave: return 5;
+        case PacketCode::Close: return 6;
+        case PacketCode::CreateGame: return 7;
+        case PacketCode::ChatRoom: return 8;
+        case PacketCode::ConnectGame: return 9;
+        default: return NO_SLOT;
+        }
+    }
+
+    static_assert([]
+    {
+        for (size_t slot = 0; slot < RATE_LIMITED_CODES.size(); ++slot)
+        {
+            if (SlotOf(RATE_LIMITED_CODES[slot]) != slot)
+            {
+                return false;
+            }
+        }
+        return true;
+    }());
+
+    // A rule in GCRA form: packets are spaced interval apart, and may run up to tolerance ahead of that.
+    struct CompiledRule
+    {
+        int64_t interval = 0;
+        int64_t tolerance = 0;
+        RateLimitAction action = RateLimitAction::Reply;
+    };
+
+    // Written once at startup, before any session runs.
+    std::array<CompiledRule, RATE_LIMITED_CODES.size()> compiledRules;
+
+    struct alignas(64) AtomicCounts
+    {
+        std::atomic<uint64_t> replied{0};
+        std::atomic<uint64_t> delayed{0};
+        std::atomic<uint64_t> disconnected{0};
+    };
+
+    // Only bumped when a packet is limited, so sharing them between sessions costs nothing on the normal path.
+    std::array<AtomicCounts, RATE_LIMITED_CODES.size()> actionCounts;
+
+    std::optional<size_t> ParseSlot(const std::string_view name)
+    {
+        for (size_t slot = 0; slot < CODE_NAMES.size(); ++slot)
+        {
+            if (CODE_NAMES[slot] == name)
+            {
+                return slot;
+            }
+        }
+
+        uint16_t number = 0;
+        if (const auto [end, ec] = std::from_chars(name.data(), name.data() + name.size(), number);
+            ec == std::errc() && end == name.data() + name.size())
+        {
+            if (const size_t slot = SlotOf(static_cast<PacketCode>(number)); slot != NO_SLOT)
+            {
+                return slot;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    bool ParseNumber(const std::string_view text, uint32_t& value)
+    {
+        const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        return ec == std::errc() && end == text.data() + text.size();
+    }
+}
+
+namespace worms_server
+{
+    RateLimitRules DefaultRateLimitRules()
+    {
+        RateLimitRules rules;
+        const auto set = [&](const PacketCode code, const uint32_t perSecond, const uint32_t burst,
+                             const RateLimitAction action)
+        {
+            rules[SlotOf(code)] = {.perSecond = perSecond, .burst = burst, .action = action};
+        };
+
+        // Each of these scans or fans out to the whole lobby; an honest client stays well below them.
+        set(PacketCode::ListRooms, 5, 10, RateLimitAction::Delay);
+        set(PacketCode::ListUsers, 5, 10, RateLimitAction::Delay);
+        set(PacketCode::ListGames, 5, 10, RateLimitAction::Delay);
+        set(PacketCode::CreateRoom, 1, 3, RateLimitAction::Reply);
+        set(PacketCode::Join, 5, 10, RateLimitAction::Delay);
+        set(PacketCode::Leave, 5, 10, RateLimitAction::Delay);
+        set(PacketCode::Close, 5, 10, RateLimitAction::Reply);
+        set(PacketCode::CreateGame, 1, 3, RateLimitAction::Reply);
+        set(PacketCode::ChatRoom, 5, 10, RateLimitAction::Reply);
+        set(PacketCode::ConnectGame, 5, 10, RateLimitAction::Reply);
+        return rules;
+    }
+
+    bool ParseRateLimitRule(const std::string_view spec, RateLimitRules& rules)
+    {
+        const size_t equals = spec.find('=');
+        if (equals == std::string_view::npos)
+        {
+            return false;
+        }
+
+        const auto slot = ParseSlot(spec.substr(0, equals));
+        if (!slot)
+        {
+            return false;
+        }
+
+        std::string_view value = spec.substr(equals + 1);
+        if (value == "off")
+        {
+            rules[*slot] = {};
+            return true;
+        }
+
+        RateLimitRule rule;
+        if (const size_t colon = value.find(':'); colon != std::string_view::npos)
+        {
+            const std::string_view action = value.substr(colon + 1);
+            if (action == "reply")
+            {
+                rule.action = RateLimitAction::Reply;
+            }
+            else if (action == "delay")
+            {
+                rule.action = RateLimitAction::Delay;
+            }
+            else if (action == "disconnect")
+            {
+                rule.action = RateLimitAction::Disconnect;
+            }
+            else
+            {
+                return false;
+            }
+            value = value.substr(0, colon);
+        }
+
+        const size_t slash = value.find('/');
+        if (slash == std::string_view::npos || !ParseNumber(value.substr(0, slash), rule.perSecond)
+            || !ParseNumber(value.substr(slash + 1), rule.burst) || rule.perSecond == 0 || rule.burst == 0)
+        {
+            return false;
+        }
+
+        rules[*slot] = rule;
+        return true;
+    }
+
+    RateLimitStats GetRateLimitStats()
+    {
+        RateLimitStats stats;
+        for (size_t slot = 0; slot < stats.size(); ++slot)
+        {
+            stats[slot] = {.replied = actionCounts[slot].replied.load(std::memory_order_relaxed),
+                           .delayed = actionCounts[slot].delayed.load(std::memory_order_relaxed),
+                           .disconnected = actionCounts[slot].disconnected.load(std::memory_order_relaxed)};
+        }
+        return stats;
+    }
+
+    void RateLimiter::setRules(const RateLimitRules& rules)
+    {
+        for (size_t slot = 0; slot < rules.size(); ++slot)
+        {
+            const auto& rule = rules[slot];
+            if (rule.perSecond == 0)
+            {
+                compiledRules[slot] = {};
+                continue;
+            }
+
+            const int64_t interval = std::chrono::nanoseconds(std::chrono::seconds(1)).count() / rule.perSecond;
+            compiledRules[slot] = {.interval = interval,
+                                   .tolerance = interval * (std::max(rule.burst, 1U) - 1),
+                                   .action = rule.action};
+        }
+    }
+
+    std::optional<RateLimitVerdict> RateLimiter::admit(const PacketCode code,
+                                                       const ServerClock::time_point now)
+    {
+        const size_t slot = SlotOf(code);
+        if (slot == NO_SLOT || compiledRules[slot].interval == 0)
+        {
+            return std::nullopt;
+        }
+
+        const auto& rule = compiledRules[slot];
+        const int64_t arrival = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+        int64_t& theoretical = arrivals_[slot];
+
+        const int64_t start = std::max(theoretical, arrival);
+        const int64_t ahead = start - arrival;
+        if (ahead <= rule.tolerance)
+        {
+            theoretical = start + rule.interval;
+            return std::nullopt;
+        }
+
+        auto& counts = actionCounts[slot];
+        switch (rule.action)
+        {
+        case RateLimitAction::Delay:
+            // The packet takes the next free token once the wait is over.
+            theoretical = start + rule.interval;
+            counts.delayed.fetch_add(1, std::memory_order_relaxed);
+            return RateLimitVerdict{rule.action, std::chrono::nanoseconds(ahead - rule.tolerance)};
+
+        case RateLimitAction::Reply:
+            counts.replied.fetch_add(1, std::memory_order_relaxed);
+            break;
+
+        case RateLimitAction::Disconnect:
+            counts.disconnected.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+
+        return RateLimitVerdict{rule.action, std::chrono::nanoseconds(0)};
+    }
+} // namespace worms_server
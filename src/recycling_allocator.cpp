@@ -0,0 +1,230 @@
+#include "recycling_allocator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace
+{
+    using namespace worms_server;
+
+    // Covers asio's receive/write/wait operation states and the co_spawn entry frames.
+    constexpr std::array<size_t, 6> SIZE_CLASSES{64, 128, 256, 512, 1024, 2048};
+    constexpr size_t MAX_CACHED_PER_CLASS = 256;
+
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    struct ThreadCounters
+    {
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> bytesRecycled{0};
+    };
+
+    class CounterRegistry
+    {
+    public:
+        static CounterRegistry& getInstance()
+        {
+            static CounterRegistry instance;
+            return instance;
+        }
+
+        void attach(ThreadCounters* counters)
+        {
+            const std::scoped_lock lock(mutex_);
+            live_.push_back(counters);
+        }
+
+        void detach(ThreadCounters* counters)
+        {
+            const std::scoped_lock lock(mutex_);
+            retired_.hits += counters->hits.load(std::memory_order_relaxed);
+            retired_.misses += counters->misses.load(std::memory_order_relaxed);
+            retired_.bytesRecycled += counters->bytesRecycled.load(std::memory_order_relaxed);
+            std::erase(live_, counters);
+        }
+
+        RecyclingAllocatorStats collect()
+        {
+            const std::scoped_lock lock(mutex_);
+            RecyclingAllocatorStats stats = retired_;
+            for (const auto* counters : live_)
+            {
+                stats.hits += counters->hits.load(std::memory_order_relaxed);
+                stats.misses += counters->misses.load(std::memory_order_relaxed);
+                stats.bytesRecycled += counters->bytesRecycled.load(std::memory_order_relaxed);
+            }
+            return stats;
+        }
+
+    private:
+        std::mutex mutex_;
+        std::vector<ThreadCounters*> live_;
+        RecyclingAllocatorStats retired_;
+    };
+
+    class ThreadCache
+    {
+    public:
+        ThreadCache()
+        {
+            CounterRegistry::getInstance().attach(&counters_);
+        }
+
+        ~ThreadCache()
+        {
+            for (auto& head : heads_)
+            {
+                while (head != nullptr)
+                {
+                    ::operator delete(std::exchange(head, head->next));
+                }
+            }
+
+            CounterRegistry::getInstance().detach(&counters_);
+        }
+
+        ThreadCache(const ThreadCache&) = delete;
+        ThreadCache& operator=(const ThreadCache&) = delete;
+
+        void* allocate(const size_t classIndex)
+        {
+            if (auto* block = heads_[classIndex])
+            {
+                heads_[classIndex] = block->next;
+                --counts_[classIndex];
+                bump(counters_.hits, 1);
+                bump(counters_.bytesRecycled, SIZE_CLASSES[classIndex]);
+                return block;
+            }
+
+            bump(counters_.misses, 1);
+            return ::operator new(SIZE_CLASSES[classIndex]);
+        }
+
+        void deallocate(void* pointer, const size_t classIndex) noexcept
+        {
+            if (counts_[classIndex] >= MAX_CACHED_PER_CLASS)
+            {
+                ::operator delete(pointer);
+                return;
+            }
+
+            auto* block = static_cast<FreeBlock*>(pointer);
+            block->next = heads_[classIndex];
+            heads_[classIndex] = block;
+            ++counts_[classIndex];
+        }
+
+        void countBypass()
+        {
+            bump(counters_.misses, 1);
+        }
+
+    private:
+        // Only the owning thread writes, so a relaxed load/store pair is enough and avoids a locked add.
+        static void bump(std::atomic<uint64_t>& counter, const uint64_t amount)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+        }
+
+        std::array<FreeBlock*, SIZE_CLASSES.size()> heads_{};
+        std::array<size_t, SIZE_CLASSES.size()> counts_{};
+        ThreadCounters counters_;
+    };
+
+    enum class CacheState : uint8_t { Unborn, Alive, Destroyed };
+
+    // Trivially destructible, so it stays readable while other thread_locals are torn down.
+    thread_local CacheState cacheState = CacheState::Unborn;
+
+    ThreadCache* GetThreadCache()
+    {
+        struct Holder
+        {
+            Holder() { cacheState = CacheState::Alive; }
+            ~Holder() { cacheState = CacheState::Destroyed; }
+            ThreadCache cache;
+        };
+
+        if (cacheState == CacheState::Destroyed)
+        {
+            return nullptr;
+        }
+
+        static thread_local Holder holder;
+        return &holder.cache;
+    }
+
+    constexpr size_t ClassIndexFor(const size_t size)
+    {
+        const auto it = std::ranges::lower_bound(SIZE_CLASSES, size);
+        return static_cast<size_t>(it - SIZE_CLASSES.begin());
+    }
+
+    constexpr bool IsCacheable(const size_t size, const size_t alignment)
+    {
+        return size <= SIZE_CLASSES.back() && alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+    }
+}
+
+namespace worms_server::detail
+{
+    void* RecyclingAllocate(const size_t size, const size_t alignment)
+    {
+        if (!IsCacheable(size, alignment))
+        {
+            if (auto* cache = GetThreadCache())
+            {
+                cache->countBypass();
+            }
+            return ::operator new(size, std::align_val_t{alignment});
+        }
+
+        if (auto* cache = GetThreadCache())
+        {
+            return cache->allocate(ClassIndexFor(size));
+        }
+
+        return ::operator new(SIZE_CLASSES[ClassIndexFor(size)]);
+    }
+
+    void RecyclingDeallocate(void* pointer, const size_t size, const size_t alignment) noexcept
+    {
+        if (pointer == nullptr)
+        {
+            return;
+        }
+
+        if (!IsCacheable(size, alignment))
+        {
+            ::operator delete(pointer, std::align_val_t{alignment});
+            return;
+        }
+
+        // Blocks migrate freely between threads: every block of a class has the same size and
+        // comes from the global heap, so whichever thread frees it may hand it out next.
+        if (cacheState == CacheState::Alive)
+        {
+            GetThreadCache()->deallocate(pointer, ClassIndexFor(size));
+            return;
+        }
+
+        ::operator delete(pointer);
+    }
+} // namespace worms_server::detail
+
+namespace worms_server
+{
+    RecyclingAllocatorStats GetRecyclingAllocatorStats()
+    {
+        return CounterRegistry::getInstance().collect();
+    }
+} // namespace worms_server
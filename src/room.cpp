@@ -12,16 +12,18 @@ namespace worms_server
 {
     Room::Room(const uint32_t id, const std::string_view name,
                const Nation nation, asio::ip::address_v4 address) :
-        id_(id), name_(name), sessionInfo_{nation, SessionType::Room},
+        id_(id), name_(name), nation_(nation),
         address_(std::move(address))
     {
     }
 
     uint32_t Room::getId() const { return id_; }
 
-    std::string_view Room::getName() const { return name_; }
+    std::string_view Room::getName() const { return name_.view(); }
 
-    const SessionInfo& Room::getSessionInfo() const { return sessionInfo_; }
+    Nation Room::getNation() const { return nation_; }
+
+    SessionInfo Room::getSessionInfo() const { return {nation_, SessionType::Room}; }
 
     asio::ip::address_v4 Room::getAddress() const { return address_; }
 } // namespace worms_server
@@ -4,36 +4,200 @@
 
 #include "server.hpp"
 
+#include <format>
+
 #include "spdlog/spdlog.h"
 
+#include "database.hpp"
+#include "disconnect_batcher.hpp"
+#include "handler_timing.hpp"
+#include "loop_monitor.hpp"
+#include "metrics.hpp"
+#include "object_pool.hpp"
+#include "packet_buffer.hpp"
+#include "presence_coalescer.hpp"
+#include "recycling_allocator.hpp"
+#include "server_clock.hpp"
+#include "session_resume.hpp"
+#include "shadow_mirror.hpp"
+#include "span_tracer.hpp"
+#include "traffic_capture.hpp"
+#include "user.hpp"
 #include "user_session.hpp"
 
 
 namespace worms_server
 {
-    Server::Server(const uint16_t port, const size_t maxConnections) : // NOLINT(*-easily-swappable-parameters)
-        port_(port), maxConnections_(maxConnections),
+    Server::Server(const ServerOptions& options) :
+        port_(options.port), maxConnections_(options.maxConnections), presenceTick_(options.presenceTick),
+        metricsPort_(options.metricsPort), stallThreshold_(options.stallThreshold),
+        keepalive_(options.keepalive),
+        admission_(options.maxPendingPerAddress, options.maxPendingLogins),
         threadPool_(std::max(1U, std::thread::hardware_concurrency())), signals_(ioContext_, SIGINT, SIGTERM),
-        running_(false)
+        traceSignals_(ioContext_), running_(false)
     {
         signals_.async_wait([this](const error_code&, int) { stop(); });
+        DisconnectBatcher::getInstance().setWindow(options.disconnectWindow);
+        SessionResume::getInstance().setGrace(options.resumeGrace);
+        RateLimiter::setRules(options.rateLimits);
+        UserSession::setWriteStallTimeout(options.writeStallTimeout);
+        SetSlowHandlerThreshold(options.slowHandlerThreshold);
+
+        if (options.traceSample != 0)
+        {
+            SpanTracer::getInstance().start(options.traceSample);
+#ifdef SIGUSR1
+            traceSignals_.add(SIGUSR1);
+            awaitTraceSignal();
+#else
+            if (options.metricsPort == 0)
+            {
+                spdlog::warn("Tracing without --metrics-port: there is no SIGUSR1 here, so the trace cannot be "
+                             "exported");
+            }
+#endif
+        }
+
+        if (!options.capturePath.empty())
+        {
+            TrafficCapture::getInstance().start(options.capturePath);
+        }
+
+        if (const auto& target = options.shadowTarget)
+        {
+            // The candidate's own sessions would be mirrored back to it without end.
+            if (target->port() == port_ && target->address().is_loopback())
+            {
+                spdlog::error("Shadow target {}:{} is this server, not mirroring", target->address().to_string(),
+                              target->port());
+            }
+            else
+            {
+                ShadowMirror::getInstance().setTarget(*target);
+            }
+        }
+
+        if (options.preallocate)
+        {
+            SlabPool<UserSession>::reserve(maxConnections_);
+            SlabPool<User>::reserve(maxConnections_);
+            spdlog::info("Preallocated {} session slots ({} KiB)", maxConnections_,
+                         maxConnections_ * (SlabPool<UserSession>::BLOCK_SIZE + SlabPool<User>::BLOCK_SIZE) / 1024);
+        }
     }
 
     void Server::run(const size_t threadCount)
     {
         co_spawn(ioContext_, listener(), detached);
+        if (stallThreshold_.count() > 0)
+        {
+            LoopMonitor::getInstance().start(ioContext_, threadCount, stallThreshold_);
+        }
+        start();
         spdlog::info("Press Ctrl+C to exit");
 
+        // Each runner takes a pool thread of its own; posted to the io_context they would all run nested
+        // on whichever thread picked them up, and be counted as that thread. Sessions, shadows and scrapes
+        // each run on a strand, so the io_context is safe to run from several threads.
         for (size_t i = 0; i < threadCount - 1; ++i)
         {
-            post(ioContext_, [this]() { ioContext_.run(); });
+            post(threadPool_, [this, i]()
+            {
+                LoopMonitor::getInstance().attach(i + 1);
+                ioContext_.run();
+            });
         }
 
         // Run the io_context on the main thread as well
+        LoopMonitor::getInstance().attach(0);
         ioContext_.run();
 
         // Wait for the thread pool to complete
         threadPool_.join();
+
+        if (LoopMonitor::enabled())
+        {
+            auto& monitor = LoopMonitor::getInstance();
+            monitor.stop();
+            monitor.logReport();
+        }
+
+        const auto stats = GetRecyclingAllocatorStats();
+        spdlog::info("Recycling allocator: {} hits, {} misses ({:.1f}% hit rate), {} bytes recycled", stats.hits,
+                     stats.misses, stats.hitRate() * 100.0, stats.bytesRecycled);
+
+        if (const auto sessions = SlabPool<UserSession>::stats(); sessions.capacity != 0)
+        {
+            spdlog::info("Session slab: {} of {} slots in use, {} heap fallbacks", sessions.inUse, sessions.capacity,
+                         sessions.fallbacks);
+        }
+
+        if (const auto users = SlabPool<User>::stats(); users.capacity != 0)
+        {
+            spdlog::info("User slab: {} of {} slots in use, {} heap fallbacks", users.inUse, users.capacity,
+                         users.fallbacks);
+        }
+
+        const auto admission = admission_.stats();
+        spdlog::info("Admission: {} refused at capacity, {} over the per-address login cap, {} over the login cap, "
+                     "accept paused {} times for {} ms",
+                     admission.rejectedAtCapacity, admission.rejectedPerAddress, admission.rejectedPending,
+                     admission.acceptPauses, admission.pausedMilliseconds);
+
+        if (const auto resume = SessionResume::getInstance().stats(); resume.suspended != 0)
+        {
+            spdlog::info("Session resume: {} of {} suspended users reconnected in time", resume.resumed,
+                         resume.suspended);
+        }
+
+        const auto rateLimits = GetRateLimitStats();
+        for (size_t slot = 0; slot < rateLimits.size(); ++slot)
+        {
+            if (const auto& counts = rateLimits[slot]; counts.replied + counts.delayed + counts.disconnected != 0)
+            {
+                spdlog::info("Rate limit for packet code {}: {} rejected, {} delayed, {} disconnected",
+                             static_cast<uint32_t>(RATE_LIMITED_CODES[slot]), counts.replied, counts.delayed,
+                             counts.disconnected);
+            }
+        }
+
+        const auto handlers = GetHandlerStats();
+        for (size_t slot = 0; slot < handlers.size(); ++slot)
+        {
+            const auto& [handler, endToEnd, slow] = handlers[slot];
+            if (handler.count == 0)
+            {
+                continue;
+            }
+
+            const auto micros = [](const std::chrono::nanoseconds value)
+            {
+                return std::chrono::duration_cast<std::chrono::microseconds>(value).count();
+            };
+            spdlog::info("Handler for packet code {}: {} packets, p50 {} us, p99 {} us, max {} us; "
+                         "end to end p50 {} us, p99 {} us, max {} us; {} slow",
+                         static_cast<uint32_t>(RATE_LIMITED_CODES[slot]),
+                         handler.count, micros(handler.p50), micros(handler.p99), micros(handler.max),
+                         micros(endToEnd.p50), micros(endToEnd.p99), micros(endToEnd.max), slow);
+        }
+
+        const auto pool = GetPacketPoolStats();
+        spdlog::info("Packet buffer pool: {} buffers served from the pool, {} from the heap", pool.pooled, pool.heap);
+
+        if (TrafficCapture::enabled())
+        {
+            auto& capture = TrafficCapture::getInstance();
+            capture.stop();
+
+            const auto stats = capture.stats();
+            spdlog::info("Traffic capture: {} records, {} KiB written, {} dropped with a full ring", stats.records,
+                         stats.bytes / 1024, stats.dropped);
+        }
+
+        if (ShadowMirror::enabled())
+        {
+            ShadowMirror::getInstance().logReport();
+        }
     }
 
     void Server::stop()
@@ -43,6 +207,106 @@ namespace worms_server
         threadPool_.stop();
     }
 
+    void Server::start()
+    {
+        if (presenceTick_.count() > 0)
+        {
+            co_spawn(ioContext_, PresenceCoalescer::getInstance().run(presenceTick_), Recycled(detached));
+            spdlog::info("Coalescing presence updates every {} ms", presenceTick_.count());
+        }
+
+        if (ShadowMirror::enabled())
+        {
+            static constexpr auto SHADOW_REPORT_INTERVAL = std::chrono::seconds(60);
+            co_spawn(ioContext_, ShadowMirror::getInstance().run(SHADOW_REPORT_INTERVAL), Recycled(detached));
+        }
+
+        if (metricsPort_ != 0)
+        {
+            auto& metrics = Metrics::getInstance();
+            metrics.addGauge("worms_users", "Users in the lobby, including suspended ones",
+                             [] { return static_cast<double>(Database::getInstance()->userCount()); });
+            metrics.addGauge("worms_rooms", "Open rooms",
+                             [] { return static_cast<double>(Database::getInstance()->roomCount()); });
+            metrics.addGauge("worms_games", "Hosted games",
+                             [] { return static_cast<double>(Database::getInstance()->gameCount()); });
+            metrics.addCollector(AppendHandlerMetrics);
+            if (LoopMonitor::enabled())
+            {
+                metrics.addCollector([](std::string& out) { LoopMonitor::getInstance().appendMetrics(out); });
+            }
+            co_spawn(ioContext_, ServeMetrics(metricsPort_), Recycled(detached));
+        }
+    }
+
+    bool Server::connect(std::unique_ptr<Transport> transport)
+    {
+        auto ticket = admit(transport->remoteAddress());
+        if (!ticket)
+        {
+            transport->close();
+            return false;
+        }
+
+        startSession(std::move(transport), std::move(*ticket));
+        return true;
+    }
+
+    io_context& Server::context()
+    {
+        return ioContext_;
+    }
+
+    std::optional<AdmissionControl::Ticket> Server::admit(const ip::address& address)
+    {
+        if (connectionCount.load(std::memory_order_acquire) >= maxConnections_)
+        {
+            admission_.countRejectedAtCapacity();
+            CountMetric(MetricCounter::ConnectionsRefused);
+            return std::nullopt;
+        }
+
+        auto ticket = admission_.admit(address);
+        if (!ticket)
+        {
+            spdlog::debug("Too many pending logins, refusing client");
+            CountMetric(MetricCounter::ConnectionsRefused);
+        }
+        return ticket;
+    }
+
+    void Server::startSession(std::unique_ptr<Transport> transport, AdmissionControl::Ticket ticket)
+    {
+        CountMetric(MetricCounter::ConnectionsAccepted);
+        const int64_t accepted = SpanTracer::enabled() ? TraceNow() : 0;
+        const auto session = std::allocate_shared<UserSession>(SlabAllocator<UserSession>(), std::move(transport),
+                                                               std::move(ticket));
+        if (const uint32_t traceId = session->traceId(); traceId != 0)
+        {
+            SpanTracer::getInstance().record(
+                {.name = "accept", .start = accepted, .duration = TraceNow() - accepted, .session = traceId});
+        }
+        const auto strand = session->strand();
+        co_spawn(strand, std::move(session)->run(), Recycled(detached));
+    }
+
+    void Server::awaitTraceSignal()
+    {
+        traceSignals_.async_wait([this](const error_code& ec, int)
+        {
+            if (ec)
+            {
+                return;
+            }
+
+            const LoopActivity activity("snapshotting the trace");
+            const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            SpanTracer::getInstance().writeJson(std::format("worms_trace_{}.json", seconds));
+            awaitTraceSignal();
+        });
+    }
+
     std::atomic<unsigned int> Server::connectionCount{0};
 
     awaitable<void> Server::listener()
@@ -64,25 +328,31 @@ namespace worms_server
         running_ = true;
         while (running_)
         {
+            // Leave new connections in the kernel backlog instead of accepting and dropping them
+            if (connectionCount.load(std::memory_order_acquire) >= maxConnections_)
+            {
+                co_await waitForCapacity();
+                continue;
+            }
+
             ip::tcp::socket socket(executor);
             error_code ec;
 
-            co_await acceptor.async_accept(socket, redirect_error(use_awaitable, ec));
+            co_await acceptor.async_accept(socket, Recycled(redirect_error(use_awaitable, ec)));
 
             if (!ec)
             {
-                if (connectionCount.load(std::memory_order_acquire) >= maxConnections_)
+                const auto endpoint = socket.remote_endpoint(ec);
+                auto ticket = ec ? std::nullopt : admit(endpoint.address());
+                if (!ticket)
                 {
-                    spdlog::warn("Too many connections, refusing client");
                     socket.close();
                     continue;
                 }
 
                 socket.set_option(ip::tcp::no_delay(true));
-                socket.set_option(ip::tcp::socket::keep_alive(true));
-
-                const auto session = std::make_shared<UserSession>(std::move(socket));
-                co_spawn(ioContext_, std::move(session)->run(), detached);
+                ApplyKeepalive(socket, keepalive_);
+                startSession(std::make_unique<TcpTransport>(std::move(socket)), std::move(*ticket));
             }
             else
             {
@@ -95,4 +365,32 @@ namespace worms_server
             }
         }
     }
+
+    awaitable<void> Server::waitForCapacity()
+    {
+        static constexpr auto CAPACITY_POLL = std::chrono::milliseconds(50);
+
+        // Resume a little below the limit, so a full server doesn't flap between accepting and pausing.
+        const size_t resumeAt = maxConnections_ - std::max<size_t>(1, maxConnections_ / 20);
+        spdlog::warn("At capacity ({} connections), pausing accept until {} remain", maxConnections_, resumeAt);
+
+        const auto pausedAt = ServerClock::now();
+        ServerTimer timer(co_await this_coro::executor);
+        while (running_ && connectionCount.load(std::memory_order_acquire) > resumeAt)
+        {
+            timer.expires_after(CAPACITY_POLL);
+
+            error_code ec;
+            co_await timer.async_wait(Recycled(redirect_error(use_awaitable, ec)));
+            if (ec)
+            {
+                break;
+            }
+        }
+
+        const auto paused = ServerClock::now() - pausedAt;
+        admission_.countPause(paused);
+        spdlog::info("Resuming accept after {} ms",
+                     std::chrono::duration_cast<std::chrono::milliseconds>(paused).count());
+    }
 } // namespace worms_server
@@ -0,0 +1,47 @@
+#include "server_clock.hpp"
+
+namespace worms_server
+{
+    std::atomic<bool> ServerClock::virtual_{false};
+    std::atomic<ServerClock::rep> ServerClock::virtualNow_{0};
+
+    void ServerClock::useVirtualTime()
+    {
+        virtualNow_.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_release);
+        virtual_.store(true, std::memory_order_relaxed);
+    }
+
+    void ServerClock::advance(const duration step)
+    {
+        virtualNow_.fetch_add(step.count(), std::memory_order_acq_rel);
+    }
+
+    size_t AdvanceVirtualTime(asio::io_context& context, const ServerClock::duration span,
+                              const ServerClock::duration step)
+    {
+        const auto until = ServerClock::now() + span;
+        size_t handlers = 0;
+
+        while (true)
+        {
+            // Handlers may arm timers that are already due, so poll until nothing more runs.
+            size_t ran = 0;
+            do
+            {
+                context.restart();
+                ran = context.poll();
+                handlers += ran;
+            }
+            while (ran != 0);
+
+            const auto now = ServerClock::now();
+            if (now >= until)
+            {
+                break;
+            }
+            ServerClock::advance(std::min(step, until - now));
+        }
+
+        return handlers;
+    }
+} // namespace worms_server
@@ -14,7 +14,7 @@ namespace worms_server
         padding.fill(static_cast<net::byte>(0));
     }
 
-    void SessionInfo::writeTo(net::packet_writer& writer) const
+    void SessionInfo::writeTo(PacketWriter& writer) const
     {
         writer.write_le(crc1);
         writer.write_le(crc2);
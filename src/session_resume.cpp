@@ -0,0 +1,120 @@
+#include "session_resume.hpp"
+
+#include <algorithm>
+
+#include "spdlog/spdlog.h"
+
+#include "database.hpp"
+#include "disconnect_batcher.hpp"
+#include "recycling_allocator.hpp"
+#include "server_clock.hpp"
+#include "user.hpp"
+#include "user_session.hpp"
+
+namespace
+{
+    using namespace worms_server;
+
+    // The protocol has no session secret, so a resume must come from the same client build and team as
+    // well; a different player behind the same NAT picking the same name is then still told it is taken.
+    bool SameClient(const SessionInfo& left, const SessionInfo& right)
+    {
+        return left.crc1 == right.crc1 && left.crc2 == right.crc2 && left.playerNation == right.playerNation
+            && left.gameVersion == right.gameVersion && left.gameRelease == right.gameRelease;
+    }
+}
+
+namespace worms_server
+{
+    SessionResume& SessionResume::getInstance()
+    {
+        static SessionResume instance;
+        return instance;
+    }
+
+    void SessionResume::setGrace(const std::chrono::milliseconds grace)
+    {
+        grace_ = grace;
+    }
+
+    bool SessionResume::suspend(const asio::any_io_executor& executor, std::shared_ptr<User> user,
+                                std::shared_ptr<UserSession> session, const asio::ip::address_v4 address,
+                                const SessionInfo& client)
+    {
+        if (grace_.count() == 0 || user == nullptr || user->getId() == 0)
+        {
+            return false;
+        }
+
+        // Other players can't join a game whose host is gone, so it has to be closed right away.
+        if (Database::getInstance()->getGameByName(user->getName()) != nullptr)
+        {
+            return false;
+        }
+
+        spdlog::debug("Suspending user {} for {} ms", user->getName(), grace_.count());
+
+        uint64_t generation = 0;
+        {
+            const std::scoped_lock lock(mutex_);
+            generation = nextGeneration_++;
+            suspended_.push_back({std::move(user), std::move(session), address, client, generation});
+        }
+        suspendedCount_.fetch_add(1, std::memory_order_relaxed);
+
+        co_spawn(executor, expire(generation), Recycled(asio::detached));
+        return true;
+    }
+
+    ResumedSession SessionResume::resume(const std::string_view name, const asio::ip::address_v4 address,
+                                         const SessionInfo& client)
+    {
+        const std::scoped_lock lock(mutex_);
+        const auto it = std::ranges::find_if(suspended_, [&](const Suspended& entry)
+        {
+            return entry.address == address && entry.user->getName() == name && SameClient(entry.client, client);
+        });
+
+        if (it == suspended_.end())
+        {
+            return {};
+        }
+
+        ResumedSession resumed{std::move(it->user), std::move(it->session)};
+        suspended_.erase(it);
+        resumedCount_.fetch_add(1, std::memory_order_relaxed);
+        return resumed;
+    }
+
+    SessionResumeStats SessionResume::stats() const
+    {
+        return {.suspended = suspendedCount_.load(std::memory_order_relaxed),
+                .resumed = resumedCount_.load(std::memory_order_relaxed)};
+    }
+
+    asio::awaitable<void> SessionResume::expire(const uint64_t generation)
+    {
+        ServerTimer timer(co_await asio::this_coro::executor, grace_);
+        asio::error_code ec;
+        co_await timer.async_wait(Recycled(asio::redirect_error(asio::use_awaitable, ec)));
+
+        std::shared_ptr<User> user;
+        std::shared_ptr<UserSession> session;
+        {
+            const std::scoped_lock lock(mutex_);
+            const auto it = std::ranges::find(suspended_, generation, &Suspended::generation);
+            if (it == suspended_.end())
+            {
+                // Resumed in time
+                co_return;
+            }
+
+            user = std::move(it->user);
+            session = std::move(it->session);
+            suspended_.erase(it);
+        }
+
+        spdlog::info("User {} did not reconnect in time", user->getName());
+        DisconnectBatcher::getInstance().submit(co_await asio::this_coro::executor, std::move(user));
+    }
+} // namespace worms_server
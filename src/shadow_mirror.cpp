@@ -0,0 +1,563 @@
+#include "shadow_mirror.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <ranges>
+#include <string>
+
+#include "spdlog/spdlog.h"
+
+#include "recycling_allocator.hpp"
+#include "worms_packet.hpp"
+
+namespace
+{
+    using namespace worms_server;
+
+    // How long the candidate gets to answer what it was sent after the client has gone. The wait restarts
+    // with every reply, so a slow but progressing candidate is not cut off.
+    constexpr auto CLOSE_GRACE = std::chrono::seconds(2);
+
+    // Requests a server is allowed to leave unanswered before the oldest is given up on.
+    constexpr size_t MAX_PENDING = 256;
+
+    constexpr size_t NO_SLOT = MIRRORED_CODES.size();
+
+    constexpr size_t SlotOf(const PacketCode code)
+    {
+        return static_cast<size_t>(std::ranges::find(MIRRORED_CODES, code) - MIRRORED_CODES.begin());
+    }
+
+    constexpr PacketCode ReplyCodeOf(const PacketCode code)
+    {
+        switch (code)
+        {
+        case PacketCode::Login:
+            return PacketCode::LoginReply;
+        case PacketCode::ListRooms:
+        case PacketCode::ListUsers:
+        case PacketCode::ListGames:
+            return PacketCode::ListEnd;
+        case PacketCode::CreateRoom:
+            return PacketCode::CreateRoomReply;
+        case PacketCode::Join:
+            return PacketCode::JoinReply;
+        case PacketCode::Leave:
+            return PacketCode::LeaveReply;
+        case PacketCode::Close:
+            return PacketCode::CloseReply;
+        case PacketCode::CreateGame:
+            return PacketCode::CreateGameReply;
+        case PacketCode::ChatRoom:
+            return PacketCode::ChatRoomReply;
+        case PacketCode::ConnectGame:
+            return PacketCode::ConnectGameReply;
+        default:
+            return PacketCode::Unknown;
+        }
+    }
+}
+
+namespace worms_server
+{
+    bool ParseShadowTarget(const std::string_view spec, asio::ip::tcp::endpoint& target)
+    {
+        const size_t colon = spec.rfind(':');
+        if (colon == std::string_view::npos)
+        {
+            return false;
+        }
+
+        asio::error_code ec;
+        const auto address = asio::ip::make_address_v4(std::string(spec.substr(0, colon)), ec);
+
+        const auto portText = spec.substr(colon + 1);
+        uint16_t port = 0;
+        const auto [end, parseEc] = std::from_chars(portText.data(), portText.data() + portText.size(), port);
+        if (ec || parseEc != std::errc() || end != portText.data() + portText.size() || port == 0)
+        {
+            return false;
+        }
+
+        target = {address, port};
+        return true;
+    }
+
+    ShadowSession::ShadowSession(const asio::any_io_executor& executor, const asio::ip::tcp::endpoint& target) :
+        strand_(asio::make_strand(executor)), target_(target), socket_(strand_), wake_(strand_)
+    {
+        candidate_.candidate = true;
+    }
+
+    void ShadowSession::start()
+    {
+        co_spawn(strand_, [self = shared_from_this()]() -> asio::awaitable<void> // NOLINT(*-avoid-capturing-lambda-coroutines)
+        {
+            co_await self->run();
+        }, Recycled(asio::detached));
+    }
+
+    void ShadowSession::inbound(const std::span<const net::byte> frame, const PacketCode code)
+    {
+        post(strand_, [self = shared_from_this(), bytes = std::vector(frame.begin(), frame.end()), code,
+                 at = ServerClock::now()]() mutable
+        {
+            if (self->finished_ || self->closing_)
+            {
+                return;
+            }
+
+            self->outgoing_.push_back({std::move(bytes), code});
+            self->wake_.cancel();
+            if (SlotOf(code) == NO_SLOT)
+            {
+                return;
+            }
+
+            for (Side* side : {&self->production_, &self->candidate_})
+            {
+                side->pending.push_back({code, at});
+                if (side->pending.size() > MAX_PENDING)
+                {
+                    side->pending.pop_front();
+                    ShadowMirror::getInstance().unanswered_.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            self->unsent_ = std::min(self->unsent_ + 1, self->candidate_.pending.size());
+        });
+    }
+
+    void ShadowSession::outbound(const PacketBufferPtr& buffer)
+    {
+        post(strand_, [self = shared_from_this(), buffer, at = ServerClock::now()]()
+        {
+            if (self->finished_)
+            {
+                return;
+            }
+
+            // Joined presence buffers hold several frames, so go through the stream rather than per buffer.
+            auto& stream = self->production_.stream;
+            auto bytes = buffer->bytes();
+            while (!bytes.empty())
+            {
+                const auto space = stream.prepare();
+                const size_t length = std::min(space.size(), bytes.size());
+                std::memcpy(space.data(), bytes.data(), length);
+                stream.commit(length);
+                bytes = bytes.subspan(length);
+
+                if (!self->drain(self->production_, at))
+                {
+                    self->finish();
+                    return;
+                }
+            }
+        });
+    }
+
+    void ShadowSession::close()
+    {
+        post(strand_, [self = shared_from_this()]()
+        {
+            self->closing_ = true;
+            self->wake_.cancel();
+        });
+    }
+
+    asio::awaitable<void> ShadowSession::run()
+    {
+        auto& mirror = ShadowMirror::getInstance();
+
+        asio::error_code ec;
+        co_await socket_.async_connect(target_, Recycled(asio::redirect_error(asio::use_awaitable, ec)));
+        if (ec)
+        {
+            spdlog::debug("Shadow mirror cannot reach the candidate at {}: {}", target_.address().to_string(),
+                          ec.message());
+            mirror.connectFailures_.fetch_add(1, std::memory_order_relaxed);
+            finish();
+            co_return;
+        }
+
+        socket_.set_option(asio::ip::tcp::no_delay(true), ec);
+        connected_ = true;
+        mirror.sessions_.fetch_add(1, std::memory_order_relaxed);
+
+        co_spawn(strand_, [self = shared_from_this()]() -> asio::awaitable<void> // NOLINT(*-avoid-capturing-lambda-coroutines)
+        {
+            co_await self->reader();
+        }, Recycled(asio::detached));
+
+        std::vector<std::vector<net::byte>> batch;
+        std::vector<asio::const_buffer> buffers;
+        while (!finished_)
+        {
+            const bool holding = awaitingId();
+            if (outgoing_.empty() || holding)
+            {
+                if (outgoing_.empty() && closing_ && candidate_.pending.empty())
+                {
+                    break;
+                }
+
+                // Woken by a new frame, by close(), and by the reader once the candidate answers. A candidate
+                // that leaves an id unassigned for the grace period is given up on like one that stops at close.
+                if (closing_ || holding)
+                {
+                    wake_.expires_after(CLOSE_GRACE);
+                }
+                else
+                {
+                    wake_.expires_at(ServerClock::time_point::max());
+                }
+
+                co_await wake_.async_wait(Recycled(asio::redirect_error(asio::use_awaitable, ec)));
+                if (ec == asio::error::operation_aborted)
+                {
+                    continue;
+                }
+                break; // grace expired or io_context stopped
+            }
+
+            // The batch ends after a request that assigns an id, since the frames behind it may name the id.
+            batch.clear();
+            while (!outgoing_.empty())
+            {
+                const Outgoing frame = std::move(outgoing_.front());
+                outgoing_.pop_front();
+                batch.push_back(translate(frame));
+
+                if (SlotOf(frame.code) != NO_SLOT && unsent_ != 0)
+                {
+                    --unsent_;
+                }
+                if (IdTranslation::assignsId(ReplyCodeOf(frame.code)))
+                {
+                    break;
+                }
+            }
+
+            buffers.clear();
+            for (const auto& frame : batch)
+            {
+                buffers.emplace_back(frame.data(), frame.size());
+            }
+
+            co_await asio::async_write(socket_, buffers, Recycled(asio::redirect_error(asio::use_awaitable, ec)));
+            if (ec)
+            {
+                break;
+            }
+        }
+
+        finish();
+    }
+
+    asio::awaitable<void> ShadowSession::reader()
+    {
+        while (!finished_)
+        {
+            asio::error_code ec;
+            const size_t read = co_await socket_.async_receive(
+                candidate_.stream.prepare(), Recycled(asio::redirect_error(asio::use_awaitable, ec)));
+            if (read == 0 || ec)
+            {
+                // A candidate that drops a session production keeps has diverged, whatever it replied so far.
+                if (!closing_ && !finished_)
+                {
+                    ShadowMirror::getInstance().candidateDisconnects_.fetch_add(1, std::memory_order_relaxed);
+                    spdlog::debug("Shadow mirror: the candidate closed a session production kept open: {}",
+                                  ec ? ec.message() : "connection closed");
+                }
+                break;
+            }
+
+            candidate_.stream.commit(read);
+            if (!drain(candidate_, ServerClock::now()))
+            {
+                break;
+            }
+
+            // The writer may be holding frames for the id this answered.
+            if (!outgoing_.empty() || (closing_ && candidate_.pending.empty()))
+            {
+                wake_.cancel();
+            }
+        }
+
+        finish();
+    }
+
+    bool ShadowSession::awaitingId() const
+    {
+        const size_t sent = candidate_.pending.size() - std::min(unsent_, candidate_.pending.size());
+        return std::ranges::any_of(candidate_.pending | std::views::take(sent), [](const Pending& request)
+        {
+            return IdTranslation::assignsId(ReplyCodeOf(request.code));
+        });
+    }
+
+    std::vector<net::byte> ShadowSession::translate(const Outgoing& frame) const
+    {
+        auto reader = net::packet_reader(frame.bytes);
+        const auto [status, packet, error] = WormsPacket::readFrom(reader);
+        if (status != net::packet_parse_status::complete)
+        {
+            return frame.bytes;
+        }
+
+        auto fields = (*packet)->fields();
+        bool changed = ShadowMirror::getInstance().ids_.translateFields(fields);
+
+        // The candidate only hosts a game at the address the request came from.
+        asio::error_code ec;
+        if (const auto local = socket_.local_endpoint(ec); frame.code == PacketCode::CreateGame && !ec)
+        {
+            fields.data = local.address().to_string();
+            changed = true;
+        }
+
+        if (!changed)
+        {
+            return frame.bytes;
+        }
+
+        const auto rewritten = WormsPacket::freeze(frame.code, std::move(fields));
+        const auto bytes = rewritten->bytes();
+        return {bytes.begin(), bytes.end()};
+    }
+
+    bool ShadowSession::drain(Side& side, const ServerClock::time_point at)
+    {
+        while (true)
+        {
+            const auto [status, data, error] = side.stream.tryReadPacket();
+            if (status == net::packet_parse_status::partial)
+            {
+                break;
+            }
+
+            if (status == net::packet_parse_status::error)
+            {
+                spdlog::debug("Shadow mirror cannot parse {} output: {}", side.candidate ? "candidate" : "production",
+                              error.value_or(""));
+                return false;
+            }
+
+            // Anything but the reply to the oldest request is a broadcast or a list item.
+            const auto& packet = *data;
+            if (side.pending.empty() || ReplyCodeOf(side.pending.front().code) != packet->code())
+            {
+                continue;
+            }
+
+            const auto& request = side.pending.front();
+            ShadowMirror::getInstance().recordLatency(request.code, side.candidate, at - request.at);
+            side.pending.pop_front();
+
+            const auto frame = side.stream.currentFrame();
+            side.replies.push_back({packet, {frame.begin(), frame.end()}});
+        }
+
+        compareReplies();
+        return true;
+    }
+
+    void ShadowSession::compareReplies()
+    {
+        auto& mirror = ShadowMirror::getInstance();
+        while (!production_.replies.empty() && !candidate_.replies.empty())
+        {
+            const auto& production = production_.replies.front();
+            const auto& candidate = candidate_.replies.front();
+
+            mirror.compared_.fetch_add(1, std::memory_order_relaxed);
+            mirror.ids_.learn(*production.packet, *candidate.packet);
+            if (production.packet->fields().error != candidate.packet->fields().error)
+            {
+                mirror.outcomeMismatches_.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            // Each lobby assigns its own ids, so only the outcome of those replies can match.
+            if (!IdTranslation::assignsId(production.packet->code()) && production.bytes != candidate.bytes)
+            {
+                mirror.byteMismatches_.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            production_.replies.pop_front();
+            candidate_.replies.pop_front();
+        }
+    }
+
+    void ShadowSession::finish()
+    {
+        if (finished_)
+        {
+            return;
+        }
+        finished_ = true;
+
+        if (connected_)
+        {
+            ShadowMirror::getInstance().unanswered_.fetch_add(
+                production_.pending.size() + candidate_.pending.size(), std::memory_order_relaxed);
+        }
+
+        outgoing_.clear();
+        unsent_ = 0;
+        production_.pending.clear();
+        candidate_.pending.clear();
+
+        asio::error_code ec;
+        socket_.shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+        socket_.close(ec);
+        wake_.cancel();
+    }
+
+    std::atomic<bool> ShadowMirror::enabled_{false};
+
+    ShadowMirror& ShadowMirror::getInstance()
+    {
+        static ShadowMirror instance;
+        return instance;
+    }
+
+    void ShadowMirror::setTarget(const asio::ip::tcp::endpoint& target)
+    {
+        target_ = target;
+        enabled_.store(true, std::memory_order_release);
+        spdlog::info("Mirroring client traffic to the candidate at {}:{}", target.address().to_string(),
+                     target.port());
+    }
+
+    std::shared_ptr<ShadowSession> ShadowMirror::open(const asio::any_io_executor& executor)
+    {
+        if (!enabled())
+        {
+            return nullptr;
+        }
+
+        auto session = std::make_shared<ShadowSession>(executor, target_);
+        session->start();
+        return session;
+    }
+
+    asio::awaitable<void> ShadowMirror::run(const std::chrono::seconds interval)
+    {
+        ServerTimer timer(co_await asio::this_coro::executor);
+        while (true)
+        {
+            timer.expires_after(interval);
+
+            asio::error_code ec;
+            co_await timer.async_wait(Recycled(asio::redirect_error(asio::use_awaitable, ec)));
+            if (ec)
+            {
+                break;
+            }
+
+            logReport();
+        }
+    }
+
+    void ShadowMirror::logReport() const
+    {
+        const auto report = stats();
+        spdlog::info("Shadow mirror: {} sessions mirrored, {} failed to reach the candidate, {} dropped by it; "
+                     "{} replies compared, {} with a different outcome, {} with different bytes, {} left unanswered",
+                     report.sessions, report.connectFailures, report.candidateDisconnects, report.compared,
+                     report.outcomeMismatches, report.byteMismatches, report.unanswered);
+
+        for (size_t slot = 0; slot < report.codes.size(); ++slot)
+        {
+            const auto& [production, candidate] = report.codes[slot];
+            if (production.count + candidate.count == 0)
+            {
+                continue;
+            }
+
+            spdlog::info("Shadow packet code {}: production p50 {} us, p99 {} us, max {} us over {}; "
+                         "candidate p50 {} us, p99 {} us, max {} us over {}",
+                         static_cast<uint32_t>(MIRRORED_CODES[slot]), production.p50.count(), production.p99.count(),
+                         production.max.count(), production.count, candidate.p50.count(), candidate.p99.count(),
+                         candidate.max.count(), candidate.count);
+        }
+    }
+
+    ShadowStats ShadowMirror::stats() const
+    {
+        ShadowStats result{.sessions = sessions_.load(std::memory_order_relaxed),
+                           .connectFailures = connectFailures_.load(std::memory_order_relaxed),
+                           .compared = compared_.load(std::memory_order_relaxed),
+                           .outcomeMismatches = outcomeMismatches_.load(std::memory_order_relaxed),
+                           .byteMismatches = byteMismatches_.load(std::memory_order_relaxed),
+                           .unanswered = unanswered_.load(std::memory_order_relaxed),
+                           .candidateDisconnects = candidateDisconnects_.load(std::memory_order_relaxed)};
+
+        for (size_t slot = 0; slot < latencies_.size(); ++slot)
+        {
+            result.codes[slot] = {.production = summarize(latencies_[slot][0]),
+                                  .candidate = summarize(latencies_[slot][1])};
+        }
+        return result;
+    }
+
+    void ShadowMirror::recordLatency(const PacketCode code, const bool candidate, const ServerClock::duration latency)
+    {
+        const size_t slot = SlotOf(code);
+        if (slot == NO_SLOT)
+        {
+            return;
+        }
+
+        auto& histogram = latencies_[slot][candidate ? 1 : 0];
+        const int64_t micros = std::max<int64_t>(
+            0, std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+        const size_t bucket = std::min<size_t>(std::bit_width(static_cast<uint64_t>(micros)), LATENCY_BUCKETS - 1);
+        histogram.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+
+        int64_t seen = histogram.maxMicroseconds.load(std::memory_order_relaxed);
+        while (micros > seen && !histogram.maxMicroseconds.compare_exchange_weak(seen, micros,
+                                                                                 std::memory_order_relaxed))
+        {
+        }
+    }
+
+    ShadowLatency ShadowMirror::summarize(const Histogram& histogram)
+    {
+        std::array<uint64_t, LATENCY_BUCKETS> counts{};
+        ShadowLatency result;
+        for (size_t bucket = 0; bucket < LATENCY_BUCKETS; ++bucket)
+        {
+            counts[bucket] = histogram.buckets[bucket].load(std::memory_order_relaxed);
+            result.count += counts[bucket];
+        }
+
+        if (result.count == 0)
+        {
+            return result;
+        }
+
+        result.max = std::chrono::microseconds(histogram.maxMicroseconds.load(std::memory_order_relaxed));
+        const auto percentile = [&](const double fraction)
+        {
+            const auto rank = std::max<uint64_t>(
+                1, static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(result.count))));
+            uint64_t seen = 0;
+            size_t bucket = 0;
+            while (bucket + 1 < LATENCY_BUCKETS && seen + counts[bucket] < rank)
+            {
+                seen += counts[bucket++];
+            }
+            return std::min(std::chrono::microseconds(int64_t{1} << bucket), result.max);
+        };
+
+        result.p50 = percentile(0.5);
+        result.p99 = percentile(0.99);
+        return result;
+    }
+} // namespace worms_server
@@ -0,0 +1,91 @@
+#include "socket_options.hpp"
+
+#include <charconv>
+
+#include "spdlog/spdlog.h"
+
+namespace
+{
+    using namespace worms_server;
+
+    template <int Level, int Name>
+    void SetIntegerOption(asio::ip::tcp::socket& socket, const int value, const std::string_view label)
+    {
+        asio::error_code ec;
+        socket.set_option(asio::detail::socket_option::integer<Level, Name>(value), ec);
+        if (ec)
+        {
+            spdlog::debug("Could not set {} on a client socket: {}", label, ec.message());
+        }
+    }
+
+    bool ParseNumber(const std::string_view text, uint32_t& value)
+    {
+        const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        return ec == std::errc() && end == text.data() + text.size();
+    }
+}
+
+namespace worms_server
+{
+    void ApplyKeepalive(asio::ip::tcp::socket& socket, const KeepaliveOptions& options)
+    {
+        socket.set_option(asio::ip::tcp::socket::keep_alive(true));
+
+        if (options.idle.count() > 0)
+        {
+            const auto idle = static_cast<int>(options.idle.count());
+#if defined(TCP_KEEPIDLE)
+            SetIntegerOption<IPPROTO_TCP, TCP_KEEPIDLE>(socket, idle, "TCP_KEEPIDLE");
+#elif defined(TCP_KEEPALIVE)
+            SetIntegerOption<IPPROTO_TCP, TCP_KEEPALIVE>(socket, idle, "TCP_KEEPALIVE");
+#endif
+#if defined(TCP_KEEPINTVL)
+            SetIntegerOption<IPPROTO_TCP, TCP_KEEPINTVL>(socket, static_cast<int>(options.interval.count()),
+                                                         "TCP_KEEPINTVL");
+#endif
+#if defined(TCP_KEEPCNT)
+            SetIntegerOption<IPPROTO_TCP, TCP_KEEPCNT>(socket, static_cast<int>(options.probes), "TCP_KEEPCNT");
+#endif
+        }
+
+#if defined(TCP_USER_TIMEOUT)
+        if (options.userTimeout.count() > 0)
+        {
+            SetIntegerOption<IPPROTO_TCP, TCP_USER_TIMEOUT>(socket, static_cast<int>(options.userTimeout.count()),
+                                                            "TCP_USER_TIMEOUT");
+        }
+#endif
+    }
+
+    bool ParseKeepalive(const std::string_view spec, KeepaliveOptions& options)
+    {
+        if (spec == "os")
+        {
+            options.idle = std::chrono::seconds(0);
+            return true;
+        }
+
+        const size_t first = spec.find('/');
+        const size_t second = first == std::string_view::npos ? first : spec.find('/', first + 1);
+        if (second == std::string_view::npos)
+        {
+            return false;
+        }
+
+        uint32_t idle = 0;
+        uint32_t interval = 0;
+        uint32_t probes = 0;
+        if (!ParseNumber(spec.substr(0, first), idle)
+            || !ParseNumber(spec.substr(first + 1, second - first - 1), interval)
+            || !ParseNumber(spec.substr(second + 1), probes) || idle == 0 || interval == 0 || probes == 0)
+        {
+            return false;
+        }
+
+        options.idle = std::chrono::seconds(idle);
+        options.interval = std::chrono::seconds(interval);
+        options.probes = probes;
+        return true;
+    }
+} // namespace worms_server
@@ -0,0 +1,216 @@
+#include "span_tracer.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <format>
+#include <iterator>
+
+#include "spdlog/spdlog.h"
+
+#include "metrics.hpp"
+
+namespace
+{
+    using namespace worms_server;
+
+    // Per thread; at about 50 bytes an event this keeps the last few seconds of a busy thread in 3 MiB.
+    constexpr size_t RING_CAPACITY = 65536;
+
+    void AppendEvent(std::string& out, const TraceEvent& event, const uint32_t thread)
+    {
+        const auto micros = [](const int64_t nanoseconds)
+        {
+            return static_cast<double>(nanoseconds) / 1000.0;
+        };
+
+        // Names are literals chosen in this repo, so nothing needs escaping.
+        switch (event.phase)
+        {
+        case TracePhase::Complete:
+            std::format_to(std::back_inserter(out),
+                           R"({{"name":"{}","cat":"session","ph":"X","ts":{:.3f},"dur":{:.3f},"pid":1,"tid":{},)"
+                           R"("args":{{"session":{})", event.name, micros(event.start), micros(event.duration),
+                           thread, event.session);
+            if (event.argName != nullptr)
+            {
+                std::format_to(std::back_inserter(out), R"(,"{}":{})", event.argName, event.arg);
+            }
+            out += "}},\n";
+            break;
+
+        case TracePhase::AsyncBegin:
+        case TracePhase::AsyncEnd:
+            std::format_to(std::back_inserter(out),
+                           R"({{"name":"{}","cat":"session","ph":"{}","id":{},"ts":{:.3f},"pid":1,"tid":{}}},)" "\n",
+                           event.name, event.phase == TracePhase::AsyncBegin ? 'b' : 'e', event.session,
+                           micros(event.start), thread);
+            break;
+        }
+    }
+}
+
+namespace worms_server
+{
+    // The latest RING_CAPACITY events of one thread. Only its thread pushes, so the mutex is uncontended
+    // except while an export copies the ring.
+    class SpanTracer::Ring
+    {
+    public:
+        explicit Ring(const uint32_t thread) :
+            thread_(thread), events_(RING_CAPACITY)
+        {
+        }
+
+        void push(const TraceEvent& event)
+        {
+            const std::scoped_lock lock(mutex_);
+            events_[next_ % RING_CAPACITY] = event;
+            ++next_;
+        }
+
+        // Copies the ring in one block under the lock, so the owning thread waits for a memcpy at most, and
+        // puts the events in order afterwards.
+        [[nodiscard]] std::vector<TraceEvent> copy() const
+        {
+            std::vector<TraceEvent> events(RING_CAPACITY);
+            uint64_t next = 0;
+            {
+                const std::scoped_lock lock(mutex_);
+                std::ranges::copy(events_, events.begin());
+                next = next_;
+            }
+
+            if (next > RING_CAPACITY)
+            {
+                std::ranges::rotate(events, events.begin() + static_cast<std::ptrdiff_t>(next % RING_CAPACITY));
+            }
+            events.resize(std::min<uint64_t>(next, RING_CAPACITY));
+            return events;
+        }
+
+        [[nodiscard]] uint32_t thread() const
+        {
+            return thread_;
+        }
+
+    private:
+        const uint32_t thread_;
+        mutable std::mutex mutex_;
+        std::vector<TraceEvent> events_;
+        uint64_t next_ = 0;
+    };
+
+    std::atomic<bool> SpanTracer::enabled_{false};
+
+    SpanTracer& SpanTracer::getInstance()
+    {
+        static SpanTracer instance;
+        return instance;
+    }
+
+    void SpanTracer::start(const uint32_t sampleEvery)
+    {
+        sampleEvery_ = std::max(1U, sampleEvery);
+        exporter_.emplace(1);
+        enabled_.store(true, std::memory_order_release);
+        spdlog::info("Tracing one session in {}", sampleEvery_);
+    }
+
+    uint32_t SpanTracer::sampleSession()
+    {
+        const uint32_t session = sessions_.fetch_add(1, std::memory_order_relaxed) + 1;
+        return session % sampleEvery_ == 0 ? session : 0;
+    }
+
+    void SpanTracer::record(const TraceEvent& event)
+    {
+        localRing().push(event);
+    }
+
+    asio::awaitable<std::string> SpanTracer::exportJson()
+    {
+        auto events = snapshot();
+        const auto caller = co_await asio::this_coro::executor;
+
+        co_await asio::post(*exporter_, asio::use_awaitable);
+        auto json = format(events);
+        co_await asio::post(caller, asio::use_awaitable);
+        co_return json;
+    }
+
+    void SpanTracer::writeJson(std::filesystem::path path)
+    {
+        post(*exporter_, [events = snapshot(), path = std::move(path)]()
+        {
+            const auto json = format(events);
+            const std::unique_ptr<std::FILE, int (*)(std::FILE*)> file(std::fopen(path.string().c_str(), "wb"),
+                                                                       &std::fclose);
+            if (file == nullptr || std::fwrite(json.data(), 1, json.size(), file.get()) != json.size())
+            {
+                spdlog::error("Cannot write trace to {}", path.string());
+                return;
+            }
+
+            spdlog::info("Wrote {} KiB of trace to {}", json.size() / 1024, path.string());
+        });
+    }
+
+    std::vector<SpanTracer::ThreadEvents> SpanTracer::snapshot() const
+    {
+        std::vector<std::shared_ptr<Ring>> rings;
+        {
+            const std::scoped_lock lock(ringsMutex_);
+            rings = rings_;
+        }
+
+        std::vector<ThreadEvents> threads;
+        threads.reserve(rings.size());
+        for (const auto& ring : rings)
+        {
+            threads.push_back({ring->thread(), ring->copy()});
+        }
+        return threads;
+    }
+
+    std::string SpanTracer::format(const std::vector<ThreadEvents>& snapshot)
+    {
+        std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+        for (const auto& [thread, events] : snapshot)
+        {
+            std::format_to(std::back_inserter(out),
+                           R"({{"name":"thread_name","ph":"M","pid":1,"tid":{},"args":{{"name":"thread {}"}}}},)" "\n",
+                           thread, thread);
+
+            for (const auto& event : events)
+            {
+                AppendEvent(out, event, thread);
+            }
+        }
+
+        // The format allows no trailing comma, so the list ends on the process name instead.
+        out += R"({"name":"process_name","ph":"M","pid":1,"args":{"name":"worms_server"}}]})" "\n";
+        return out;
+    }
+
+    SpanTracer::Ring& SpanTracer::localRing()
+    {
+        // Rings stay registered after their thread exits, so its events are still exported.
+        thread_local std::shared_ptr<Ring> ring;
+        if (ring == nullptr)
+        {
+            const std::scoped_lock lock(ringsMutex_);
+            ring = std::make_shared<Ring>(static_cast<uint32_t>(rings_.size() + 1));
+            rings_.push_back(ring);
+        }
+        return *ring;
+    }
+
+    const char* TracePacketName(const PacketCode code)
+    {
+        const auto value = static_cast<size_t>(code);
+        const size_t slot = value < METERED_CODE_LIMIT ? METERED_CODE_SLOTS[value] : METERED_CODES.size();
+
+        // The names are string literals, so they are null-terminated.
+        return slot < METERED_CODES.size() ? METERED_CODES[slot].second.data() : "packet";
+    }
+} // namespace worms_server
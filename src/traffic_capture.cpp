@@ -0,0 +1,242 @@
+#include "traffic_capture.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "spdlog/spdlog.h"
+
+#include "packet_buffer.hpp"
+#include "server_clock.hpp"
+
+namespace
+{
+    using namespace worms_server;
+
+    constexpr std::array<char, 8> MAGIC{'W', '2', 'C', 'A', 'P', '\0', '\0', '\1'};
+    constexpr size_t RECORD_HEADER = sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint32_t);
+    constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds(50);
+
+    int64_t NowNanoseconds()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(ServerClock::now().time_since_epoch()).count();
+    }
+
+    template <typename T>
+    T ReadLe(const net::byte* bytes)
+    {
+        T value;
+        std::memcpy(&value, bytes, sizeof(T));
+        if constexpr (std::endian::native != std::endian::little && sizeof(T) > 1)
+        {
+            value = std::byteswap(value);
+        }
+        return value;
+    }
+}
+
+namespace worms_server
+{
+    // Single-producer, single-consumer byte ring. Positions only grow; the slot is position % CAPACITY.
+    class TrafficCapture::Ring
+    {
+    public:
+        static constexpr size_t CAPACITY = size_t{1} << 20;
+
+        bool push(const std::span<const net::byte> header, const std::span<const net::byte> payload)
+        {
+            const size_t tail = tail_.load(std::memory_order_relaxed);
+            const size_t head = head_.load(std::memory_order_acquire);
+            if (CAPACITY - (tail - head) < header.size() + payload.size())
+            {
+                return false;
+            }
+
+            copyIn(tail, header);
+            copyIn(tail + header.size(), payload);
+            tail_.store(tail + header.size() + payload.size(), std::memory_order_release);
+            return true;
+        }
+
+        // Writes everything pushed so far to file and returns the number of bytes.
+        size_t drainTo(std::FILE* file)
+        {
+            const size_t head = head_.load(std::memory_order_relaxed);
+            const size_t tail = tail_.load(std::memory_order_acquire);
+            if (head == tail)
+            {
+                return 0;
+            }
+
+            const size_t from = head % CAPACITY;
+            const size_t length = tail - head;
+            const size_t first = std::min(length, CAPACITY - from);
+            std::fwrite(data_.get() + from, 1, first, file);
+            std::fwrite(data_.get(), 1, length - first, file);
+
+            head_.store(tail, std::memory_order_release);
+            return length;
+        }
+
+    private:
+        void copyIn(const size_t position, const std::span<const net::byte> bytes)
+        {
+            const size_t at = position % CAPACITY;
+            const size_t first = std::min(bytes.size(), CAPACITY - at);
+            std::memcpy(data_.get() + at, bytes.data(), first);
+            std::memcpy(data_.get(), bytes.data() + first, bytes.size() - first);
+        }
+
+        std::unique_ptr<net::byte[]> data_ = std::make_unique<net::byte[]>(CAPACITY);
+        alignas(64) std::atomic<size_t> head_{0};
+        alignas(64) std::atomic<size_t> tail_{0};
+    };
+
+    std::atomic<bool> TrafficCapture::enabled_{false};
+
+    TrafficCapture& TrafficCapture::getInstance()
+    {
+        static TrafficCapture instance;
+        return instance;
+    }
+
+    bool TrafficCapture::start(const std::filesystem::path& path)
+    {
+        file_.reset(std::fopen(path.string().c_str(), "wb"));
+        if (file_ == nullptr)
+        {
+            spdlog::error("Cannot open capture file {}", path.string());
+            return false;
+        }
+
+        std::fwrite(MAGIC.data(), 1, MAGIC.size(), file_.get());
+        startedAt_ = NowNanoseconds();
+        flusher_ = std::jthread([this](const std::stop_token& stop) { flushLoop(stop); });
+        enabled_.store(true, std::memory_order_release);
+        spdlog::info("Capturing session traffic to {}", path.string());
+        return true;
+    }
+
+    void TrafficCapture::stop()
+    {
+        if (!enabled_.exchange(false))
+        {
+            return;
+        }
+
+        flusher_.request_stop();
+        flusher_.join();
+        drain();
+        file_.reset();
+    }
+
+    uint32_t TrafficCapture::nextSessionId()
+    {
+        return nextSessionId_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void TrafficCapture::record(const uint32_t session, const CaptureEvent event,
+                                const std::span<const net::byte> payload)
+    {
+        std::array<net::byte, RECORD_HEADER> header{};
+        PacketWriter writer(header);
+        writer.write_le(static_cast<uint64_t>(std::max<int64_t>(0, NowNanoseconds() - startedAt_)));
+        writer.write_le(session);
+        writer.write_le(static_cast<uint8_t>(event));
+        writer.write_le(static_cast<uint32_t>(payload.size()));
+
+        if (!localRing().push(header, payload))
+        {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        records_.fetch_add(1, std::memory_order_relaxed);
+        bytes_.fetch_add(header.size() + payload.size(), std::memory_order_relaxed);
+    }
+
+    CaptureStats TrafficCapture::stats() const
+    {
+        return {.records = records_.load(std::memory_order_relaxed),
+                .bytes = bytes_.load(std::memory_order_relaxed),
+                .dropped = dropped_.load(std::memory_order_relaxed)};
+    }
+
+    TrafficCapture::Ring& TrafficCapture::localRing()
+    {
+        // Rings stay registered after their thread exits, so nothing pushed is lost.
+        thread_local std::shared_ptr<Ring> ring;
+        if (ring == nullptr)
+        {
+            ring = std::make_shared<Ring>();
+            const std::scoped_lock lock(ringsMutex_);
+            rings_.push_back(ring);
+        }
+        return *ring;
+    }
+
+    void TrafficCapture::flushLoop(const std::stop_token& stop)
+    {
+        while (!stop.stop_requested())
+        {
+            std::this_thread::sleep_for(FLUSH_INTERVAL);
+            drain();
+        }
+    }
+
+    void TrafficCapture::drain()
+    {
+        std::vector<std::shared_ptr<Ring>> rings;
+        {
+            const std::scoped_lock lock(ringsMutex_);
+            rings = rings_;
+        }
+
+        size_t written = 0;
+        for (const auto& ring : rings)
+        {
+            written += ring->drainTo(file_.get());
+        }
+
+        if (written != 0)
+        {
+            std::fflush(file_.get());
+        }
+    }
+
+    std::optional<std::vector<CaptureRecord>> ReadCapture(const std::filesystem::path& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        const std::vector<char> contents{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+        if (contents.size() < MAGIC.size() || !std::equal(MAGIC.begin(), MAGIC.end(), contents.begin()))
+        {
+            return std::nullopt;
+        }
+
+        const auto* bytes = reinterpret_cast<const net::byte*>(contents.data());
+        std::vector<CaptureRecord> records;
+        for (size_t offset = MAGIC.size(); contents.size() - offset >= RECORD_HEADER;)
+        {
+            const auto* header = bytes + offset;
+            const auto length = ReadLe<uint32_t>(header + 13);
+            if (contents.size() - offset - RECORD_HEADER < length)
+            {
+                // Cut off mid-record, e.g. by a crash; keep what came before.
+                break;
+            }
+
+            const auto* payload = header + RECORD_HEADER;
+            records.push_back({.time = ReadLe<uint64_t>(header),
+                               .session = ReadLe<uint32_t>(header + 8),
+                               .event = static_cast<CaptureEvent>(ReadLe<uint8_t>(header + 12)),
+                               .payload = std::vector<net::byte>(payload, payload + length)});
+            offset += RECORD_HEADER + length;
+        }
+
+        std::ranges::stable_sort(records, {}, &CaptureRecord::time);
+        return records;
+    }
+} // namespace worms_server
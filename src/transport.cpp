@@ -0,0 +1,47 @@
+#include "transport.hpp"
+
+#include "recycling_allocator.hpp"
+
+namespace worms_server
+{
+    TcpTransport::TcpTransport(asio::ip::tcp::socket socket) : socket_(std::move(socket))
+    {
+        asio::error_code ec;
+        if (const auto endpoint = socket_.remote_endpoint(ec); !ec)
+        {
+            address_ = endpoint.address().to_v4();
+        }
+    }
+
+    asio::any_io_executor TcpTransport::executor()
+    {
+        return socket_.get_executor();
+    }
+
+    asio::ip::address_v4 TcpTransport::remoteAddress() const
+    {
+        return address_;
+    }
+
+    bool TcpTransport::isOpen() const
+    {
+        return socket_.is_open();
+    }
+
+    asio::awaitable<size_t> TcpTransport::receive(const asio::mutable_buffer buffer, asio::error_code& ec)
+    {
+        co_return co_await socket_.async_receive(buffer, Recycled(asio::redirect_error(asio::use_awaitable, ec)));
+    }
+
+    asio::awaitable<void> TcpTransport::write(const std::span<const asio::const_buffer> buffers, asio::error_code& ec)
+    {
+        co_await asio::async_write(socket_, buffers, Recycled(asio::redirect_error(asio::use_awaitable, ec)));
+    }
+
+    void TcpTransport::close()
+    {
+        asio::error_code ec;
+        socket_.shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+        socket_.close(ec);
+    }
+} // namespace worms_server
@@ -8,7 +8,7 @@
 
 worms_server::User::User(
     const std::shared_ptr<UserSession>& session, const uint32_t id, const std::string_view name, const Nation nation) :
-    id_(id), name_(name), sessionInfo_(nation, SessionType::User), session_(session)
+    id_(id), roomId_(0), name_(name), nation_(nation), session_(session)
 {
 }
 
@@ -19,12 +19,17 @@ uint32_t worms_server::User::getId() const
 
 std::string_view worms_server::User::getName() const
 {
-    return name_;
+    return name_.view();
 }
 
-const worms_server::SessionInfo& worms_server::User::getSessionInfo() const
+worms_server::Nation worms_server::User::getNation() const
 {
-    return sessionInfo_;
+    return nation_;
+}
+
+worms_server::SessionInfo worms_server::User::getSessionInfo() const
+{
+    return {nation_, SessionType::User};
 }
 
 uint32_t worms_server::User::getRoomId() const
@@ -37,20 +42,49 @@ void worms_server::User::setRoomId(const uint32_t roomId)
     roomId_.store(roomId, std::memory_order_release);
 }
 
-void worms_server::User::sendPacket(const net::shared_bytes_ptr& packet) const
+void worms_server::User::sendPacket(const PacketBufferPtr& packet, const PresenceKey key) const
 {
-    if (const auto session = session_.lock())
+    if (const auto session = session_.load(std::memory_order_acquire).lock())
     {
-        session->sendPacket(packet);
+        session->sendPacket(packet, key);
+    }
+}
+
+void worms_server::User::sendPackets(const std::span<const PacketBufferPtr> packets) const
+{
+    if (const auto session = session_.load(std::memory_order_acquire).lock())
+    {
+        session->sendPackets(packets);
+    }
+}
+
+void worms_server::User::sendSnapshot(const std::span<const PacketBufferPtr> packets) const
+{
+    if (const auto session = session_.load(std::memory_order_acquire).lock())
+    {
+        session->sendReplies(packets);
+    }
+}
+
+void worms_server::User::sendReply(const PacketBufferPtr& packet) const
+{
+    if (const auto session = session_.load(std::memory_order_acquire).lock())
+    {
+        session->sendReply(packet);
     }
 }
 
 asio::ip::address_v4 worms_server::User::getAddress() const
 {
-    if (const auto session = session_.lock())
+    if (const auto session = session_.load(std::memory_order_acquire).lock())
     {
         return session->addressV4();
     }
 
     return {};
 }
+
+void worms_server::User::rebind(const std::shared_ptr<UserSession>& session)
+{
+    session_.store(session, std::memory_order_release);
+}
@@ -3,158 +3,192 @@
 #include <spdlog/spdlog.h>
 
 #include "database.hpp"
-#include "framed_packet_reader.hpp"
-#include "game.hpp"
+#include "disconnect_batcher.hpp"
+#include "handler_timing.hpp"
+#include "metrics.hpp"
+#include "object_pool.hpp"
 #include "packet_code.hpp"
 #include "packet_handler.hpp"
-#include "room.hpp"
+#include "presence_coalescer.hpp"
+#include "recycling_allocator.hpp"
 #include "server.hpp"
-#include "string_utils.hpp"
+#include "session_resume.hpp"
+#include "span_tracer.hpp"
 #include "user.hpp"
 #include "worms_packet.hpp"
-#include <asio/steady_timer.hpp>
+
+#include <array>
+#include <cassert>
+#include <deque>
+#include <utility>
 
 namespace
 {
     using namespace worms_server;
 
-    awaitable<void> LeaveRoom(std::shared_ptr<Room> room, uint32_t leftId)
+    // Drops presence entries that cancel out before a slow client sees them: an open and its matching
+    // close, and the Join/Leave entries naming a user, room or game that appeared and vanished between
+    // them. A pair with chat relayed from or within its subject in between is kept, so the client never
+    // sees chat from a user or room it was not shown. Returns the number of entries dropped.
+    size_t CompactPresence(std::deque<UserSession::OutboxEntry>& backlog)
     {
-        const auto database = Database::getInstance();
-        const auto users = database->getUsers();
-        const auto games = database->getGames();
-        const uint32_t roomId = room == nullptr ? 0 : room->getId();
+        static constexpr size_t UNKNOWN = SIZE_MAX;
 
+        std::vector<bool> dropped(backlog.size());
+        std::vector<std::pair<PresenceKey, size_t>> openStates;
+        size_t droppedCount = 0;
 
-        spdlog::debug("User Session: Leaving room {}", roomId);
-        const auto hasOtherUsers = std::ranges::any_of(users, [leftId, roomId](const auto& user)
+        // Entries are only dropped within one reply epoch. A list response bumps the epoch, so a Join or Leave
+        // queued before a ListEnd always reaches the client, which would otherwise keep a listed user forever.
+        const auto drop = [&](const size_t index, [[maybe_unused]] const uint32_t replyEpoch)
         {
-            return user->getId() != leftId && user->getRoomId() == roomId;
-        });
+            assert(backlog[index].replyEpoch == replyEpoch);
+            if (!dropped[index])
+            {
+                dropped[index] = true;
+                ++droppedCount;
+            }
+        };
 
-        const auto hasOtherGames = std::ranges::any_of(games, [leftId, roomId](const auto& game)
+        for (size_t index = 0; index < backlog.size(); ++index)
         {
-            return game->getId() != leftId && game->getRoomId() == roomId;
-        });
+            const auto& entry = backlog[index];
+            if (entry.key.kind == PresenceKind::None)
+            {
+                continue;
+            }
 
-        const bool roomClosed = room && !hasOtherUsers && !hasOtherGames;
+            const auto state = std::ranges::find_if(openStates, [&](const auto& open)
+            {
+                return open.first.sameState(entry.key);
+            });
 
-        if (roomClosed)
-        {
-            database->removeRoom(roomId);
-        }
+            if (entry.key.change != PresenceChange::Close)
+            {
+                // Opened again, so it was open before the earlier entry too; nothing here can cancel it.
+                if (state != openStates.end())
+                {
+                    state->second = UNKNOWN;
+                    continue;
+                }
 
-        const auto roomLeavePacketBytes =
-            WormsPacket::freeze(PacketCode::Leave, {.value2 = roomId, .value10 = leftId});
-        const auto roomClosePacketBytes = WormsPacket::freeze(PacketCode::Close, {.value10 = roomId});
+                // A refresh means the state was opened before this backlog, possibly already on the wire.
+                openStates.emplace_back(entry.key, entry.key.change == PresenceChange::Open ? index : UNKNOWN);
+                continue;
+            }
 
-        for (const auto& user : users)
-        {
-            if (user->getId() == leftId)
+            if (state == openStates.end())
             {
                 continue;
             }
 
-            if (room != nullptr)
+            const size_t openIndex = state->second;
+            openStates.erase(state);
+            if (openIndex == UNKNOWN || backlog[openIndex].replyEpoch != entry.replyEpoch)
             {
-                user->sendPacket(roomLeavePacketBytes);
+                continue;
             }
 
-            if (roomClosed)
+            bool relayedBetween = false;
+            for (size_t between = openIndex + 1; between < index && !relayedBetween; ++between)
             {
-                user->sendPacket(roomClosePacketBytes);
+                relayedBetween = backlog[between].key.dependsOn(entry.key.subject);
+            }
+            if (relayedBetween)
+            {
+                continue;
             }
-        }
 
-        co_return;
-    }
+            drop(openIndex, entry.replyEpoch);
+            drop(index, entry.replyEpoch);
 
-    awaitable<void> DisconnectUser(std::shared_ptr<User> client_user)
-    {
-        if (client_user == nullptr)
-        {
-            co_return;
-        }
-
-        spdlog::debug("User Session: Disconnecting user {}", client_user->getName());
+            if (entry.key.kind == PresenceKind::Member)
+            {
+                continue;
+            }
 
-        uint32_t leftId = client_user->getId();
+            for (size_t between = openIndex + 1; between < index; ++between)
+            {
+                if (backlog[between].key.mentions(entry.key.subject))
+                {
+                    drop(between, entry.replyEpoch);
+                }
+            }
 
-        if (leftId == 0)
-        {
-            co_return;
+            // A Join swept above that was still open leaves its Leave with nothing to cancel against.
+            std::erase_if(openStates, [&](const auto& open)
+            {
+                return open.first.mentions(entry.key.subject) && open.second != UNKNOWN && dropped[open.second];
+            });
         }
 
-        uint32_t roomId = client_user->getRoomId();
-        const auto database = Database::getInstance();
-        database->removeUser(leftId);
-
-        // Close abandoned game
-        if (const auto game = database->getGameByName(client_user->getName()))
+        if (droppedCount != 0)
         {
-            roomId = game->getRoomId();
-            leftId = game->getId();
-
-            database->removeGame(leftId);
-
-            const auto roomLeavePacketBytes =
-                WormsPacket::freeze(PacketCode::Leave, {.value2 = game->getId(), .value10 = client_user->getId()});
-            const auto roomClosePacketBytes = WormsPacket::freeze(PacketCode::Close, {.value10 = game->getId()});
-            for (const auto& user : database->getUsers())
+            size_t kept = 0;
+            for (size_t index = 0; index < backlog.size(); ++index)
             {
-                if (user->getId() == client_user->getId())
+                if (!dropped[index])
                 {
-                    continue;
+                    if (kept != index)
+                    {
+                        backlog[kept] = std::move(backlog[index]);
+                    }
+                    ++kept;
                 }
-
-                user->sendPacket(roomLeavePacketBytes);
-                user->sendPacket(roomClosePacketBytes);
             }
+            backlog.erase(backlog.begin() + static_cast<std::ptrdiff_t>(kept), backlog.end());
         }
 
-        // Close abandoned room
-        co_await LeaveRoom(database->getRoom(roomId), leftId);
-
-        // Notify other users we've disconnected
-        const auto packetBytes =
-            WormsPacket::freeze(PacketCode::DisconnectUser, {.value10 = client_user->getId()});
-        for (const auto& user : database->getUsers())
-        {
-            user->sendPacket(packetBytes);
-        }
-
-        co_return;
+        return droppedCount;
     }
 }
 
 namespace worms_server
 {
+    std::chrono::seconds UserSession::writeStallTimeout_{0};
 
-
-    UserSession::UserSession(ip::tcp::socket socket) :
-        database_(Database::getInstance()), socket_(std::move(socket)), timer_(socket_.get_executor()),
-        strand_(socket_.get_executor())
+    UserSession::UserSession(std::unique_ptr<Transport> transport, AdmissionControl::Ticket admission) :
+        database_(Database::getInstance()), transport_(std::move(transport)), address_(transport_->remoteAddress()),
+        admission_(std::move(admission)), timer_(transport_->executor()), stallTimer_(transport_->executor()),
+        strand_(transport_->executor())
     {
-        timer_.expires_at(std::chrono::steady_clock::time_point::max());
+        timer_.expires_at(ServerClock::time_point::max());
         Server::connectionCount.fetch_add(1, std::memory_order_relaxed);
+        AdjustMetric(MetricGauge::Connections, 1);
+
+        if (TrafficCapture::enabled())
+        {
+            captureId_ = TrafficCapture::getInstance().nextSessionId();
+            const auto address = address_.to_bytes();
+            capture(CaptureEvent::Open, std::as_bytes(std::span(address)));
+        }
+
+        if (ShadowMirror::enabled())
+        {
+            shadow_ = ShadowMirror::getInstance().open(transport_->executor());
+        }
+
+        if (SpanTracer::enabled())
+        {
+            traceId_ = SpanTracer::getInstance().sampleSession();
+            TraceAsync(traceId_, "session", TracePhase::AsyncBegin);
+        }
     }
 
     UserSession::~UserSession()
     {
         isShuttingDown_ = true;
-        socket_.close();
-
-        Server::connectionCount.fetch_sub(1, std::memory_order_relaxed);
-
-        // Clear any pending packets
-        moodycamel::ConsumerToken consumer_token(packets_);
-        net::shared_bytes_ptr bytes;
-        while (packets_.try_dequeue(consumer_token, bytes))
+        transport_->close();
+        if (shadow_)
         {
-            // Drain the queue
+            shadow_->close();
         }
 
+        releaseConnection();
+
         spdlog::debug("User session for {} destroyed", user_ ? user_->getName() : "unknown");
+        TraceAsync(traceId_, "teardown", TracePhase::AsyncEnd);
+        TraceAsync(traceId_, "session", TracePhase::AsyncEnd);
     }
 
     awaitable<void> UserSession::run()
@@ -165,82 +199,319 @@ namespace worms_server
         co_spawn(strand_, [self = shared_from_this()]() -> awaitable<void> // NOLINT(*-avoid-capturing-lambda-coroutines)
         {
             co_await self->writer();
-        }, detached);
+        }, Recycled(detached));
 
+        TraceAsync(traceId_, "login", TracePhase::AsyncBegin);
         user_ = co_await handleLogin();
+        TraceAsync(traceId_, "login", TracePhase::AsyncEnd);
+        admission_.release();
         if (user_ == nullptr)
         {
             spdlog::error("Failed to login");
+            CountMetric(MetricCounter::LoginFailures);
+            capture(CaptureEvent::Close);
+            TraceAsync(traceId_, "teardown", TracePhase::AsyncBegin);
+            closeConnection();
             co_return;
         }
 
         spdlog::info("User {} logged in", user_->getName());
+        CountMetric(MetricCounter::Logins);
+        if (writeStallTimeout_.count() > 0)
+        {
+            co_spawn(strand_, [self = shared_from_this()]() -> awaitable<void> // NOLINT(*-avoid-capturing-lambda-coroutines)
+            {
+                co_await self->watchWrites();
+            }, Recycled(detached));
+        }
+
         co_await handleSession();
+        capture(CaptureEvent::Close);
+
+        // Runs until the last reference to the session goes, so it covers the writer winding down as well.
+        TraceAsync(traceId_, "teardown", TracePhase::AsyncBegin);
 
+        // Nothing reaches this session anymore, so let the writer go instead of idling until the next failed write
+        closeConnection();
 
-        co_await DisconnectUser(user_);
+        // Within the grace window the user stays in the lobby, so a quick reconnect goes unnoticed by others.
+        // The socket is closed already, so the connection slot is free for the reconnect to take.
+        const auto executor = co_await this_coro::executor;
+        if (resumable_ &&
+            SessionResume::getInstance().suspend(executor, user_, shared_from_this(), address_, loginInfo_))
+        {
+            releaseConnection();
+        }
+        else
+        {
+            DisconnectBatcher::getInstance().submit(executor, user_);
+        }
         co_return;
     }
 
-    void UserSession::sendPacket(const net::shared_bytes_ptr& packet)
+    void UserSession::releaseConnection()
+    {
+        if (!std::exchange(connectionReleased_, true))
+        {
+            Server::connectionCount.fetch_sub(1, std::memory_order_relaxed);
+            AdjustMetric(MetricGauge::Connections, -1);
+        }
+    }
+
+    void UserSession::sendPacket(const PacketBufferPtr& packet, const PresenceKey key)
     {
-        const moodycamel::ProducerToken producerToken(packets_);
-        packets_.enqueue(producerToken, packet);
-        timer_.cancel_one(); // wake up the writer if sleeping
+        bool wake = false;
+        {
+            const std::scoped_lock lock(outboxMutex_);
+            packets_.push_back({packet, key, replyEpoch_});
+            wake = std::exchange(writerIdle_, false);
+        }
+        NoteDispatchEnqueue();
+        if (wake)
+        {
+            wakeWriter();
+        }
+    }
+
+    void UserSession::sendPackets(const std::span<const PacketBufferPtr> packets)
+    {
+        bool wake = false;
+        {
+            const std::scoped_lock lock(outboxMutex_);
+            for (const auto& packet : packets)
+            {
+                packets_.push_back({packet, {}, replyEpoch_});
+                NoteDispatchEnqueue();
+            }
+            wake = std::exchange(writerIdle_, false);
+        }
+        if (wake)
+        {
+            wakeWriter();
+        }
+    }
+
+    void UserSession::sendReply(const PacketBufferPtr& packet)
+    {
+        sendReplies(std::span(&packet, 1));
+    }
+
+    void UserSession::sendReplies(const std::span<const PacketBufferPtr> packets)
+    {
+        bool wake = false;
+        {
+            const std::scoped_lock lock(outboxMutex_);
+            ++replyEpoch_;
+            for (const auto& packet : packets)
+            {
+                replies_.push_back(packet);
+                NoteDispatchEnqueue();
+            }
+            wake = std::exchange(writerIdle_, false);
+        }
+        if (wake)
+        {
+            wakeWriter();
+        }
+    }
+
+    void UserSession::adoptBacklog(UserSession& previous)
+    {
+        std::deque<OutboxEntry> adopted;
+        {
+            const std::scoped_lock lock(previous.outboxMutex_);
+            adopted.swap(previous.packets_);
+        }
+        if (adopted.empty())
+        {
+            return;
+        }
+
+        bool wake = false;
+        {
+            // The old client's replies never reach this one, so the entries take this session's reply epoch.
+            const std::scoped_lock lock(outboxMutex_);
+            for (auto& entry : adopted)
+            {
+                entry.replyEpoch = replyEpoch_;
+                packets_.push_back(std::move(entry));
+            }
+            wake = std::exchange(writerIdle_, false);
+        }
+        if (wake)
+        {
+            wakeWriter();
+        }
+    }
+
+    void UserSession::wakeWriter()
+    {
+        // The timer is only touched on the strand, where the writer waits on it.
+        post(strand_, [self = shared_from_this()]()
+        {
+            self->timer_.cancel_one();
+        });
     }
 
     ip::address_v4 UserSession::addressV4() const
     {
-        return socket_.remote_endpoint().address().to_v4();
+        return address_;
+    }
+
+    void UserSession::setWriteStallTimeout(const std::chrono::seconds timeout)
+    {
+        writeStallTimeout_ = timeout;
+    }
+
+    void UserSession::capture(const CaptureEvent event, const std::span<const net::byte> payload) const
+    {
+        if (captureId_ != 0 && TrafficCapture::enabled())
+        {
+            TrafficCapture::getInstance().record(captureId_, event, payload);
+        }
+    }
+
+    void UserSession::closeConnection()
+    {
+        isShuttingDown_ = true;
+        if (shadow_)
+        {
+            shadow_->close();
+        }
+
+        post(strand_, [self = shared_from_this()]()
+        {
+            self->transport_->close();
+            self->timer_.cancel();
+            self->stallTimer_.cancel();
+        });
+    }
+
+    awaitable<void> UserSession::watchWrites()
+    {
+        const auto timeout = std::chrono::duration_cast<ServerClock::duration>(writeStallTimeout_);
+
+        // Sampling at half the timeout catches a stall at most one and a half timeouts after it began.
+        while (!isShuttingDown_)
+        {
+            stallTimer_.expires_after(timeout / 2);
+            error_code ec;
+            co_await stallTimer_.async_wait(Recycled(redirect_error(use_awaitable, ec)));
+            if (ec)
+            {
+                break;
+            }
+
+            const auto startedAt = writeStartedAt_.load(std::memory_order_relaxed);
+            const auto now = ServerClock::now().time_since_epoch().count();
+            if (startedAt != 0 && now - startedAt > timeout.count())
+            {
+                spdlog::warn("Write to {} stalled for over {} s, dropping the connection", user_->getName(),
+                             writeStallTimeout_.count());
+                closeConnection();
+                break;
+            }
+        }
     }
 
     awaitable<void> UserSession::writer()
     {
         try
         {
-            moodycamel::ConsumerToken consumerToken(packets_);
             static constexpr auto FLUSH_DELAY = std::chrono::milliseconds(100);
+            static constexpr size_t MAX_BATCH = 16;
+            static constexpr size_t MAX_BACKLOG = 256;
 
-            std::vector<net::shared_bytes_ptr> packetBatch;
+            std::vector<PacketBufferPtr> packetBatch;
             std::vector<const_buffer> buffers;
 
-            net::shared_bytes_ptr packet;
+            // Broadcasts taken off the queue but not yet written; only grows past a batch while the
+            // client is behind, which is when compacting it pays off.
+            std::deque<OutboxEntry> backlog;
+            size_t compacted = 0;
 
             while (!isShuttingDown_)
             {
-                // Collect available packets
-                while (packets_.try_dequeue(consumerToken, packet) && packetBatch.size() < 16)
+                // Collect available packets, replies first, so a reply waits for at most one batch of broadcasts
+                const size_t backlogBefore = backlog.size();
                 {
-                    packetBatch.push_back(std::move(packet));
+                    const std::scoped_lock lock(outboxMutex_);
+                    while (packetBatch.size() < MAX_BATCH && !replies_.empty())
+                    {
+                        packetBatch.push_back(std::move(replies_.front()));
+                        replies_.pop_front();
+                    }
+
+                    while (backlog.size() < MAX_BACKLOG && !packets_.empty())
+                    {
+                        backlog.push_back(std::move(packets_.front()));
+                        packets_.pop_front();
+                    }
+                }
+
+                if (backlog.size() > MAX_BATCH && backlog.size() != backlogBefore)
+                {
+                    compacted += CompactPresence(backlog);
+                }
+
+                if (const size_t depth = packetBatch.size() + backlog.size(); depth != 0)
+                {
+                    ObserveMetric(MetricHistogram::OutboxDepth, depth);
+                }
+
+                while (packetBatch.size() < MAX_BATCH && !backlog.empty())
+                {
+                    packetBatch.push_back(std::move(backlog.front().packet));
+                    backlog.pop_front();
                 }
 
 
                 // Flush everything currently queued
                 if (!packetBatch.empty())
                 {
+                    TraceAsync(traceId_, "write", TracePhase::AsyncBegin);
+
                     // Prepare buffers for vectored writing
                     buffers.clear();
                     for (const auto& pkt : packetBatch)
                     {
                         buffers.emplace_back(pkt->data(), pkt->size());
+                        capture(CaptureEvent::Outbound, pkt->bytes());
+                        CountPacketsOut(pkt->bytes());
+                        if (shadow_)
+                        {
+                            shadow_->outbound(pkt);
+                        }
                     }
 
+                    writeStartedAt_.store(ServerClock::now().time_since_epoch().count(), std::memory_order_relaxed);
                     error_code ec;
-                    co_await async_write(socket_, buffers, redirect_error(use_awaitable, ec));
-
+                    co_await transport_->write(buffers, ec);
+                    writeStartedAt_.store(0, std::memory_order_relaxed);
+                    TraceAsync(traceId_, "write", TracePhase::AsyncEnd);
 
                     if (ec)
                     {
-                        co_return; // socket closed/reset
+                        break; // socket closed/reset
                     }
                     packetBatch.clear();
                 }
 
                 error_code ec;
-                if (packets_.size_approx() == 0)
+                bool idle = false;
+                {
+                    const std::scoped_lock lock(outboxMutex_);
+                    idle = backlog.empty() && replies_.empty() && packets_.empty();
+                    writerIdle_ = idle;
+                }
+
+                if (idle)
                 {
                     timer_.expires_after(FLUSH_DELAY);
-                    co_await timer_.async_wait(redirect_error(use_awaitable, ec));
+                    co_await timer_.async_wait(Recycled(redirect_error(use_awaitable, ec)));
+
+                    const std::scoped_lock lock(outboxMutex_);
+                    writerIdle_ = false;
                 }
 
                 if (ec == error::operation_aborted)
@@ -249,9 +520,14 @@ namespace worms_server
                 }
                 if (ec)
                 {
-                    co_return; // io_context stopped
+                    break; // io_context stopped
                 }
             }
+
+            if (compacted != 0)
+            {
+                spdlog::debug("Dropped {} superseded presence packets while the client was behind", compacted);
+            }
         }
         catch (const std::exception& e)
         {
@@ -262,9 +538,7 @@ namespace worms_server
 
     awaitable<std::shared_ptr<User>> UserSession::handleLogin()
     {
-        std::vector<std::byte> incoming(1024);
-
-        steady_timer timer(socket_.get_executor());
+        ServerTimer timer(transport_->executor());
         timer.expires_after(std::chrono::seconds(3));
 
 
@@ -272,49 +546,62 @@ namespace worms_server
         {
             uint32_t userId = 0;
             // Start the timer
-            timer.async_wait([&](const error_code& wait_ec)
+            timer.async_wait(Recycled([&](const error_code& wait_ec)
             {
                 if (!wait_ec)
                 {
-                    // Timer expired, close the socket
-                    socket_.close();
+                    // Timer expired; the handler may run on any io thread, so the close goes via the strand
+                    closeConnection();
                 }
-            });
+            }));
 
-            // Wait for the client to send a login packet
-            error_code ec;
+            // Wait for the client to send a login packet. It may arrive in pieces, and whatever follows it
+            // stays in the stream for handleSession.
+            WormsPacketPtr login_info;
+            while (login_info == nullptr)
+            {
+                auto [status, data, error] = stream_.tryReadPacket();
+                if (status == net::packet_parse_status::error)
+                {
+                    spdlog::error("Error reading login packet: {}", error.value_or(""));
+                    CountMetric(MetricCounter::ParseErrors);
+                    co_return nullptr;
+                }
 
-            co_await socket_.async_receive(buffer(incoming), redirect_error(use_awaitable, ec));
+                if (status == net::packet_parse_status::complete)
+                {
+                    if (!data)
+                    {
+                        spdlog::error("Login packet has no data");
+                        co_return nullptr;
+                    }
 
-            // Cancel the timer since we got data
-            timer.cancel();
+                    login_info = std::move(*data);
+                    capture(CaptureEvent::Inbound, stream_.currentFrame());
+                    CountPacketIn(login_info->code());
+                    if (shadow_)
+                    {
+                        shadow_->inbound(stream_.currentFrame(), login_info->code());
+                    }
+                    break;
+                }
 
-            if (ec)
-            {
-                spdlog::error("Error reading login packet: {}", ec.message());
-                co_return nullptr;
-            }
+                error_code ec;
+                const size_t read = co_await transport_->receive(stream_.prepare(), ec);
 
-            auto packetReader = net::packet_reader(incoming);
-            auto [status, data, error] = WormsPacket::readFrom(packetReader);
-            if (status == net::packet_parse_status::error)
-            {
-                spdlog::error("Error reading login packet: {}", error.value_or(""));
-                co_return nullptr;
-            }
+                if (read == 0 || ec)
+                {
+                    spdlog::error("Error reading login packet: {}", ec ? ec.message() : "connection closed");
+                    co_return nullptr;
+                }
 
-            if (status == net::packet_parse_status::partial)
-            {
-                spdlog::error("Login packet is empty");
-                co_return nullptr;
-            }
-            if (!data)
-            {
-                spdlog::error("Login packet has no data");
-                co_return nullptr;
+                CountMetric(MetricCounter::BytesIn, read);
+                stream_.commit(read);
             }
 
-            const auto& login_info = *data;
+            // Cancel the timer since we got the whole packet
+            timer.cancel();
+
             if (login_info->code() != PacketCode::Login)
             {
                 spdlog::error("Invalid packet code in login packet");
@@ -330,40 +617,75 @@ namespace worms_server
 
 
             const std::string_view username = *login_info->fields().name;
+            loginInfo_ = *login_info->fields().info;
+
+            // A client that dropped moments ago takes its user back without anyone else being told
+            if (auto [resumed, previous] = SessionResume::getInstance().resume(username, address_, loginInfo_);
+                resumed != nullptr)
+            {
+                // Adopted again after the rebind for whatever was queued on the old session in between.
+                adoptBacklog(*previous);
+                resumed->rebind(shared_from_this());
+                adoptBacklog(*previous);
+
+                // The client logs in afresh and thinks it is in the lobby, so that is where the user goes.
+                if (const uint32_t roomId = resumed->getRoomId(); roomId != 0)
+                {
+                    database_->setUserRoomId(resumed->getId(), 0);
+                    if (database_->getRoom(roomId) != nullptr)
+                    {
+                        auto& presence = PresenceCoalescer::getInstance();
+                        presence.publish(WormsPacket::freeze(PacketCode::Leave,
+                                                             {.value2 = roomId, .value10 = resumed->getId()}),
+                                         resumed->getId(), PresenceKey::left(resumed->getId(), roomId));
+
+                        const std::array left{roomId};
+                        for (const uint32_t closedId : database_->removeEmptyRooms(left))
+                        {
+                            presence.publish(WormsPacket::freeze(PacketCode::Close, {.value10 = closedId}),
+                                             resumed->getId(), PresenceKey::roomClosed(closedId));
+                        }
+                    }
+                }
+
+                spdlog::info("User {} resumed their session", username);
+                sendReply(WormsPacket::freeze(PacketCode::LoginReply, {.value1 = resumed->getId(), .error = 0}));
+                co_return resumed;
+            }
 
             // check if a username is valid and not already taken
-            const auto currentUsers = database_->getUsers();
-            const auto foundUser = std::ranges::find_if(currentUsers,
-                                                        [&username](const auto& user)
-                                                        {
-                                                            return EqualsCaseInsensitive(user->getName(), username);
-                                                        });
-
-            if (foundUser != currentUsers.end())
+            if (database_->isUserNameTaken(username))
             {
                 const auto bytes = WormsPacket::freeze(PacketCode::LoginReply, {.value1 = 0, .error = 1});
-                co_await socket_.async_write_some(buffer(bytes->data(), bytes->size()), use_awaitable);
+                const std::array reply{buffer(bytes->data(), bytes->size())};
+                capture(CaptureEvent::Outbound, bytes->bytes());
+                CountPacketsOut(bytes->bytes());
+                if (shadow_)
+                {
+                    shadow_->outbound(bytes);
+                }
+                error_code ec;
+                co_await transport_->write(reply, ec);
                 co_return nullptr;
             }
 
             // create a new user and add it to the database
             userId = Database::getNextId();
-            auto clientUser =
-                std::make_shared<User>(shared_from_this(), userId, username, login_info->fields().info->playerNation);
+            auto clientUser = std::allocate_shared<User>(SlabAllocator<User>(), shared_from_this(), userId, username,
+                                                         login_info->fields().info->playerNation);
 
             // Notify other users we've logged in
             const auto packetBytes = WormsPacket::freeze(PacketCode::Login,
                                                          {.value1 = userId, .value4 = 0, .name = username.data(),
                                                           .info = clientUser->getSessionInfo()});
-            for (const auto& user : database_->getUsers())
-            {
-                user->sendPacket(packetBytes);
-            }
+            auto& presence = PresenceCoalescer::getInstance();
+            presence.publish(packetBytes, userId, PresenceKey::loggedIn(userId));
+            presence.noteLogin(userId);
 
             database_->addUser(clientUser);
 
             // Send the login reply packet
-            sendPacket(WormsPacket::freeze(PacketCode::LoginReply, {.value1 = userId, .error = 0}));
+            sendReply(WormsPacket::freeze(PacketCode::LoginReply, {.value1 = userId, .error = 0}));
 
             co_return std::move(clientUser);
         }
@@ -378,50 +700,19 @@ namespace worms_server
     {
         try
         {
-            net::framed_packet_reader<WormsPacketPtr, std::string> reader(WormsPacket::readFrom);
-
             static constexpr auto TIMEOUT_DELAY = std::chrono::minutes(10);
             const std::string_view username = user_->getName();
 
-            steady_timer timer(socket_.get_executor());
-            std::vector<std::byte> incoming(2048);
-            while (socket_.is_open())
+            ServerTimer timer(transport_->executor());
+            while (transport_->isOpen())
             {
                 try
                 {
-                    timer.expires_after(TIMEOUT_DELAY);
-                    timer.async_wait([&](const error_code& wait_ec)
-                    {
-                        if (!wait_ec && socket_.is_open())
-                        {
-                            // Timer expired, close the socket
-                            socket_.close();
-                        }
-                    });
-
-                    error_code ec;
-                    const size_t read =
-                        co_await socket_.async_receive(buffer(incoming), redirect_error(use_awaitable, ec));
-
-                    // Cancel the timer since we got data
-                    timer.cancel();
-
-
-                    if (read == 0 || ec == error::eof)
-                    {
-                        spdlog::info("User {} disconnected", username);
-                        break;
-                    }
-                    if (ec)
-                    {
-                        spdlog::error("Error receiving data: {}", ec.message());
-                        break;
-                    }
-
-                    reader.append(incoming.data(), read);
+                    // Handle every complete packet already buffered, including any that came in behind the login
+                    auto received = ServerClock::now();
                     while (true)
                     {
-                        const auto [status, data, error] = reader.try_read_packet();
+                        const auto [status, data, error] = stream_.tryReadPacket();
                         if (status == net::packet_parse_status::partial)
                         {
                             // Needs more data
@@ -432,18 +723,84 @@ namespace worms_server
                         {
                             // Invalid data
                             spdlog::error("Parse error: {}", error.value_or(""));
+                            CountMetric(MetricCounter::ParseErrors);
+                            resumable_ = false;
                             co_return;
                         }
 
                         spdlog::debug(
                             "Received packet code {} from {}", static_cast<uint32_t>(data.value()->code()), username);
+                        capture(CaptureEvent::Inbound, stream_.currentFrame());
 
-                        if (!co_await PacketHandler::handlePacket(user_, database_, *data))
+                        const auto code = data.value()->code();
+                        CountPacketIn(code);
+                        if (shadow_)
+                        {
+                            shadow_->inbound(stream_.currentFrame(), code);
+                        }
+                        if (const auto verdict = rateLimiter_.admit(code, received))
+                        {
+                            if (verdict->action == RateLimitAction::Disconnect)
+                            {
+                                spdlog::warn("User {} exceeded the rate limit for packet code {}, disconnecting",
+                                             username, static_cast<uint32_t>(code));
+                                resumable_ = false;
+                                co_return;
+                            }
+
+                            if (verdict->action == RateLimitAction::Reply)
+                            {
+                                PacketHandler::rejectPacket(user_, code);
+                                continue;
+                            }
+
+                            // Delay: holding the reader also stops the client's socket from being drained.
+                            timer.expires_after(verdict->wait);
+                            error_code delayEc;
+                            co_await timer.async_wait(Recycled(redirect_error(use_awaitable, delayEc)));
+                            received = ServerClock::now();
+                        }
+
+                        // Handlers never suspend, so the span stays on this thread.
+                        const TraceScope trace(traceId_ != 0, TracePacketName(code), traceId_);
+                        if (!co_await PacketHandler::handlePacket(user_, database_, *data, received))
                         {
                             spdlog::warn("Packet handler failed or returned false");
+                            resumable_ = false;
                             co_return;
                         }
                     }
+
+                    timer.expires_after(TIMEOUT_DELAY);
+                    timer.async_wait(Recycled([&](const error_code& wait_ec)
+                    {
+                        if (!wait_ec)
+                        {
+                            // Timer expired; the handler may run on any io thread, so the close goes via the strand
+                            closeConnection();
+                        }
+                    }));
+
+                    error_code ec;
+                    const size_t read = co_await transport_->receive(stream_.prepare(), ec);
+
+                    // Cancel the timer since we got data
+                    timer.cancel();
+
+
+                    if (read == 0 || ec == error::eof)
+                    {
+                        spdlog::info("User {} disconnected", username);
+                        break;
+                    }
+                    if (ec)
+                    {
+                        spdlog::error("Error receiving data: {}", ec.message());
+                        break;
+                    }
+
+                    CountMetric(MetricCounter::BytesIn, read);
+                    stream_.commit(read);
                 }
                 catch (const std::exception& e)
                 {
@@ -6,6 +6,8 @@
 
 #include <algorithm>
 #include <array>
+#include <bit>
+#include <cstring>
 #include <ostream>
 #include <utility>
 
@@ -15,15 +17,30 @@
 #include "windows_1251.hpp"
 #include "windows_1252.hpp"
 
+namespace
+{
+    using namespace worms_server;
+
+    constexpr bool CodeExists(const uint32_t code, const PacketSource source)
+    {
+        return source == PacketSource::Client ? PacketCodeExists(code) : ServerPacketCodeExists(code);
+    }
+}
+
 namespace worms_server
 {
     std::atomic<bool> WormsPacket::useWindows1252Encoding{false};
 
-    net::shared_bytes_ptr WormsPacket::freeze(const PacketCode code, PacketFields fields)
+    PacketBufferPtr WormsPacket::freeze(const PacketCode code, PacketFields fields)
     {
-        net::packet_writer writer;
-        WormsPacket{code, std::move(fields)}.writeTo(writer);
-        return std::move(writer).to_shared();
+        const WormsPacket packet{code, std::move(fields)};
+        const auto encoded = packet.encodeStrings();
+
+        return PacketBuffer::create(packet.wireLength(encoded), [&](const std::span<net::byte> target)
+        {
+            PacketWriter writer(target);
+            packet.writeTo(writer, encoded);
+        });
     }
 
     WormsPacket::WormsPacket(const PacketCode code, PacketFields fields) :
@@ -31,14 +48,14 @@ namespace worms_server
     {
     }
 
-    net::deserialization_result<WormsPacketPtr, std::string> WormsPacket::readFrom(net::packet_reader& reader) // NOLINT(*-function-cognitive-complexity)
+    net::deserialization_result<WormsPacketPtr, std::string> WormsPacket::readFrom(net::packet_reader& reader, const PacketSource source) // NOLINT(*-function-cognitive-complexity)
     {
         if (!reader.can_read(sizeof(uint32_t) * 2))
         {
             return {.status = net::packet_parse_status::partial};
         }
         const uint32_t codeValue = *reader.read_le<uint32_t>();
-        if (!PacketCodeExists(codeValue))
+        if (!CodeExists(codeValue, source))
         {
             return {
                 .status = net::packet_parse_status::error, .error = std::format("Unknown packet code: {}", codeValue)};
@@ -226,6 +243,88 @@ namespace worms_server
         return {.status = net::packet_parse_status::complete, .data = std::make_optional(std::move(packet))};
     }
 
+    net::deserialization_result<size_t, std::string> WormsPacket::peekFrameLength(
+        const std::span<const net::byte> bytes, const PacketSource source)
+    {
+        static constexpr size_t HEADER_LENGTH = sizeof(uint32_t) * 2;
+        static constexpr size_t SESSION_INFO_LENGTH = 50;
+
+        if (bytes.size() < HEADER_LENGTH)
+        {
+            return {.status = net::packet_parse_status::partial};
+        }
+
+        const auto readU32 = [bytes](const size_t offset)
+        {
+            uint32_t value = 0;
+            std::memcpy(&value, bytes.data() + offset, sizeof(value));
+            return std::endian::native == std::endian::little ? value : std::byteswap(value);
+        };
+
+        const uint32_t codeValue = readU32(0);
+        if (!CodeExists(codeValue, source))
+        {
+            return {
+                .status = net::packet_parse_status::error, .error = std::format("Unknown packet code: {}", codeValue)};
+        }
+
+        const uint32_t flags = readU32(sizeof(uint32_t));
+        size_t length = HEADER_LENGTH;
+
+        for (const auto flag : {PacketFlags::Value0, PacketFlags::Value1, PacketFlags::Value2, PacketFlags::Value3,
+                                PacketFlags::Value4, PacketFlags::Value10})
+        {
+            if (HasFlag(flags, flag))
+            {
+                length += sizeof(uint32_t);
+            }
+        }
+
+        size_t dataLength = 0;
+        if (HasFlag(flags, PacketFlags::DataLength))
+        {
+            if (bytes.size() < length + sizeof(uint32_t))
+            {
+                return {.status = net::packet_parse_status::partial};
+            }
+
+            dataLength = readU32(length);
+            if (dataLength > MAX_DATA_LENGTH)
+            {
+                return {.status = net::packet_parse_status::error,
+                        .error = std::format("Data length is too big: {}", dataLength)};
+            }
+            length += sizeof(uint32_t);
+        }
+
+        if (HasFlag(flags, PacketFlags::Data))
+        {
+            length += dataLength;
+        }
+
+        if (HasFlag(flags, PacketFlags::Error))
+        {
+            length += sizeof(uint32_t);
+        }
+
+        if (HasFlag(flags, PacketFlags::Name))
+        {
+            length += MAX_NAME_LENGTH;
+        }
+
+        if (HasFlag(flags, PacketFlags::SessionInfo))
+        {
+            length += SESSION_INFO_LENGTH;
+        }
+
+        if (bytes.size() < length)
+        {
+            return {.status = net::packet_parse_status::partial};
+        }
+
+        return {.status = net::packet_parse_status::complete, .data = length};
+    }
+
     PacketCode WormsPacket::code() const
     {
         return code_;
@@ -312,7 +411,53 @@ namespace worms_server
             : Windows1251::decode(input);
     }
 
-    void WormsPacket::writeTo(net::packet_writer& writer) const
+    WormsPacket::EncodedStrings WormsPacket::encodeStrings() const
+    {
+        EncodedStrings encoded;
+        if (fields_.data)
+        {
+            encoded.data = encodeString(*fields_.data);
+        }
+        if (fields_.name)
+        {
+            encoded.name = encodeString(*fields_.name);
+        }
+        return encoded;
+    }
+
+    size_t WormsPacket::wireLength(const EncodedStrings& encoded) const
+    {
+        static constexpr size_t SESSION_INFO_LENGTH = 50;
+
+        size_t length = sizeof(uint32_t) * 2;
+        for (const auto& value : {fields_.value0, fields_.value1, fields_.value2, fields_.value3, fields_.value4,
+                                  fields_.value10, fields_.error})
+        {
+            if (value)
+            {
+                length += sizeof(uint32_t);
+            }
+        }
+
+        if (encoded.data)
+        {
+            length += sizeof(uint32_t) + encoded.data->size() + 1;
+        }
+
+        if (encoded.name)
+        {
+            length += MAX_NAME_LENGTH;
+        }
+
+        if (fields_.info)
+        {
+            length += SESSION_INFO_LENGTH;
+        }
+
+        return length;
+    }
+
+    void WormsPacket::writeTo(PacketWriter& writer, const EncodedStrings& encoded) const
     {
         writer.write_le(static_cast<uint32_t>(code_));
         writer.write_le(getFlagsFromFields());
@@ -347,13 +492,10 @@ namespace worms_server
             writer.write_le(*fields_.value10);
         }
 
-        if (fields_.data)
+        if (encoded.data)
         {
-            const auto& str = *fields_.data;
-            const auto encoded = encodeString(str);
-
-            writer.write_le(static_cast<uint32_t>(encoded.size() + 1));
-            writer.write_bytes(std::as_bytes(std::span{encoded}));
+            writer.write_le(static_cast<uint32_t>(encoded.data->size() + 1));
+            writer.write_bytes(std::as_bytes(std::span{*encoded.data}));
             writer.write(std::byte{0});
         }
 
@@ -362,11 +504,9 @@ namespace worms_server
             writer.write_le(*fields_.error);
         }
 
-        if (fields_.name)
+        if (encoded.name)
         {
-            const auto encoded = encodeString(*fields_.name);
-
-            const auto encodedBytes = std::as_bytes(std::span{encoded});
+            const auto encodedBytes = std::as_bytes(std::span{*encoded.name});
 
             // Name is a fixed size string of 20 chars
             std::array<net::byte, MAX_NAME_LENGTH> buffer{};